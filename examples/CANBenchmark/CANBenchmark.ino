@@ -0,0 +1,316 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// Benchmarks the CAN driver of this board against a second board running the
+// same sketch as the peer. Results are printed as one JSON object per line.
+//
+// The device under test measures:
+//  - endPacket() call to TX complete time
+//  - maximum sustained TX rate
+//  - packet timestamp to receive callback delay, this only covers the readout
+//    where the driver stamps a packet when it is parsed (MCP2515, ESP32), and
+//    includes the frame time where it is stamped at the start of the frame
+//    (SAME5x)
+//  - RX loss and CPU utilization while the peer loads the bus in steps
+
+#include <CAN.h>
+#include <CANTraffic.h>
+
+// set to true on the board generating the load
+const bool peer = false;
+
+const long bitRate = 500E3;
+const int loadSteps[] = { 10, 25, 50, 75, 90, 100 };
+const unsigned long stepDuration = 2000;
+
+const long ID_START = 0x7f0;
+const long ID_STEP = 0x7f1;
+const long ID_DONE = 0x7f2;
+const long ID_TX = 0x7a0;
+
+#if defined(ADAFRUIT_FEATHER_M4_CAN)
+const char driver[] = "CANSAME5x";
+#elif defined(ARDUINO_ARCH_ESP32)
+const char driver[] = "ESP32SJA1000";
+#else
+const char driver[] = "MCP2515";
+#endif
+
+CANTrafficGenerator trafficGenerator(CAN);
+CANTrafficAnalyzer trafficAnalyzer(CAN);
+
+volatile int currentLoad = -1;
+volatile bool stepChanged = false;
+volatile bool done = false;
+
+volatile unsigned long latencyCount = 0;
+volatile unsigned long latencyMin = 0;
+volatile unsigned long latencyMax = 0;
+volatile unsigned long latencySum = 0;
+
+unsigned long idlePerMs = 0;
+unsigned long idleCount = 0;
+unsigned long stepStart = 0;
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial);
+
+  if (!CAN.begin(bitRate)) {
+    Serial.println("{\"error\":\"starting CAN failed\"}");
+    while (1);
+  }
+
+  if (peer) {
+    runPeer();
+    return;
+  }
+
+  measureIdle();
+  measureTxLatency();
+  measureTxRate();
+
+  trafficAnalyzer.setIds(0x100, 0x1ff);
+  CAN.onReceive(onReceive);
+
+  // tell the peer to start loading the bus
+  CAN.beginPacket(ID_START);
+  CAN.endPacket();
+}
+
+// measureIdle() calibrates with this same loop body, before the receive
+// callback is installed
+void loop() {
+  if (peer) {
+    return;
+  }
+
+  idleCount++;
+
+  if (stepChanged) {
+    stepChanged = false;
+
+    printStep();
+  }
+
+  if (done) {
+    done = false;
+
+    printStep();
+    Serial.println("{\"bench\":\"done\"}");
+  }
+}
+
+void onReceive(int packetSize) {
+  unsigned long latency = micros() - CAN.packetTimestamp();
+
+  long id = CAN.packetId();
+
+  if (id == ID_STEP) {
+    stepChanged = true;
+    return;
+  } else if (id == ID_DONE) {
+    done = true;
+    return;
+  }
+
+  if (latencyCount == 0 || latency < latencyMin) {
+    latencyMin = latency;
+  }
+  if (latency > latencyMax) {
+    latencyMax = latency;
+  }
+  latencySum += latency;
+  latencyCount++;
+
+  trafficAnalyzer.handlePacket();
+}
+
+void measureIdle() {
+  unsigned long start = millis();
+
+  idleCount = 0;
+
+  while (millis() - start < 1000) {
+    loop();
+  }
+
+  idlePerMs = idleCount / 1000;
+  idleCount = 0;
+}
+
+void measureTxLatency() {
+  const int samples = 200;
+  unsigned long callMin = 0, callMax = 0, callSum = 0;
+  unsigned long wireMin = 0, wireMax = 0, wireSum = 0;
+  int errors = 0;
+
+  for (int i = 0; i < samples; i++) {
+    unsigned long start = micros();
+
+    CAN.beginPacket(ID_TX);
+    CAN.write((const uint8_t*)"benchmrk", 8);
+    if (!CAN.endPacket()) {
+      errors++;
+    }
+
+    unsigned long call = micros() - start;
+    unsigned long wire = CAN.txTimestamp() - start;
+
+    if (i == 0 || call < callMin) callMin = call;
+    if (call > callMax) callMax = call;
+    callSum += call;
+
+    if (i == 0 || wire < wireMin) wireMin = wire;
+    if (wire > wireMax) wireMax = wire;
+    wireSum += wire;
+
+    delay(1);
+  }
+
+  printHeader("tx_latency");
+  printField("samples", samples);
+  printField("errors", errors);
+  printField("call_min_us", callMin);
+  printField("call_avg_us", callSum / samples);
+  printField("call_max_us", callMax);
+  printField("wire_min_us", wireMin);
+  printField("wire_avg_us", wireSum / samples);
+  printField("wire_max_us", wireMax);
+  Serial.println("}");
+}
+
+void measureTxRate() {
+  unsigned long sent = 0;
+  unsigned long errors = 0;
+  unsigned long start = millis();
+
+  while (millis() - start < 1000) {
+    CAN.beginPacket(ID_TX);
+    CAN.write((const uint8_t*)"benchmrk", 8);
+
+    if (CAN.endPacket()) {
+      sent++;
+    } else {
+      errors++;
+    }
+  }
+
+  printHeader("tx_rate");
+  printField("frames_per_s", sent);
+  printField("errors", errors);
+  Serial.println("}");
+}
+
+void printStep() {
+  unsigned long elapsed = millis() - stepStart;
+
+  // the receive callback updates the counters, take them and start the
+  // next step in one go
+  noInterrupts();
+  unsigned long count = latencyCount;
+  unsigned long minimum = latencyMin;
+  unsigned long maximum = latencyMax;
+  unsigned long sum = latencySum;
+  unsigned long received = trafficAnalyzer.received();
+  unsigned long lost = trafficAnalyzer.lost();
+  unsigned long reordered = trafficAnalyzer.reordered();
+  unsigned long duplicates = trafficAnalyzer.duplicates();
+
+  latencyCount = 0;
+  latencyMin = 0;
+  latencyMax = 0;
+  latencySum = 0;
+  trafficAnalyzer.reset();
+  interrupts();
+
+  if (currentLoad >= 0 && elapsed > 0) {
+    unsigned long idleExpected = idlePerMs * elapsed;
+    long cpu = 100;
+
+    if (idleExpected > 0 && idleCount < idleExpected) {
+      cpu = 100 - (long)((idleCount * 100) / idleExpected);
+    } else if (idleExpected > 0) {
+      cpu = 0;
+    }
+
+    printHeader("rx_load");
+    printField("load_percent", currentLoad);
+    printField("received", received);
+    printField("lost", lost);
+    printField("reordered", reordered);
+    printField("duplicates", duplicates);
+    printField("stamp_to_callback_min_us", minimum);
+    printField("stamp_to_callback_avg_us", count ? sum / count : 0);
+    printField("stamp_to_callback_max_us", maximum);
+    printField("cpu_percent", cpu);
+    Serial.println("}");
+  }
+
+  currentLoad = nextLoad();
+  idleCount = 0;
+  stepStart = millis();
+}
+
+int nextLoad() {
+  static int step = 0;
+
+  if (step < (int)(sizeof(loadSteps) / sizeof(loadSteps[0]))) {
+    return loadSteps[step++];
+  }
+
+  return -1;
+}
+
+void runPeer() {
+  // wait for the device under test to finish its TX measurements
+  while (!(CAN.parsePacket() && CAN.packetId() == ID_START));
+
+  trafficGenerator.setIds(0x100, 0x1ff);
+  trafficGenerator.setDlc(8);
+
+  for (unsigned int i = 0; i < sizeof(loadSteps) / sizeof(loadSteps[0]); i++) {
+    CAN.beginPacket(ID_STEP);
+    CAN.write((uint8_t)loadSteps[i]);
+    CAN.endPacket();
+
+    trafficGenerator.begin(bitRate, loadSteps[i]);
+
+    unsigned long start = millis();
+    while (millis() - start < stepDuration) {
+      trafficGenerator.update();
+    }
+
+    trafficGenerator.end();
+  }
+
+  CAN.beginPacket(ID_DONE);
+  CAN.endPacket();
+}
+
+void printHeader(const char* bench) {
+  Serial.print("{\"bench\":\"");
+  Serial.print(bench);
+  Serial.print("\",\"driver\":\"");
+  Serial.print(driver);
+  Serial.print("\",\"bit_rate\":");
+  Serial.print(bitRate);
+}
+
+void printField(const char* name, unsigned long value) {
+  Serial.print(",\"");
+  Serial.print(name);
+  Serial.print("\":");
+  Serial.print(value);
+}
+
+void printField(const char* name, long value) {
+  Serial.print(",\"");
+  Serial.print(name);
+  Serial.print("\":");
+  Serial.print(value);
+}
+
+void printField(const char* name, int value) {
+  printField(name, (long)value);
+}
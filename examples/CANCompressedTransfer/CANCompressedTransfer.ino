@@ -0,0 +1,77 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <CAN.h>
+#include <CANIsoTp.h>
+#include <CANCompression.h>
+
+// set to true on the sending node
+const bool sender = false;
+
+// the sender transmits on 0x7e0 and listens on 0x7e8, the receiver the reverse
+CANIsoTp isotp(CAN, sender ? 0x7e0 : 0x7e8, sender ? 0x7e8 : 0x7e0);
+
+// sender: data written to the compressor is sent through ISO-TP
+CANCompressor compressor(isotp);
+
+// receiver: ISO-TP data is decompressed and printed to Serial
+CANDecompressor decompressor(Serial);
+
+void setup() {
+  Serial.begin(9600);
+  while (!Serial);
+
+  Serial.println("CAN Compressed Transfer");
+
+  // start the CAN bus at 500 kbps
+  if (!CAN.begin(500E3)) {
+    Serial.println("Starting CAN failed!");
+    while (1);
+  }
+
+  if (sender) {
+    // flow control frames are handled as they arrive, while send() waits
+    CAN.onReceive(onReceive);
+  }
+
+  // the decompressor is reset when a message is cut off
+  isotp.setSink(decompressor);
+  isotp.onError(onError);
+}
+
+void onReceive(int packetSize) {
+  isotp.handlePacket();
+}
+
+void onError(int error) {
+  Serial.print("ISO-TP error ");
+  Serial.println(error);
+}
+
+void loop() {
+  if (sender) {
+    Serial.print("Sending compressed text ... ");
+
+    for (int i = 0; i < 20; i++) {
+      compressor.print("The quick brown fox jumps over the lazy dog. ");
+      compressor.println(i);
+    }
+
+    // end the stream and send what is still buffered
+    compressor.flush();
+
+    Serial.print(compressor.bytesIn());
+    Serial.print(" bytes in, ");
+    Serial.print(compressor.bytesOut());
+    Serial.println(" bytes on the bus");
+
+    delay(5000);
+    return;
+  }
+
+  if (CAN.parsePacket()) {
+    isotp.handlePacket();
+  }
+
+  isotp.update();
+}
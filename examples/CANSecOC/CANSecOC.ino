@@ -0,0 +1,70 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <CAN.h>
+#include <CANSecOC.h>
+
+// both nodes must share the same 128-bit key
+const uint8_t key[16] = {
+  0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+  0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c
+};
+
+// set to true on the sending node
+const bool sender = false;
+
+CANSecOC secoc(CAN);
+
+void setup() {
+  Serial.begin(9600);
+  while (!Serial);
+
+  Serial.println("CAN SecOC");
+
+  // start the CAN bus at 500 kbps
+  if (!CAN.begin(500E3)) {
+    Serial.println("Starting CAN failed!");
+    while (1);
+  }
+
+  secoc.setKey(key);
+
+  // id 0x12 carries 4 data bytes, 1 freshness byte and a 3 byte MAC
+  secoc.addId(0x12, 4, 1, 3);
+}
+
+void loop() {
+  if (sender) {
+    uint8_t data[4] = { 'h', 'e', 'l', 'o' };
+
+    Serial.print("Sending authenticated packet ... ");
+    secoc.send(0x12, data, sizeof(data));
+    Serial.println("done");
+
+    delay(1000);
+    return;
+  }
+
+  if (CAN.parsePacket()) {
+    uint8_t data[8];
+    int length = secoc.handlePacket(data);
+
+    if (length == CAN_SECOC_NOT_PROTECTED) {
+      return;
+    }
+
+    Serial.print("Received packet with id 0x");
+    Serial.print(CAN.packetId(), HEX);
+
+    if (length == CAN_SECOC_FAILED) {
+      Serial.println(" that failed authentication!");
+      return;
+    }
+
+    Serial.print(" and authentic data ");
+    for (int i = 0; i < length; i++) {
+      Serial.print((char)data[i]);
+    }
+    Serial.println();
+  }
+}
@@ -0,0 +1,62 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <CAN.h>
+#include <CANTimeSync.h>
+
+// set to true on exactly one node of the bus
+const bool master = false;
+
+CANTimeSync timeSync(CAN);
+
+void setup() {
+  Serial.begin(9600);
+  while (!Serial);
+
+  Serial.println("CAN Time Sync");
+
+  // start the CAN bus at 500 kbps
+  if (!CAN.begin(500E3)) {
+    Serial.println("Starting CAN failed!");
+    while (1);
+  }
+
+  if (master) {
+    // send a SYNC and FOLLOW UP pair every second
+    timeSync.beginMaster(1000);
+  } else {
+    timeSync.begin();
+
+    // receive in interrupt context, so frames are timestamped on arrival
+    CAN.onReceive(onReceive);
+  }
+}
+
+void loop() {
+  if (master) {
+    timeSync.update();
+    return;
+  }
+
+  static unsigned long lastPrint = 0;
+
+  if (millis() - lastPrint >= 1000) {
+    lastPrint = millis();
+
+    if (timeSync.synchronized()) {
+      Serial.print("master time ");
+      Serial.print(timeSync.now());
+      Serial.print(" us, last error ");
+      Serial.print(timeSync.lastError());
+      Serial.print(" us, drift ");
+      Serial.print(timeSync.drift());
+      Serial.println(" ppb");
+    } else {
+      Serial.println("waiting for master");
+    }
+  }
+}
+
+void onReceive(int packetSize) {
+  timeSync.handlePacket();
+}
@@ -0,0 +1,58 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <CAN.h>
+#include <CANTraffic.h>
+
+// set to true on the node generating the load
+const bool generator = false;
+
+CANTrafficGenerator trafficGenerator(CAN);
+CANTrafficAnalyzer trafficAnalyzer(CAN);
+
+void setup() {
+  Serial.begin(9600);
+  while (!Serial);
+
+  Serial.println("CAN Traffic Generator");
+
+  // start the CAN bus at 500 kbps
+  if (!CAN.begin(500E3)) {
+    Serial.println("Starting CAN failed!");
+    while (1);
+  }
+
+  if (generator) {
+    // random ids 0x100 - 0x1ff, mostly full packets, in bursts of 4
+    const uint8_t dlcWeights[9] = { 0, 0, 1, 0, 1, 0, 2, 0, 8 };
+
+    trafficGenerator.setIds(0x100, 0x1ff, true);
+    trafficGenerator.setDlcDistribution(dlcWeights);
+    trafficGenerator.setBurst(4);
+    trafficGenerator.setSeed(42);
+
+    // 30 % bus load
+    trafficGenerator.begin(500E3, 30);
+  } else {
+    trafficAnalyzer.setIds(0x100, 0x1ff);
+  }
+}
+
+void loop() {
+  if (generator) {
+    trafficGenerator.update();
+    return;
+  }
+
+  while (CAN.parsePacket()) {
+    trafficAnalyzer.handlePacket();
+  }
+
+  static unsigned long lastReport = 0;
+
+  if (millis() - lastReport >= 5000) {
+    lastReport = millis();
+
+    trafficAnalyzer.printReport(Serial);
+  }
+}
@@ -0,0 +1,71 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// Tunnels CAN packets to a Linux host running cannelloni, for example:
+//
+//   sudo ip link add dev vcan0 type vcan && sudo ip link set up vcan0
+//   cannelloni -I vcan0 -R <board ip> -r 20000 -l 20000
+
+#include <WiFi.h>
+#include <WiFiUdp.h>
+
+#include <CAN.h>
+#include <CANUdpBridge.h>
+
+const char ssid[] = "your network";
+const char pass[] = "your password";
+
+// host running cannelloni
+IPAddress remoteIp(192, 168, 1, 2);
+
+WiFiUDP udp;
+CANUdpBridge bridge(CAN, udp);
+
+void setup() {
+  Serial.begin(9600);
+  while (!Serial);
+
+  Serial.println("CAN UDP Bridge");
+
+  WiFi.begin(ssid, pass);
+  while (WiFi.status() != WL_CONNECTED) {
+    delay(500);
+  }
+
+  Serial.print("IP address: ");
+  Serial.println(WiFi.localIP());
+
+  // start the CAN bus at 500 kbps
+  if (!CAN.begin(500E3)) {
+    Serial.println("Starting CAN failed!");
+    while (1);
+  }
+
+  bridge.begin(remoteIp);
+
+  // send a datagram at least every 2 ms, or as soon as 256 bytes are collected
+  bridge.setBatchWindow(2000);
+  bridge.setBatchSize(256);
+}
+
+void loop() {
+  while (CAN.parsePacket()) {
+    bridge.handlePacket();
+  }
+
+  // flushes an expired batch, and sends packets received from the host
+  bridge.update();
+
+  static unsigned long lastPrint = 0;
+
+  if (millis() - lastPrint >= 5000) {
+    lastPrint = millis();
+
+    Serial.print(bridge.packetsSent());
+    Serial.print(" packets in ");
+    Serial.print(bridge.datagramsSent());
+    Serial.print(" datagrams sent, ");
+    Serial.print(bridge.packetsReceived());
+    Serial.println(" packets received");
+  }
+}
@@ -0,0 +1,428 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// Host side runner of the CANBenchmark example: the driver runs against the
+// register model of its controller, and the model's ground truth is used
+// where the sketch has to make do with what the board can see:
+//  - irq_to_callback runs from the controller storing the packet, which is
+//    when it raises the interrupt, to the receive callback
+//  - wire runs from the endPacket() call to the end of the frame on the bus
+//  - lost is counted by the controller model, where the analyzer can't see
+//    packets lost at the end of a step
+//  - CPU utilization is the time spent in interrupt handlers, with the
+//    costs of the host profile printed first
+// Results are printed as one JSON object per line, as by the sketch. Checks
+// that fail are printed to stderr and make the exit code non-zero.
+
+#include <CAN.h>
+#include <CANTraffic.h>
+#include <HostCore.h>
+
+#include "models/HostCANBus.h"
+
+#if defined(ARDUINO_ARCH_ESP32)
+#include "soc/dport_reg.h"
+#include "soc/gpio_sig_map.h"
+
+#include "models/TWAIModel.h"
+
+const char driver[] = "ESP32SJA1000";
+
+typedef TWAIModel DeviceModel;
+
+DeviceModel* createModel(HostCANBus& bus)
+{
+  TWAIModel::Gates gates = { DPORT_PERIP_CLK_EN_REG, DPORT_CAN_CLK_EN, 0, 0, DPORT_PERIP_RST_EN_REG, DPORT_CAN_RST };
+
+  // 80 MHz APB clock, register reads over the APB take a few cycles
+  host::costs().registerAccess = 150;
+  host::costs().interruptEntry = 2000;
+
+  return new TWAIModel(bus, 0x3ff6b000, gates, ETS_CAN_INTR_SOURCE, 80000000);
+}
+
+uint64_t storedOfLastRead(DeviceModel* model)
+{
+  return model->lastReleasedStored();
+}
+
+unsigned long modelLost(DeviceModel* model)
+{
+  return model->overruns();
+}
+#else
+#include "models/MCP2515Model.h"
+
+const char driver[] = "MCP2515";
+
+typedef MCP2515Model DeviceModel;
+
+DeviceModel* createModel(HostCANBus& bus)
+{
+  // an AVR at 16 MHz: slow digitalWrite() and interrupt dispatch
+  host::costs().spiByteOverhead = 500;
+  host::costs().pinAccess = 3000;
+  host::costs().interruptEntry = 3000;
+
+  return new MCP2515Model(bus);
+}
+
+uint64_t storedOfLastRead(DeviceModel* model)
+{
+  return model->lastReadStored();
+}
+
+unsigned long modelLost(DeviceModel* model)
+{
+  return model->overflows();
+}
+#endif
+
+const long bitRate = 500E3;
+const int loadSteps[] = { 10, 25, 50, 75, 90, 100 };
+const unsigned long stepDuration = 1000;
+
+const long maxBitRates[] = { (long)125E3, (long)250E3, (long)500E3, (long)1000E3 };
+const int maxDlcs[] = { 8, 2 };
+
+const long ID_TX = 0x7a0;
+
+HostCANBus* bus;
+HostCANPeer* peer;
+DeviceModel* model;
+
+CANTrafficGenerator* trafficGenerator;
+CANTrafficAnalyzer trafficAnalyzer(CAN);
+
+struct Stats {
+  unsigned long count;
+  unsigned long min;
+  unsigned long max;
+  unsigned long long sum;
+
+  void reset() { count = 0; min = 0; max = 0; sum = 0; }
+
+  void add(unsigned long value)
+  {
+    if (count == 0 || value < min) min = value;
+    if (value > max) max = value;
+    sum += value;
+    count++;
+  }
+
+  unsigned long avg() { return count ? sum / count : 0; }
+};
+
+Stats irqToCallback;
+Stats stampToCallback;
+
+int failures = 0;
+
+void check(bool condition, const char* what)
+{
+  if (!condition) {
+    fprintf(stderr, "FAIL: %s: %s\n", driver, what);
+    failures++;
+  }
+}
+
+void printHeader(const char* bench, long rate)
+{
+  Serial.print("{\"bench\":\"");
+  Serial.print(bench);
+  Serial.print("\",\"driver\":\"");
+  Serial.print(driver);
+  Serial.print("\",\"runner\":\"host\",\"bit_rate\":");
+  Serial.print(rate);
+}
+
+void printField(const char* name, unsigned long value)
+{
+  Serial.print(",\"");
+  Serial.print(name);
+  Serial.print("\":");
+  Serial.print(value);
+}
+
+void onReceive(int)
+{
+  unsigned long now = micros();
+
+  irqToCallback.add(now - storedOfLastRead(model) / 1000);
+  stampToCallback.add(now - CAN.packetTimestamp());
+
+  trafficAnalyzer.handlePacket();
+}
+
+void run(unsigned long ms)
+{
+  uint64_t end = host::now() + (uint64_t)ms * 1000000;
+
+  while (host::now() < end) {
+    trafficGenerator->update();
+    host::advance(10000);
+  }
+}
+
+void printHostModel()
+{
+  host::Costs& costs = host::costs();
+
+  printHeader("host_model", bitRate);
+  printField("spi_byte_overhead_ns", costs.spiByteOverhead);
+  printField("pin_access_ns", costs.pinAccess);
+  printField("register_access_ns", costs.registerAccess);
+  printField("interrupt_entry_ns", costs.interruptEntry);
+  printField("yield_ns", costs.yield);
+  Serial.println("}");
+}
+
+void measureTxLatency()
+{
+  const int samples = 200;
+  Stats call, request, wire;
+  int errors = 0;
+
+  call.reset();
+  request.reset();
+  wire.reset();
+  model->clearTransmitted();
+
+  for (int i = 0; i < samples; i++) {
+    uint64_t start = host::now();
+
+    CAN.beginPacket(ID_TX);
+    CAN.write((const uint8_t*)"benchmrk", 8);
+    if (!CAN.endPacket()) {
+      errors++;
+    }
+
+    call.add((host::now() - start) / 1000);
+
+    if (model->transmitted().size() == (size_t)(i + 1)) {
+      request.add((model->transmitted().back().requested - start) / 1000);
+      wire.add((model->transmitted().back().completed - start) / 1000);
+    } else {
+      errors++;
+    }
+
+    delay(1);
+  }
+
+  printHeader("tx_latency", bitRate);
+  printField("samples", samples);
+  printField("errors", errors);
+  printField("call_min_us", call.min);
+  printField("call_avg_us", call.avg());
+  printField("call_max_us", call.max);
+  printField("request_min_us", request.min);
+  printField("request_avg_us", request.avg());
+  printField("request_max_us", request.max);
+  printField("wire_min_us", wire.min);
+  printField("wire_avg_us", wire.avg());
+  printField("wire_max_us", wire.max);
+  Serial.println("}");
+
+  unsigned long frameTime = (HOST_CAN_STANDARD_FRAME_BITS + 64) * 1000000L / bitRate;
+
+  check(errors == 0, "every tx_latency packet is sent");
+  check(wire.min >= frameTime, "a packet is on the wire for at least its frame time");
+  check(call.max >= wire.max, "endPacket() returns after the packet is on the wire");
+  check(peer->log().size() == (size_t)samples, "the peer receives every tx_latency packet");
+
+  bool intact = true;
+
+  for (size_t i = 0; i < peer->log().size(); i++) {
+    const CANFrame& frame = peer->log()[i].frame;
+
+    intact &= frame.packetId() == ID_TX && frame.dlc == 8 && memcmp(frame.data, "benchmrk", 8) == 0;
+  }
+
+  check(intact, "the peer receives the packets as sent");
+}
+
+void measureTxRate()
+{
+  unsigned long sent = 0;
+  unsigned long errors = 0;
+  uint64_t start = host::now();
+
+  peer->clearLog();
+
+  while (host::now() - start < 1000000000ULL) {
+    CAN.beginPacket(ID_TX);
+    CAN.write((const uint8_t*)"benchmrk", 8);
+
+    if (CAN.endPacket()) {
+      sent++;
+    } else {
+      errors++;
+    }
+  }
+
+  unsigned long busMax = bitRate / (HOST_CAN_STANDARD_FRAME_BITS + 64);
+
+  printHeader("tx_rate", bitRate);
+  printField("frames_per_s", sent);
+  printField("errors", errors);
+  printField("bus_frames_per_s", busMax);
+  Serial.println("}");
+
+  check(errors == 0, "no tx_rate packet fails");
+  check(sent > busMax / 2, "the TX rate is more than half of the bus rate");
+  check(peer->log().size() == sent, "the peer receives every tx_rate packet");
+}
+
+void beginRx(long rate)
+{
+  CAN.end();
+
+  bus->setBitRate(rate);
+  peer->begin(rate);
+
+  check(CAN.begin(rate), "begin() at the step's bit rate");
+  check(model->bitRate() == rate, "the controller runs at the step's bit rate");
+  CAN.onReceive(onReceive);
+}
+
+void measureRxLoad()
+{
+  beginRx(bitRate);
+
+  for (unsigned int i = 0; i < sizeof(loadSteps) / sizeof(loadSteps[0]); i++) {
+    int load = loadSteps[i];
+    unsigned long lostBefore = modelLost(model);
+    uint64_t handlerBefore = host::interruptTime();
+    uint64_t start = host::now();
+
+    irqToCallback.reset();
+    stampToCallback.reset();
+    trafficAnalyzer.reset();
+
+    trafficGenerator->begin(bitRate, load);
+    run(stepDuration);
+    trafficGenerator->end();
+
+    uint64_t elapsed = host::now() - start;
+
+    // let the last packets through
+    run(10);
+
+    unsigned long lost = modelLost(model) - lostBefore;
+    unsigned long cpu = (host::interruptTime() - handlerBefore) * 100 / elapsed;
+
+    printHeader("rx_load", bitRate);
+    printField("load_percent", load);
+    printField("sent", trafficGenerator->sent());
+    printField("received", trafficAnalyzer.received());
+    printField("lost", lost);
+    printField("lost_detected", trafficAnalyzer.lost());
+    printField("reordered", trafficAnalyzer.reordered());
+    printField("duplicates", trafficAnalyzer.duplicates());
+    printField("irq_to_callback_min_us", irqToCallback.min);
+    printField("irq_to_callback_avg_us", irqToCallback.avg());
+    printField("irq_to_callback_max_us", irqToCallback.max);
+    printField("stamp_to_callback_min_us", stampToCallback.min);
+    printField("stamp_to_callback_avg_us", stampToCallback.avg());
+    printField("stamp_to_callback_max_us", stampToCallback.max);
+    printField("cpu_percent", cpu);
+    Serial.println("}");
+
+    check(trafficAnalyzer.received() + lost == trafficGenerator->sent(), "every rx_load packet is received or lost");
+    check(trafficAnalyzer.lost() <= lost, "the analyzer doesn't see more losses than there are");
+    check(trafficAnalyzer.reordered() == 0 && trafficAnalyzer.duplicates() == 0, "no rx_load packet is reordered or duplicated");
+    check(load > 50 || lost == 0, "nothing is lost up to 50% load");
+  }
+}
+
+void measureRxMax()
+{
+  unsigned long best = 0;
+  long bestBitRate = 0;
+
+  for (unsigned int r = 0; r < sizeof(maxBitRates) / sizeof(maxBitRates[0]); r++) {
+    for (unsigned int d = 0; d < sizeof(maxDlcs) / sizeof(maxDlcs[0]); d++) {
+      long rate = maxBitRates[r];
+      int dlc = maxDlcs[d];
+
+      beginRx(rate);
+
+      unsigned long lostBefore = modelLost(model);
+      uint64_t handlerBefore = host::interruptTime();
+      uint64_t start = host::now();
+
+      trafficAnalyzer.reset();
+      trafficGenerator->setDlc(dlc);
+      trafficGenerator->begin(rate, 100);
+      run(stepDuration);
+      trafficGenerator->end();
+
+      uint64_t elapsed = host::now() - start;
+
+      run(10);
+
+      unsigned long lost = modelLost(model) - lostBefore;
+      unsigned long received = trafficAnalyzer.received();
+      unsigned long cpu = (host::interruptTime() - handlerBefore) * 100 / elapsed;
+      unsigned long perSecond = (unsigned long)(received * 1000000000ULL / elapsed);
+
+      printHeader("rx_max", rate);
+      printField("dlc", dlc);
+      printField("sent", trafficGenerator->sent());
+      printField("received", received);
+      printField("lost", lost);
+      printField("received_frames_per_s", perSecond);
+      printField("cpu_percent", cpu);
+      Serial.println("}");
+
+      check(received + lost == trafficGenerator->sent(), "every rx_max packet is received or lost");
+
+      if (lost == 0 && perSecond > best) {
+        best = perSecond;
+        bestBitRate = rate;
+      }
+    }
+  }
+
+  trafficGenerator->setDlc(8);
+
+  printHeader("rx_max_lossless", bestBitRate);
+  printField("frames_per_s", best);
+  Serial.println("}");
+
+  check(best > 0, "some bit rate is received without loss");
+}
+
+int main()
+{
+  host::reset();
+
+  bus = new HostCANBus(bitRate);
+  model = createModel(*bus);
+  peer = new HostCANPeer(*bus);
+  peer->begin(bitRate);
+
+  trafficGenerator = new CANTrafficGenerator(*peer);
+  trafficGenerator->setIds(0x100, 0x1ff);
+  trafficGenerator->setDlc(8);
+  trafficAnalyzer.setIds(0x100, 0x1ff);
+
+  printHostModel();
+
+  if (!CAN.begin(bitRate)) {
+    Serial.println("{\"error\":\"starting CAN failed\"}");
+    return 1;
+  }
+
+  check(model->bitRate() == bitRate, "the controller runs at the requested bit rate");
+
+  measureTxLatency();
+  measureTxRate();
+  measureRxLoad();
+  measureRxMax();
+
+  Serial.println("{\"bench\":\"done\"}");
+  Serial.flush();
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,553 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <map>
+#include <vector>
+
+#include "Arduino.h"
+#include "HostCore.h"
+
+#define PIN_COUNT                  256
+
+// a level interrupt that is never released would hang the simulation
+#define MAX_HANDLER_RUNS           1000000
+
+namespace {
+
+struct PinInterrupt {
+  void (*fn)(void);
+  int mode;
+  bool pending;
+  bool masked;
+};
+
+struct SourceInterrupt {
+  void (*fn)(void*);
+  void* arg;
+  bool asserted;
+};
+
+struct RegisterRange {
+  uint32_t size;
+  host::RegisterDevice* device;
+};
+
+host::Costs hostCosts = { 250, 100, 100, 2000, 1000 };
+
+uint64_t currentTime = 0;
+std::multimap<uint64_t, std::function<void()> > events;
+
+int levels[PIN_COUNT];
+PinInterrupt pinInterrupts[PIN_COUNT];
+std::map<int, std::vector<std::function<void(int)> > > pinListeners;
+std::map<int, SourceInterrupt> sources;
+
+bool enabled = true;
+bool inHandler = false;
+uint64_t handlerTime = 0;
+unsigned long handlerCount = 0;
+
+std::vector<host::SPIDevice*> spiDevices;
+std::map<uint32_t, RegisterRange> registerRanges;
+std::map<uint32_t, uint32_t> memory;
+std::map<uint32_t, std::vector<std::function<void(uint32_t)> > > registerListeners;
+
+uint32_t seed = 1;
+
+void runHandler(std::function<void()> handler)
+{
+  uint64_t start = currentTime;
+
+  inHandler = true;
+  host::advance(hostCosts.interruptEntry);
+  handler();
+  inHandler = false;
+
+  handlerTime += currentTime - start;
+  handlerCount++;
+}
+
+void dispatch()
+{
+  unsigned long runs = 0;
+  bool again = true;
+
+  while (again && enabled && !inHandler) {
+    again = false;
+
+    for (int pin = 0; pin < PIN_COUNT && !again; pin++) {
+      PinInterrupt& interrupt = pinInterrupts[pin];
+
+      if (!interrupt.fn || interrupt.masked) {
+        continue;
+      }
+
+      bool fire = (interrupt.mode == LOW) ? (levels[pin] == LOW) : interrupt.pending;
+
+      if (fire) {
+        interrupt.pending = false;
+
+        runHandler(interrupt.fn);
+        again = true;
+      }
+    }
+
+    for (std::map<int, SourceInterrupt>::iterator it = sources.begin(); it != sources.end() && !again; ++it) {
+      if (it->second.fn && it->second.asserted) {
+        void (*fn)(void*) = it->second.fn;
+        void* arg = it->second.arg;
+
+        runHandler([fn, arg]() { fn(arg); });
+        again = true;
+      }
+    }
+
+    if (++runs > MAX_HANDLER_RUNS) {
+      fprintf(stderr, "interrupt never released\n");
+      abort();
+    }
+  }
+}
+
+RegisterRange* findRange(uint32_t address, uint32_t& base)
+{
+  std::map<uint32_t, RegisterRange>::iterator it = registerRanges.upper_bound(address);
+
+  if (it == registerRanges.begin()) {
+    return NULL;
+  }
+
+  --it;
+
+  if (address - it->first >= it->second.size) {
+    return NULL;
+  }
+
+  base = it->first;
+
+  return &it->second;
+}
+
+}
+
+namespace host {
+
+Costs& costs()
+{
+  return hostCosts;
+}
+
+void reset()
+{
+  currentTime = 0;
+  events.clear();
+
+  for (int i = 0; i < PIN_COUNT; i++) {
+    levels[i] = HIGH;
+    pinInterrupts[i].fn = NULL;
+    pinInterrupts[i].pending = false;
+    pinInterrupts[i].masked = false;
+  }
+
+  pinListeners.clear();
+  sources.clear();
+
+  enabled = true;
+  inHandler = false;
+  handlerTime = 0;
+  handlerCount = 0;
+
+  spiDevices.clear();
+  registerRanges.clear();
+  memory.clear();
+  registerListeners.clear();
+}
+
+uint64_t now()
+{
+  return currentTime;
+}
+
+void advance(uint64_t ns)
+{
+  uint64_t target = currentTime + ns;
+
+  while (!events.empty() && events.begin()->first <= target) {
+    std::multimap<uint64_t, std::function<void()> >::iterator it = events.begin();
+    std::function<void()> fn = it->second;
+
+    if (it->first > currentTime) {
+      currentTime = it->first;
+    }
+    events.erase(it);
+
+    fn();
+    dispatch();
+  }
+
+  if (target > currentTime) {
+    currentTime = target;
+  }
+
+  dispatch();
+}
+
+void schedule(uint64_t at, std::function<void()> fn)
+{
+  events.insert(std::make_pair(at, fn));
+}
+
+void setPin(int pin, int level)
+{
+  if (pin < 0 || pin >= PIN_COUNT) {
+    return;
+  }
+
+  if (levels[pin] == HIGH && level == LOW && pinInterrupts[pin].fn && pinInterrupts[pin].mode == FALLING) {
+    pinInterrupts[pin].pending = true;
+  }
+
+  levels[pin] = level;
+}
+
+int pin(int pin)
+{
+  return (pin >= 0 && pin < PIN_COUNT) ? levels[pin] : LOW;
+}
+
+void onPinWrite(int pin, std::function<void(int)> fn)
+{
+  pinListeners[pin].push_back(fn);
+}
+
+void attachSource(int source, void (*fn)(void*), void* arg)
+{
+  SourceInterrupt& interrupt = sources[source];
+
+  interrupt.fn = fn;
+  interrupt.arg = arg;
+}
+
+void detachSource(int source)
+{
+  sources[source].fn = NULL;
+  sources[source].arg = NULL;
+}
+
+bool sourceAttached(int source)
+{
+  return sources.count(source) && sources[source].fn;
+}
+
+void* sourceArg(int source)
+{
+  return sources.count(source) ? sources[source].arg : NULL;
+}
+
+void setSource(int source, bool asserted)
+{
+  sources[source].asserted = asserted;
+}
+
+bool pinInterruptAttached(int pin)
+{
+  return pin >= 0 && pin < PIN_COUNT && pinInterrupts[pin].fn;
+}
+
+void maskPin(int pin, bool masked)
+{
+  if (pin >= 0 && pin < PIN_COUNT) {
+    pinInterrupts[pin].masked = masked;
+  }
+
+  if (!masked) {
+    dispatch();
+  }
+}
+
+bool interruptsEnabled()
+{
+  return enabled;
+}
+
+bool inInterrupt()
+{
+  return inHandler;
+}
+
+uint64_t interruptTime()
+{
+  return handlerTime;
+}
+
+unsigned long interruptCount()
+{
+  return handlerCount;
+}
+
+void attachSPIDevice(SPIDevice* device)
+{
+  spiDevices.push_back(device);
+}
+
+uint8_t spiTransfer(uint8_t value)
+{
+  uint8_t result = 0xff;
+
+  for (size_t i = 0; i < spiDevices.size(); i++) {
+    if (spiDevices[i]->selected()) {
+      result = spiDevices[i]->transfer(value);
+    }
+  }
+
+  return result;
+}
+
+void mapRegisters(uint32_t base, uint32_t size, RegisterDevice* device)
+{
+  RegisterRange range = { size, device };
+
+  registerRanges[base] = range;
+}
+
+uint32_t readRegister(uint32_t address)
+{
+  advance(hostCosts.registerAccess);
+
+  uint32_t base;
+  RegisterRange* range = findRange(address, base);
+
+  if (range) {
+    return range->device->read(address - base);
+  }
+
+  return peekRegister(address);
+}
+
+void writeRegister(uint32_t address, uint32_t value)
+{
+  advance(hostCosts.registerAccess);
+
+  uint32_t base;
+  RegisterRange* range = findRange(address, base);
+
+  if (range) {
+    range->device->write(address - base, value);
+  } else {
+    memory[address] = value;
+
+    std::vector<std::function<void(uint32_t)> > listeners = registerListeners[address];
+
+    for (size_t i = 0; i < listeners.size(); i++) {
+      listeners[i](value);
+    }
+  }
+}
+
+uint32_t peekRegister(uint32_t address)
+{
+  return memory.count(address) ? memory[address] : 0;
+}
+
+void onRegisterWrite(uint32_t address, std::function<void(uint32_t)> fn)
+{
+  registerListeners[address].push_back(fn);
+}
+
+}
+
+unsigned long micros()
+{
+  return host::now() / 1000;
+}
+
+unsigned long millis()
+{
+  return host::now() / 1000000;
+}
+
+void delay(unsigned long ms)
+{
+  host::advance((uint64_t)ms * 1000000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+  host::advance((uint64_t)us * 1000);
+}
+
+void yield()
+{
+  host::advance(hostCosts.yield);
+}
+
+void pinMode(uint8_t, uint8_t)
+{
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+  host::advance(hostCosts.pinAccess);
+
+  levels[pin] = value ? HIGH : LOW;
+
+  if (pinListeners.count(pin)) {
+    std::vector<std::function<void(int)> > listeners = pinListeners[pin];
+
+    for (size_t i = 0; i < listeners.size(); i++) {
+      listeners[i](levels[pin]);
+    }
+  }
+}
+
+int digitalRead(uint8_t pin)
+{
+  host::advance(hostCosts.pinAccess);
+
+  return levels[pin];
+}
+
+void attachInterrupt(uint8_t interruptNum, void (*userFunc)(void), int mode)
+{
+  PinInterrupt& interrupt = pinInterrupts[interruptNum];
+
+  // like most cores, an edge from before the attach is not remembered
+  interrupt.fn = userFunc;
+  interrupt.mode = mode;
+  interrupt.pending = false;
+
+  dispatch();
+}
+
+void detachInterrupt(uint8_t interruptNum)
+{
+  pinInterrupts[interruptNum].fn = NULL;
+  pinInterrupts[interruptNum].pending = false;
+}
+
+void noInterrupts()
+{
+  enabled = false;
+}
+
+void interrupts()
+{
+  enabled = true;
+
+  dispatch();
+}
+
+long random(long howBig)
+{
+  if (howBig <= 0) {
+    return 0;
+  }
+
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+
+  return seed % howBig;
+}
+
+long random(long howSmall, long howBig)
+{
+  if (howSmall >= howBig) {
+    return howSmall;
+  }
+
+  return howSmall + random(howBig - howSmall);
+}
+
+void randomSeed(unsigned long value)
+{
+  seed = value ? value : 1;
+}
+
+size_t Print::write(const uint8_t* buffer, size_t size)
+{
+  size_t n = 0;
+
+  while (size--) {
+    n += write(*buffer++);
+  }
+
+  return n;
+}
+
+size_t Print::print(long value, int base)
+{
+  char buffer[72];
+
+  if (base == DEC) {
+    snprintf(buffer, sizeof(buffer), "%ld", value);
+  } else {
+    return print((unsigned long)value, base);
+  }
+
+  return write(buffer);
+}
+
+size_t Print::print(unsigned long value, int base)
+{
+  char buffer[72];
+  char* p = &buffer[sizeof(buffer) - 1];
+
+  if (base < 2) {
+    base = DEC;
+  }
+
+  *p = '\0';
+
+  do {
+    int digit = value % base;
+
+    *--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+    value /= base;
+  } while (value);
+
+  return write(p);
+}
+
+size_t Print::print(double value, int digits)
+{
+  char buffer[64];
+
+  snprintf(buffer, sizeof(buffer), "%.*f", digits, value);
+
+  return write(buffer);
+}
+
+size_t Stream::readBytes(uint8_t* buffer, size_t length)
+{
+  size_t count = 0;
+
+  while (count < length) {
+    int c = read();
+
+    if (c < 0) {
+      break;
+    }
+
+    buffer[count++] = c;
+  }
+
+  return count;
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+  return fwrite(&c, 1, 1, stdout);
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size)
+{
+  return fwrite(buffer, 1, size, stdout);
+}
+
+void HardwareSerial::flush()
+{
+  fflush(stdout);
+}
+
+HardwareSerial Serial;
@@ -0,0 +1,89 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef HOST_CORE_H
+#define HOST_CORE_H
+
+#include <stdint.h>
+
+#include <functional>
+
+// Simulated board for running the library on a Linux host: a nanosecond
+// clock that only moves when the code under test waits or touches hardware,
+// pins and interrupt lines driven by device models, and memory mapped
+// registers routed to them.
+
+namespace host {
+
+// what the code under test is charged for, in nanoseconds
+struct Costs {
+  uint32_t spiByteOverhead;   // per SPI.transfer(), on top of the 8 clocks
+  uint32_t pinAccess;         // digitalWrite() and digitalRead()
+  uint32_t registerAccess;    // memory mapped peripheral register
+  uint32_t interruptEntry;    // entering and leaving a handler
+  uint32_t yield;             // yield() and each pass of a busy wait
+};
+
+Costs& costs();
+
+void reset();
+
+uint64_t now();
+void advance(uint64_t ns);
+void schedule(uint64_t at, std::function<void()> fn);
+
+// pins, input levels are driven by the device models
+void setPin(int pin, int level);
+int pin(int pin);
+void onPinWrite(int pin, std::function<void(int)> fn);
+
+// peripheral interrupt sources, for esp_intr_alloc()
+void attachSource(int source, void (*fn)(void*), void* arg);
+void detachSource(int source);
+bool sourceAttached(int source);
+void* sourceArg(int source);
+void setSource(int source, bool asserted);
+
+// whether attachInterrupt() has a handler on the pin
+bool pinInterruptAttached(int pin);
+
+// masks a pin interrupt without detaching it, as SPI transactions do for
+// SPI.usingInterrupt()
+void maskPin(int pin, bool masked);
+
+bool interruptsEnabled();
+bool inInterrupt();
+uint64_t interruptTime();
+unsigned long interruptCount();
+
+class SPIDevice {
+public:
+  virtual ~SPIDevice() {}
+  virtual bool selected() = 0;
+  virtual uint8_t transfer(uint8_t value) = 0;
+};
+
+void attachSPIDevice(SPIDevice* device);
+uint8_t spiTransfer(uint8_t value);
+
+class RegisterDevice {
+public:
+  virtual ~RegisterDevice() {}
+  virtual uint32_t read(uint32_t offset) = 0;
+  virtual void write(uint32_t offset, uint32_t value) = 0;
+};
+
+// addresses outside of a mapped device read back what was last written,
+// peekRegister() reads those without charging for the access
+void mapRegisters(uint32_t base, uint32_t size, RegisterDevice* device);
+uint32_t readRegister(uint32_t address);
+void writeRegister(uint32_t address, uint32_t value);
+uint32_t peekRegister(uint32_t address);
+
+// called after a write to an address outside of the mapped devices, for
+// models that follow their clock and reset bits in a shared register
+void onRegisterWrite(uint32_t address, std::function<void(uint32_t)> fn);
+
+}
+
+#endif
@@ -0,0 +1,213 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "HostUDP.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+HostUDP::HostUDP() :
+  _socket(-1),
+  _localPort(0),
+  _txPort(0),
+  _txLength(0),
+  _txOverflow(false),
+  _rxPort(0),
+  _rxLength(0),
+  _rxIndex(0)
+{
+}
+
+HostUDP::~HostUDP()
+{
+  stop();
+}
+
+uint8_t HostUDP::begin(uint16_t port)
+{
+  stop();
+
+  _socket = socket(AF_INET, SOCK_DGRAM, 0);
+
+  if (_socket < 0) {
+    return 0;
+  }
+
+  struct sockaddr_in address;
+  socklen_t length = sizeof(address);
+
+  memset(&address, 0x00, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(port);
+
+  if (bind(_socket, (struct sockaddr*)&address, sizeof(address)) < 0 ||
+      getsockname(_socket, (struct sockaddr*)&address, &length) < 0 ||
+      fcntl(_socket, F_SETFL, fcntl(_socket, F_GETFL) | O_NONBLOCK) < 0) {
+    stop();
+
+    return 0;
+  }
+
+  _localPort = ntohs(address.sin_port);
+
+  return 1;
+}
+
+void HostUDP::stop()
+{
+  if (_socket >= 0) {
+    close(_socket);
+    _socket = -1;
+  }
+
+  _localPort = 0;
+  _rxLength = 0;
+  _rxIndex = 0;
+}
+
+int HostUDP::beginPacket(IPAddress ip, uint16_t port)
+{
+  if (_socket < 0) {
+    return 0;
+  }
+
+  _txIp = ip;
+  _txPort = port;
+  _txLength = 0;
+  _txOverflow = false;
+
+  return 1;
+}
+
+int HostUDP::endPacket()
+{
+  if (_socket < 0 || _txOverflow) {
+    return 0;
+  }
+
+  struct sockaddr_in address;
+
+  memset(&address, 0x00, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(_txIp.value());
+  address.sin_port = htons(_txPort);
+
+  ssize_t sent = sendto(_socket, _txBuffer, _txLength, 0, (struct sockaddr*)&address, sizeof(address));
+
+  return (sent == (ssize_t)_txLength) ? 1 : 0;
+}
+
+size_t HostUDP::write(uint8_t value)
+{
+  return write(&value, 1);
+}
+
+size_t HostUDP::write(const uint8_t* buffer, size_t size)
+{
+  if ((_txLength + size) > sizeof(_txBuffer)) {
+    _txOverflow = true;
+
+    return 0;
+  }
+
+  memcpy(&_txBuffer[_txLength], buffer, size);
+  _txLength += size;
+
+  return size;
+}
+
+int HostUDP::parsePacket()
+{
+  // the rest of the previous datagram is dropped, as on the boards
+  _rxLength = 0;
+  _rxIndex = 0;
+
+  if (_socket < 0) {
+    return 0;
+  }
+
+  struct sockaddr_in address;
+  socklen_t length = sizeof(address);
+  ssize_t received = recvfrom(_socket, _rxBuffer, sizeof(_rxBuffer), 0, (struct sockaddr*)&address, &length);
+
+  if (received <= 0) {
+    return 0;
+  }
+
+  uint32_t ip = ntohl(address.sin_addr.s_addr);
+
+  _rxIp = IPAddress(ip >> 24, (ip >> 16) & 0xff, (ip >> 8) & 0xff, ip & 0xff);
+  _rxPort = ntohs(address.sin_port);
+  _rxLength = received;
+
+  return received;
+}
+
+int HostUDP::available()
+{
+  return _rxLength - _rxIndex;
+}
+
+int HostUDP::read()
+{
+  if (_rxIndex >= _rxLength) {
+    return -1;
+  }
+
+  return _rxBuffer[_rxIndex++];
+}
+
+int HostUDP::read(unsigned char* buffer, size_t len)
+{
+  size_t count = min(len, _rxLength - _rxIndex);
+
+  memcpy(buffer, &_rxBuffer[_rxIndex], count);
+  _rxIndex += count;
+
+  return count;
+}
+
+int HostUDP::read(char* buffer, size_t len)
+{
+  return read((unsigned char*)buffer, len);
+}
+
+int HostUDP::peek()
+{
+  return (_rxIndex < _rxLength) ? _rxBuffer[_rxIndex] : -1;
+}
+
+void HostUDP::flush()
+{
+}
+
+IPAddress HostUDP::remoteIP()
+{
+  return _rxIp;
+}
+
+uint16_t HostUDP::remotePort()
+{
+  return _rxPort;
+}
+
+uint16_t HostUDP::localPort()
+{
+  return _localPort;
+}
+
+bool HostUDP::wait(unsigned long timeout)
+{
+  if (_socket < 0) {
+    return false;
+  }
+
+  struct pollfd fd = { _socket, POLLIN, 0 };
+
+  return poll(&fd, 1, timeout) > 0;
+}
@@ -0,0 +1,60 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef HOST_UDP_H
+#define HOST_UDP_H
+
+#include <Udp.h>
+
+// UDP over a non-blocking BSD socket, bound to the loopback interface, so
+// datagrams really go through the host's network stack. Only IPv4 unicast.
+class HostUDP : public UDP {
+public:
+  HostUDP();
+  virtual ~HostUDP();
+
+  // port 0 binds an ephemeral port, see localPort()
+  virtual uint8_t begin(uint16_t port);
+  virtual void stop();
+
+  virtual int beginPacket(IPAddress ip, uint16_t port);
+  virtual int endPacket();
+  virtual size_t write(uint8_t value);
+  virtual size_t write(const uint8_t* buffer, size_t size);
+  using Print::write;
+
+  virtual int parsePacket();
+  virtual int available();
+  virtual int read();
+  virtual int read(unsigned char* buffer, size_t len);
+  virtual int read(char* buffer, size_t len);
+  virtual int peek();
+  virtual void flush();
+
+  virtual IPAddress remoteIP();
+  virtual uint16_t remotePort();
+
+  uint16_t localPort();
+
+  // waits up to timeout ms of real time for a datagram to arrive, the
+  // simulated clock doesn't move
+  bool wait(unsigned long timeout);
+
+private:
+  int _socket;
+  uint16_t _localPort;
+
+  IPAddress _txIp;
+  uint16_t _txPort;
+  uint8_t _txBuffer[1500];
+  size_t _txLength;
+  bool _txOverflow;
+
+  IPAddress _rxIp;
+  uint16_t _rxPort;
+  uint8_t _rxBuffer[1500];
+  size_t _rxLength;
+  size_t _rxIndex;
+};
+
+#endif
@@ -0,0 +1,26 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef IP_ADDRESS_H
+#define IP_ADDRESS_H
+
+#include <stdint.h>
+
+class IPAddress {
+public:
+  IPAddress() : _address(0) {}
+  IPAddress(uint8_t first, uint8_t second, uint8_t third, uint8_t fourth) :
+    _address((uint32_t)first << 24 | (uint32_t)second << 16 | (uint32_t)third << 8 | fourth) {}
+
+  // host byte order, first octet in the top byte
+  uint32_t value() const { return _address; }
+  uint8_t operator[](int index) const { return (_address >> (24 - 8 * index)) & 0xff; }
+
+  bool operator==(const IPAddress& other) const { return _address == other._address; }
+  bool operator!=(const IPAddress& other) const { return _address != other._address; }
+
+private:
+  uint32_t _address;
+};
+
+#endif
@@ -0,0 +1,72 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "SPI.h"
+#include "HostCore.h"
+
+SPIClass::SPIClass() :
+  _inTransaction(false)
+{
+  memset(_interruptMask, 0x00, sizeof(_interruptMask));
+}
+
+void SPIClass::begin()
+{
+}
+
+void SPIClass::end()
+{
+}
+
+void SPIClass::usingInterrupt(int interruptNumber)
+{
+  if (interruptNumber >= 0 && interruptNumber < 256) {
+    _interruptMask[interruptNumber / 32] |= (1UL << (interruptNumber % 32));
+  }
+}
+
+void SPIClass::notUsingInterrupt(int interruptNumber)
+{
+  if (interruptNumber >= 0 && interruptNumber < 256) {
+    _interruptMask[interruptNumber / 32] &= ~(1UL << (interruptNumber % 32));
+  }
+}
+
+void SPIClass::beginTransaction(SPISettings settings)
+{
+  _settings = settings;
+  _inTransaction = true;
+
+  for (int i = 0; i < 256; i++) {
+    if (_interruptMask[i / 32] & (1UL << (i % 32))) {
+      host::maskPin(i, true);
+    }
+  }
+}
+
+void SPIClass::endTransaction()
+{
+  _inTransaction = false;
+
+  for (int i = 0; i < 256; i++) {
+    if (_interruptMask[i / 32] & (1UL << (i % 32))) {
+      host::maskPin(i, false);
+    }
+  }
+}
+
+uint8_t SPIClass::transfer(uint8_t data)
+{
+  uint8_t result = host::spiTransfer(data);
+
+  host::advance(8000000000ULL / _settings.clock + host::costs().spiByteOverhead);
+
+  return result;
+}
+
+uint32_t SPIClass::clock()
+{
+  return _settings.clock;
+}
+
+SPIClass SPI;
@@ -0,0 +1,56 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef SPI_H
+#define SPI_H
+
+#include <Arduino.h>
+
+#define SPI_HAS_TRANSACTION        1
+#define SPI_HAS_NOTUSINGINTERRUPT  1
+
+#define SPI_MODE0                  0x00
+#define SPI_MODE1                  0x04
+#define SPI_MODE2                  0x08
+#define SPI_MODE3                  0x0c
+
+class SPISettings {
+public:
+  SPISettings() : clock(4000000), bitOrder(MSBFIRST), dataMode(SPI_MODE0) {}
+  SPISettings(uint32_t clock, uint8_t bitOrder, uint8_t dataMode) :
+    clock(clock), bitOrder(bitOrder), dataMode(dataMode) {}
+
+  uint32_t clock;
+  uint8_t bitOrder;
+  uint8_t dataMode;
+};
+
+// transfers take 8 clocks at the transaction's frequency plus a fixed
+// overhead, interrupts named with usingInterrupt() are masked in between
+// beginTransaction() and endTransaction()
+class SPIClass {
+public:
+  SPIClass();
+
+  void begin();
+  void end();
+
+  void usingInterrupt(int interruptNumber);
+  void notUsingInterrupt(int interruptNumber);
+
+  void beginTransaction(SPISettings settings);
+  void endTransaction();
+
+  uint8_t transfer(uint8_t data);
+
+  uint32_t clock();
+
+private:
+  SPISettings _settings;
+  uint32_t _interruptMask[8];
+  bool _inTransaction;
+};
+
+extern SPIClass SPI;
+
+#endif
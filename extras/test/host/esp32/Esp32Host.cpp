@@ -0,0 +1,228 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <map>
+
+#include <Arduino.h>
+
+#include "driver/gpio.h"
+#include "esp_intr.h"
+#include "esp_ipc.h"
+
+#include "Esp32Host.h"
+
+struct intr_handle_data_t {
+  int source;
+};
+
+struct HostTask {
+  TaskFunction_t fn;
+  void* arg;
+  uint32_t notifications;
+};
+
+namespace {
+
+std::map<int, int> inputRoutes;
+std::map<int, int> outputRoutes;
+int allocations = 0;
+int taskCount = 0;
+int taskDeleteCount = 0;
+
+}
+
+namespace host {
+namespace esp32 {
+
+void reset()
+{
+  inputRoutes.clear();
+  outputRoutes.clear();
+  allocations = 0;
+  taskCount = 0;
+  taskDeleteCount = 0;
+}
+
+int inputPin(int signal)
+{
+  return inputRoutes.count(signal) ? inputRoutes[signal] : -1;
+}
+
+int outputSignal(int pin)
+{
+  return outputRoutes.count(pin) ? outputRoutes[pin] : -1;
+}
+
+int allocatedInterrupts()
+{
+  return allocations;
+}
+
+int createdTasks()
+{
+  return taskCount;
+}
+
+int deletedTasks()
+{
+  return taskDeleteCount;
+}
+
+}
+}
+
+int esp_intr_alloc(int source, int, intr_handler_t handler, void* arg, intr_handle_t* handle)
+{
+  if (host::sourceAttached(source)) {
+    // every source can only be allocated once
+    return -1;
+  }
+
+  host::attachSource(source, handler, arg);
+  allocations++;
+
+  if (handle) {
+    *handle = new intr_handle_data_t;
+    (*handle)->source = source;
+  }
+
+  return 0;
+}
+
+int esp_intr_free(intr_handle_t handle)
+{
+  if (!handle) {
+    return -1;
+  }
+
+  host::detachSource(handle->source);
+  allocations--;
+
+  delete handle;
+
+  return 0;
+}
+
+int esp_ipc_call_blocking(uint32_t, esp_ipc_func_t func, void* arg)
+{
+  func(arg);
+
+  return 0;
+}
+
+int gpio_set_direction(gpio_num_t, gpio_mode_t)
+{
+  return 0;
+}
+
+void gpio_pad_select_gpio(uint32_t)
+{
+}
+
+void gpio_matrix_in(uint32_t gpio, uint32_t signal, bool)
+{
+  inputRoutes[signal] = gpio;
+}
+
+void gpio_matrix_out(uint32_t gpio, uint32_t signal, bool, bool)
+{
+  outputRoutes[gpio] = signal;
+}
+
+void portENTER_CRITICAL(portMUX_TYPE*)
+{
+  noInterrupts();
+}
+
+void portEXIT_CRITICAL(portMUX_TYPE*)
+{
+  interrupts();
+}
+
+void portENTER_CRITICAL_ISR(portMUX_TYPE*)
+{
+}
+
+void portEXIT_CRITICAL_ISR(portMUX_TYPE*)
+{
+}
+
+void portENTER_CRITICAL_SAFE(portMUX_TYPE* mux)
+{
+  if (!host::inInterrupt()) {
+    portENTER_CRITICAL(mux);
+  }
+}
+
+void portEXIT_CRITICAL_SAFE(portMUX_TYPE* mux)
+{
+  if (!host::inInterrupt()) {
+    portEXIT_CRITICAL(mux);
+  }
+}
+
+BaseType_t xPortInIsrContext()
+{
+  return host::inInterrupt() ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xPortGetCoreID()
+{
+  return 0;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char* name, uint32_t stackDepth, void* arg,
+                       UBaseType_t priority, TaskHandle_t* handle)
+{
+  return xTaskCreatePinnedToCore(fn, name, stackDepth, arg, priority, handle, 0);
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char*, uint32_t, void* arg,
+                                   UBaseType_t, TaskHandle_t* handle, BaseType_t)
+{
+  HostTask* task = new HostTask;
+
+  task->fn = fn;
+  task->arg = arg;
+  task->notifications = 0;
+  taskCount++;
+
+  if (handle) {
+    *handle = task;
+  }
+
+  return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t handle)
+{
+  taskDeleteCount++;
+
+  delete handle;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+  delay(ticks * portTICK_PERIOD_MS);
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t handle, BaseType_t* woken)
+{
+  handle->notifications++;
+
+  if (woken) {
+    *woken = pdTRUE;
+  }
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t handle)
+{
+  handle->notifications++;
+
+  return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t, TickType_t)
+{
+  return 0;
+}
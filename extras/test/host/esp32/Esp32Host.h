@@ -0,0 +1,25 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef ESP32_HOST_H
+#define ESP32_HOST_H
+
+// what the ESP-IDF shims recorded, for the tests
+
+namespace host {
+namespace esp32 {
+
+void reset();
+
+// GPIO matrix routing, -1 if nothing is routed
+int inputPin(int signal);
+int outputSignal(int pin);
+
+int allocatedInterrupts();
+int createdTasks();
+int deletedTasks();
+
+}
+}
+
+#endif
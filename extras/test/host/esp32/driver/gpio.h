@@ -0,0 +1,21 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef DRIVER_GPIO_H
+#define DRIVER_GPIO_H
+
+#include "esp32-hal.h"
+#include "soc/gpio_sig_map.h"
+
+typedef enum {
+  GPIO_MODE_DISABLE = 0,
+  GPIO_MODE_INPUT = 1,
+  GPIO_MODE_OUTPUT = 2
+} gpio_mode_t;
+
+int gpio_set_direction(gpio_num_t gpio, gpio_mode_t mode);
+void gpio_pad_select_gpio(uint32_t gpio);
+void gpio_matrix_in(uint32_t gpio, uint32_t signal, bool inv);
+void gpio_matrix_out(uint32_t gpio, uint32_t signal, bool outInv, bool oenInv);
+
+#endif
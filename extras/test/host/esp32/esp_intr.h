@@ -0,0 +1,16 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef ESP_INTR_H
+#define ESP_INTR_H
+
+#include "esp32-hal.h"
+#include "soc/soc.h"
+
+typedef void (*intr_handler_t)(void* arg);
+
+// the handler runs from host::setSource() of the source, see HostCore.h
+int esp_intr_alloc(int source, int flags, intr_handler_t handler, void* arg, intr_handle_t* handle);
+int esp_intr_free(intr_handle_t handle);
+
+#endif
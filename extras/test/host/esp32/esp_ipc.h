@@ -0,0 +1,14 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef ESP_IPC_H
+#define ESP_IPC_H
+
+#include <stdint.h>
+
+typedef void (*esp_ipc_func_t)(void* arg);
+
+// runs the function right away, the host has one core
+int esp_ipc_call_blocking(uint32_t cpu, esp_ipc_func_t func, void* arg);
+
+#endif
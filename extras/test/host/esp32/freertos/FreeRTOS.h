@@ -0,0 +1,35 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef FREERTOS_H
+#define FREERTOS_H
+
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE                    0
+#define pdTRUE                     1
+#define pdPASS                     1
+#define portMAX_DELAY              0xffffffffUL
+#define portTICK_PERIOD_MS         1
+
+// interrupts run to completion on the host, there is nothing to switch to
+#define portYIELD_FROM_ISR()
+
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+
+void portENTER_CRITICAL(portMUX_TYPE* mux);
+void portEXIT_CRITICAL(portMUX_TYPE* mux);
+void portENTER_CRITICAL_ISR(portMUX_TYPE* mux);
+void portEXIT_CRITICAL_ISR(portMUX_TYPE* mux);
+void portENTER_CRITICAL_SAFE(portMUX_TYPE* mux);
+void portEXIT_CRITICAL_SAFE(portMUX_TYPE* mux);
+
+BaseType_t xPortInIsrContext();
+BaseType_t xPortGetCoreID();
+
+#endif
@@ -0,0 +1,19 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef SOC_DPORT_REG_H
+#define SOC_DPORT_REG_H
+
+#include "soc.h"
+
+#define DPORT_PERIP_CLK_EN_REG     (DR_REG_DPORT_BASE + 0x0c0)
+#define DPORT_PERIP_RST_EN_REG     (DR_REG_DPORT_BASE + 0x0c4)
+
+#define DPORT_CAN_CLK_EN           BIT(19)
+#define DPORT_CAN_RST              BIT(19)
+
+// no DPORT access workaround is needed on the host
+#define DPORT_SET_PERI_REG_MASK(reg, mask)   SET_PERI_REG_MASK(reg, mask)
+#define DPORT_CLEAR_PERI_REG_MASK(reg, mask) CLEAR_PERI_REG_MASK(reg, mask)
+
+#endif
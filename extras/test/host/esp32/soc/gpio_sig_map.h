@@ -0,0 +1,17 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef SOC_GPIO_SIG_MAP_H
+#define SOC_GPIO_SIG_MAP_H
+
+#if defined(CONFIG_IDF_TARGET_ESP32C6)
+#define TWAI0_RX_PAD_IN_IDX        73
+#define TWAI0_TX_PAD_OUT_IDX       73
+#define TWAI1_RX_PAD_IN_IDX        77
+#define TWAI1_TX_PAD_OUT_IDX       77
+#else
+#define CAN_RX_IDX                 94
+#define CAN_TX_IDX                 123
+#endif
+
+#endif
@@ -0,0 +1,21 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef SOC_PCR_REG_H
+#define SOC_PCR_REG_H
+
+#include "soc.h"
+
+#define PCR_TWAI0_CONF_REG           (DR_REG_PCR_BASE + 0x3c)
+#define PCR_TWAI0_FUNC_CLK_CONF_REG  (DR_REG_PCR_BASE + 0x40)
+#define PCR_TWAI1_CONF_REG           (DR_REG_PCR_BASE + 0x44)
+#define PCR_TWAI1_FUNC_CLK_CONF_REG  (DR_REG_PCR_BASE + 0x48)
+
+#define PCR_TWAI0_CLK_EN             BIT(0)
+#define PCR_TWAI0_RST_EN             BIT(1)
+#define PCR_TWAI0_FUNC_CLK_EN        BIT(31)
+#define PCR_TWAI1_CLK_EN             BIT(0)
+#define PCR_TWAI1_RST_EN             BIT(1)
+#define PCR_TWAI1_FUNC_CLK_EN        BIT(31)
+
+#endif
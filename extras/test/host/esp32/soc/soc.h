@@ -0,0 +1,39 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef SOC_SOC_H
+#define SOC_SOC_H
+
+#include <stdint.h>
+
+#include "HostCore.h"
+
+// Peripheral register access goes to host::readRegister() and
+// host::writeRegister(), which route it to the device models. The addresses
+// follow ESP-IDF for the target picked with CONFIG_IDF_TARGET_*; the models
+// only rely on every controller having registers and bits of its own.
+
+#ifndef BIT
+#define BIT(nr)                    (1UL << (nr))
+#endif
+
+#define REG_READ(_r)               host::readRegister((uint32_t)(_r))
+#define REG_WRITE(_r, _v)          host::writeRegister((uint32_t)(_r), (uint32_t)(_v))
+
+#define SET_PERI_REG_MASK(reg, mask)   REG_WRITE((reg), (REG_READ(reg) | (mask)))
+#define CLEAR_PERI_REG_MASK(reg, mask) REG_WRITE((reg), (REG_READ(reg) & (~(mask))))
+
+#if defined(CONFIG_IDF_TARGET_ESP32C6)
+#define DR_REG_TWAI0_BASE          0x6000B000
+#define DR_REG_TWAI1_BASE          0x6000D000
+#define DR_REG_PCR_BASE            0x60096000
+
+#define ETS_TWAI0_INTR_SOURCE      37
+#define ETS_TWAI1_INTR_SOURCE      38
+#else
+#define DR_REG_DPORT_BASE          0x3ff00000
+
+#define ETS_CAN_INTR_SOURCE        45
+#endif
+
+#endif
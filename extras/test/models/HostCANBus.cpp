@@ -0,0 +1,264 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <HostCore.h>
+
+#include "HostCANBus.h"
+
+#define PEER_QUEUE_SIZE            1024
+
+namespace {
+
+// lower wins: base id, then a standard frame beats an extended one with the
+// same base id, then the extended bits, then data beats remote
+uint64_t arbitrationKey(const CANFrame& frame)
+{
+  uint64_t id = frame.packetId();
+  uint64_t key;
+
+  if (frame.packetExtended()) {
+    key = ((id >> 18) << 20) | (1ULL << 19) | ((id & 0x3ffff) << 1);
+  } else {
+    key = id << 20;
+  }
+
+  return key | (frame.packetRtr() ? 1 : 0);
+}
+
+}
+
+HostCANBus::HostCANBus(long bitRate) :
+  _bitRate(bitRate),
+  _busy(false),
+  _framesCarried(0),
+  _mismatched(0)
+{
+}
+
+void HostCANBus::attach(HostCANNode* node)
+{
+  _nodes.push_back(node);
+}
+
+void HostCANBus::setBitRate(long bitRate)
+{
+  _bitRate = bitRate;
+}
+
+long HostCANBus::bitRate()
+{
+  return _bitRate;
+}
+
+void HostCANBus::transmit(HostCANNode* node, const CANFrame& frame)
+{
+  Transmission transmission = { node, frame };
+
+  _pending.push_back(transmission);
+
+  start();
+}
+
+bool HostCANBus::cancel(HostCANNode* node)
+{
+  for (std::deque<Transmission>::iterator it = _pending.begin(); it != _pending.end(); ++it) {
+    if (it->node == node) {
+      _pending.erase(it);
+
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool HostCANBus::transmitting(HostCANNode* node)
+{
+  return _busy && _current.node == node;
+}
+
+unsigned long HostCANBus::framesCarried()
+{
+  return _framesCarried;
+}
+
+unsigned long HostCANBus::mismatched()
+{
+  return _mismatched;
+}
+
+int HostCANBus::frameBits(const CANFrame& frame)
+{
+  return (frame.packetExtended() ? HOST_CAN_EXTENDED_FRAME_BITS : HOST_CAN_STANDARD_FRAME_BITS) +
+         8 * frame.packetLength();
+}
+
+uint64_t HostCANBus::frameTime(const CANFrame& frame)
+{
+  return (uint64_t)frameBits(frame) * 1000000000ULL / _bitRate;
+}
+
+void HostCANBus::start()
+{
+  if (_busy || _pending.empty()) {
+    return;
+  }
+
+  std::deque<Transmission>::iterator winner = _pending.begin();
+
+  for (std::deque<Transmission>::iterator it = _pending.begin(); it != _pending.end(); ++it) {
+    if (arbitrationKey(it->frame) < arbitrationKey(winner->frame)) {
+      winner = it;
+    }
+  }
+
+  _current = *winner;
+  _pending.erase(winner);
+  _busy = true;
+
+  host::schedule(host::now() + frameTime(_current.frame), [this]() { finish(); });
+}
+
+void HostCANBus::finish()
+{
+  Transmission done = _current;
+
+  _busy = false;
+  _framesCarried++;
+
+  bool senderMatches = (done.node->nodeBitRate() == _bitRate);
+
+  for (size_t i = 0; i < _nodes.size(); i++) {
+    HostCANNode* node = _nodes[i];
+
+    if (node == done.node || node->nodeBitRate() == 0) {
+      continue;
+    }
+
+    if (!senderMatches || node->nodeBitRate() != _bitRate) {
+      _mismatched++;
+      continue;
+    }
+
+    node->frameReceived(done.frame);
+  }
+
+  done.node->frameSent(done.frame);
+
+  start();
+}
+
+HostCANPeer::HostCANPeer(HostCANBus& bus) :
+  CANControllerClass(),
+  _bus(&bus),
+  _bitRate(0),
+  _sending(false)
+{
+  bus.attach(this);
+}
+
+HostCANPeer::~HostCANPeer()
+{
+}
+
+int HostCANPeer::begin(long baudRate)
+{
+  CANControllerClass::begin(baudRate);
+
+  _bitRate = baudRate;
+  _txQueue.clear();
+  _rxQueue.clear();
+
+  return 1;
+}
+
+void HostCANPeer::end()
+{
+  _bitRate = 0;
+
+  CANControllerClass::end();
+}
+
+int HostCANPeer::endPacket()
+{
+  if (!CANControllerClass::endPacket() || _txQueue.size() >= PEER_QUEUE_SIZE) {
+    return 0;
+  }
+
+  CANFrame frame;
+
+  frame.setId(_txId, _txExtended, _txRtr);
+  frame.dlc = _txLength;
+  frame.bus = 0;
+  frame.filter = -1;
+  frame.reserved = 0;
+  memset(frame.data, 0x00, sizeof(frame.data));
+  memcpy(frame.data, _txData, _txLength);
+
+  _txQueue.push_back(frame);
+
+  if (!_sending) {
+    _sending = true;
+    _bus->transmit(this, _txQueue.front());
+  }
+
+  return 1;
+}
+
+int HostCANPeer::parsePacket()
+{
+  if (_rxQueue.empty()) {
+    return 0;
+  }
+
+  Received received = _rxQueue.front();
+  _rxQueue.pop_front();
+
+  loadFrame(received.frame, received.time / 1000);
+
+  return _rxDlc;
+}
+
+long HostCANPeer::nodeBitRate()
+{
+  return _bitRate;
+}
+
+void HostCANPeer::frameReceived(const CANFrame& frame)
+{
+  Received received = { frame, host::now() };
+
+  _rxQueue.push_back(received);
+  _log.push_back(received);
+}
+
+void HostCANPeer::frameSent(const CANFrame&)
+{
+  _txQueue.pop_front();
+
+  if (_txQueue.empty()) {
+    _sending = false;
+  } else {
+    _bus->transmit(this, _txQueue.front());
+  }
+}
+
+const std::vector<HostCANPeer::Received>& HostCANPeer::log()
+{
+  return _log;
+}
+
+void HostCANPeer::clearLog()
+{
+  _log.clear();
+}
+
+size_t HostCANPeer::queued()
+{
+  return _txQueue.size();
+}
+
+size_t HostCANPeer::pending()
+{
+  return _rxQueue.size();
+}
@@ -0,0 +1,107 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef HOST_CAN_BUS_H
+#define HOST_CAN_BUS_H
+
+#include <deque>
+#include <vector>
+
+#include <CANController.h>
+#include <CANFrame.h>
+
+// frame length without stuff bits: SOF, arbitration, control, CRC, ACK, EOF and intermission
+#define HOST_CAN_STANDARD_FRAME_BITS     47
+#define HOST_CAN_EXTENDED_FRAME_BITS     67
+
+class HostCANNode {
+public:
+  virtual ~HostCANNode() {}
+
+  // 0 while the node doesn't take part in bus traffic
+  virtual long nodeBitRate() = 0;
+
+  virtual void frameReceived(const CANFrame& frame) = 0;
+  virtual void frameSent(const CANFrame& frame) = 0;
+};
+
+// a bus without errors or stuff bits: every node offers at most one frame at
+// a time, the one with the lowest id wins arbitration, and the nodes whose
+// bit rate matches the bus get it at the end of the frame
+class HostCANBus {
+public:
+  HostCANBus(long bitRate);
+
+  void attach(HostCANNode* node);
+
+  void setBitRate(long bitRate);
+  long bitRate();
+
+  void transmit(HostCANNode* node, const CANFrame& frame);
+  bool cancel(HostCANNode* node);
+  bool transmitting(HostCANNode* node);
+
+  unsigned long framesCarried();
+  unsigned long mismatched();
+
+  static int frameBits(const CANFrame& frame);
+  uint64_t frameTime(const CANFrame& frame);
+
+private:
+  void start();
+  void finish();
+
+private:
+  struct Transmission {
+    HostCANNode* node;
+    CANFrame frame;
+  };
+
+  long _bitRate;
+  std::vector<HostCANNode*> _nodes;
+  std::deque<Transmission> _pending;
+  bool _busy;
+  Transmission _current;
+
+  unsigned long _framesCarried;
+  unsigned long _mismatched;
+};
+
+// the other node on the bus: sends what it is given in order, and keeps what
+// it receives for parsePacket() and for inspection
+class HostCANPeer : public CANControllerClass, public HostCANNode {
+public:
+  HostCANPeer(HostCANBus& bus);
+  virtual ~HostCANPeer();
+
+  virtual int begin(long baudRate);
+  virtual void end();
+
+  virtual int endPacket();
+  virtual int parsePacket();
+
+  virtual long nodeBitRate();
+  virtual void frameReceived(const CANFrame& frame);
+  virtual void frameSent(const CANFrame& frame);
+
+  struct Received {
+    CANFrame frame;
+    uint64_t time;
+  };
+
+  const std::vector<Received>& log();
+  void clearLog();
+  size_t queued();
+  size_t pending();
+
+private:
+  HostCANBus* _bus;
+  long _bitRate;
+
+  std::deque<CANFrame> _txQueue;
+  bool _sending;
+  std::deque<Received> _rxQueue;
+  std::vector<Received> _log;
+};
+
+#endif
@@ -0,0 +1,732 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "MCP2515Model.h"
+
+#define REG_BFPCTRL                0x0c
+#define REG_TXRTSCTRL              0x0d
+#define REG_CANSTAT                0x0e
+#define REG_CANCTRL                0x0f
+#define REG_CNF3                   0x28
+#define REG_CNF2                   0x29
+#define REG_CNF1                   0x2a
+#define REG_CANINTE                0x2b
+#define REG_CANINTF                0x2c
+#define REG_EFLG                   0x2d
+#define REG_TXBnCTRL(n)            (0x30 + (n * 0x10))
+#define REG_RXBnCTRL(n)            (0x60 + (n * 0x10))
+
+#define MODE_NORMAL                0x00
+#define MODE_SLEEP                 0x20
+#define MODE_LOOPBACK              0x40
+#define MODE_LISTEN_ONLY           0x60
+#define MODE_CONFIG                0x80
+
+#define FLAG_ABAT                  0x10
+#define FLAG_TXREQ                 0x08
+#define FLAG_ABTF                  0x40
+#define FLAG_BUKT                  0x04
+#define FLAG_RXRTR                 0x08
+#define FLAG_ERRIF                 0x20
+#define FLAG_RX0OVR                0x40
+#define FLAG_RX1OVR                0x80
+
+#define FLAG_RXnIF(n)              (0x01 << n)
+#define FLAG_TXnIF(n)              (0x04 << n)
+
+// RXF3 - RXF5 start at 0x10, after BFPCTRL, TXRTSCTRL, CANSTAT and CANCTRL
+#define REG_RXFn(n)                ((n + (n > 2)) * 4)
+#define REG_RXMn(n)                (0x20 + (n * 4))
+
+MCP2515Model::MCP2515Model(HostCANBus& bus, int csPin, int intPin, long clockFrequency) :
+  _bus(&bus),
+  _csPin(csPin),
+  _intPin(intPin),
+  _clockFrequency(clockFrequency),
+  _selected(false),
+  _state(STATE_IDLE),
+  _address(0),
+  _mask(0),
+  _rxRead(-1),
+  _txBuffer(-1),
+  _lastReadStored(0),
+  _overflows(0),
+  _ignoredWrites(0)
+{
+  resetRegisters();
+
+  bus.attach(this);
+  host::attachSPIDevice(this);
+  host::onPinWrite(csPin, [this](int level) { csChanged(level); });
+}
+
+MCP2515Model::~MCP2515Model()
+{
+}
+
+bool MCP2515Model::selected()
+{
+  return _selected;
+}
+
+uint8_t MCP2515Model::transfer(uint8_t value)
+{
+  uint8_t result = 0xff;
+
+  switch (_state) {
+    case STATE_COMMAND:
+      command(value);
+      break;
+
+    case STATE_READ_ADDRESS:
+      _address = value & 0x7f;
+      _state = STATE_READ;
+      break;
+
+    case STATE_READ:
+      result = readReg(_address);
+      _address = (_address + 1) & 0x7f;
+      break;
+
+    case STATE_WRITE_ADDRESS:
+      _address = value & 0x7f;
+      _state = STATE_WRITE;
+      break;
+
+    case STATE_WRITE:
+      writeReg(_address, value, 0xff);
+      _address = (_address + 1) & 0x7f;
+      break;
+
+    case STATE_MODIFY_ADDRESS:
+      _address = value & 0x7f;
+      _state = STATE_MODIFY_MASK;
+      break;
+
+    case STATE_MODIFY_MASK:
+      _mask = value;
+      _state = STATE_MODIFY_DATA;
+      break;
+
+    case STATE_MODIFY_DATA:
+      writeReg(_address, value, _mask);
+      _state = STATE_DONE;
+      break;
+
+    case STATE_READ_STATUS:
+      result = readStatus();
+      break;
+
+    case STATE_RX_STATUS:
+      result = rxStatus();
+      break;
+
+    default:
+      break;
+  }
+
+  return result;
+}
+
+long MCP2515Model::nodeBitRate()
+{
+  uint8_t opmod = mode();
+
+  if (opmod != MODE_NORMAL && opmod != MODE_LISTEN_ONLY) {
+    return 0;
+  }
+
+  return bitRate();
+}
+
+void MCP2515Model::frameReceived(const CANFrame& frame)
+{
+  receive(frame);
+}
+
+void MCP2515Model::frameSent(const CANFrame&)
+{
+  completeTransmit();
+}
+
+uint8_t MCP2515Model::reg(uint8_t address)
+{
+  return _regs[address & 0x7f];
+}
+
+uint8_t MCP2515Model::mode()
+{
+  return _regs[REG_CANSTAT] & 0xe0;
+}
+
+long MCP2515Model::bitRate()
+{
+  uint8_t cnf1 = _regs[REG_CNF1];
+  uint8_t cnf2 = _regs[REG_CNF2];
+  uint8_t cnf3 = _regs[REG_CNF3];
+
+  long brp = (cnf1 & 0x3f) + 1;
+  long prseg = (cnf2 & 0x07) + 1;
+  long phseg1 = ((cnf2 >> 3) & 0x07) + 1;
+  long phseg2;
+
+  if (cnf2 & 0x80) {
+    phseg2 = (cnf3 & 0x07) + 1;
+  } else {
+    // PHSEG2 is the greater of PHSEG1 and the information processing time
+    phseg2 = (phseg1 > 2) ? phseg1 : 2;
+  }
+
+  long quanta = 1 + prseg + phseg1 + phseg2;
+
+  if (quanta < 5 || quanta > 25) {
+    return 0;
+  }
+
+  return _clockFrequency / (2 * brp * quanta);
+}
+
+unsigned long MCP2515Model::overflows()
+{
+  return _overflows;
+}
+
+unsigned long MCP2515Model::ignoredWrites()
+{
+  return _ignoredWrites;
+}
+
+uint64_t MCP2515Model::lastReadStored()
+{
+  return _lastReadStored;
+}
+
+const std::vector<MCP2515Model::Transmission>& MCP2515Model::transmitted()
+{
+  return _transmitted;
+}
+
+void MCP2515Model::clearTransmitted()
+{
+  _transmitted.clear();
+}
+
+void MCP2515Model::csChanged(int level)
+{
+  if (level == LOW) {
+    _selected = true;
+    _state = STATE_COMMAND;
+    return;
+  }
+
+  _selected = false;
+  _state = STATE_IDLE;
+
+  if (_rxRead >= 0) {
+    // raising CS after READ RX BUFFER clears RXnIF
+    _regs[REG_CANINTF] &= ~FLAG_RXnIF(_rxRead);
+    _rxRead = -1;
+
+    updateInt();
+  }
+}
+
+void MCP2515Model::command(uint8_t value)
+{
+  if (value == 0xc0) {
+    // RESET
+    if (_txBuffer >= 0) {
+      _bus->cancel(this);
+      _txBuffer = -1;
+    }
+
+    resetRegisters();
+    updateInt();
+    _state = STATE_DONE;
+  } else if (value == 0x03) {
+    _state = STATE_READ_ADDRESS;
+  } else if (value == 0x02) {
+    _state = STATE_WRITE_ADDRESS;
+  } else if (value == 0x05) {
+    _state = STATE_MODIFY_ADDRESS;
+  } else if ((value & 0xf8) == 0x40 && (value & 0x07) <= 5) {
+    // LOAD TX BUFFER, at TXBnSIDH or TXBnD0
+    int n = (value >> 1) & 0x03;
+
+    _address = REG_TXBnCTRL(n) + ((value & 0x01) ? 6 : 1);
+    _state = STATE_WRITE;
+  } else if ((value & 0xf9) == 0x90) {
+    // READ RX BUFFER, at RXBnSIDH or RXBnD0
+    int n = (value >> 2) & 0x01;
+
+    _address = REG_RXBnCTRL(n) + ((value & 0x02) ? 6 : 1);
+    _rxRead = n;
+    _lastReadStored = _stored[n];
+    _state = STATE_READ;
+  } else if ((value & 0xf8) == 0x80) {
+    // RTS
+    for (int n = 0; n < 3; n++) {
+      if (value & (1 << n)) {
+        writeReg(REG_TXBnCTRL(n), FLAG_TXREQ, FLAG_TXREQ);
+      }
+    }
+    _state = STATE_DONE;
+  } else if (value == 0xa0) {
+    _state = STATE_READ_STATUS;
+  } else if (value == 0xb0) {
+    _state = STATE_RX_STATUS;
+  } else {
+    _state = STATE_DONE;
+  }
+}
+
+void MCP2515Model::resetRegisters()
+{
+  memset(_regs, 0x00, sizeof(_regs));
+
+  for (int i = 0; i < 8; i++) {
+    _regs[(i << 4) | 0x0e] = MODE_CONFIG;
+    _regs[(i << 4) | 0x0f] = 0x87;
+  }
+
+  memset(_txRequested, 0x00, sizeof(_txRequested));
+  memset(_stored, 0x00, sizeof(_stored));
+}
+
+uint8_t MCP2515Model::readReg(uint8_t address)
+{
+  // CANSTAT and CANCTRL show up at the end of every row
+  if ((address & 0x0f) == 0x0e) {
+    return _regs[REG_CANSTAT];
+  } else if ((address & 0x0f) == 0x0f) {
+    return _regs[REG_CANCTRL];
+  }
+
+  return _regs[address];
+}
+
+uint8_t MCP2515Model::writableBits(uint8_t address)
+{
+  if ((address & 0x0f) == 0x0e) {
+    return 0x00;
+  }
+
+  if (address >= 0x30 && address < 0x60) {
+    // TXBnCTRL: TXREQ and TXP, the rest of the buffer is data
+    return ((address & 0x0f) == 0x00) ? 0x0b : 0xff;
+  }
+
+  if (address >= 0x60) {
+    // RXBnCTRL: RXM and BUKT, the buffers themselves are read only
+    if (address == REG_RXBnCTRL(0)) {
+      return 0x64;
+    } else if (address == REG_RXBnCTRL(1)) {
+      return 0x60;
+    }
+
+    return 0x00;
+  }
+
+  switch (address) {
+    case 0x01: case 0x05: case 0x09: case 0x11: case 0x15: case 0x19:
+    case 0x21: case 0x25:
+      // RXFnSIDL and RXMnSIDL have unimplemented bits
+      return 0xeb;
+
+    case REG_BFPCTRL:
+      return 0x3f;
+
+    case REG_TXRTSCTRL:
+      return 0x07;
+
+    case REG_CNF3:
+      return 0xc7;
+
+    case REG_EFLG:
+      return FLAG_RX1OVR | FLAG_RX0OVR;
+
+    default:
+      return 0xff;
+  }
+}
+
+bool MCP2515Model::configOnly(uint8_t address)
+{
+  // filters, masks, TXRTSCTRL and the bit timing
+  if (address < 0x20) {
+    return ((address & 0x0f) < 0x0c) || address == REG_TXRTSCTRL;
+  }
+
+  return address < 0x28 || address == REG_CNF3 || address == REG_CNF2 || address == REG_CNF1;
+}
+
+void MCP2515Model::writeReg(uint8_t address, uint8_t value, uint8_t mask)
+{
+  if ((address & 0x0f) == 0x0f) {
+    address = REG_CANCTRL;
+  }
+
+  if (configOnly(address) && mode() != MODE_CONFIG) {
+    _ignoredWrites++;
+    return;
+  }
+
+  uint8_t writable = writableBits(address) & mask;
+  uint8_t previous = _regs[address];
+
+  _regs[address] = (previous & ~writable) | (value & writable);
+
+  if (address == REG_CANCTRL) {
+    if ((_regs[REG_CANCTRL] & FLAG_ABAT) && !(previous & FLAG_ABAT)) {
+      abortTransmit(true);
+    }
+
+    modeChanged();
+  } else if (address == REG_TXBnCTRL(0) || address == REG_TXBnCTRL(1) || address == REG_TXBnCTRL(2)) {
+    int n = (address - REG_TXBnCTRL(0)) >> 4;
+
+    if ((_regs[address] & FLAG_TXREQ) && !(previous & FLAG_TXREQ)) {
+      requestTransmit(n);
+    } else if (!(_regs[address] & FLAG_TXREQ) && (previous & FLAG_TXREQ) && _txBuffer == n) {
+      if (_bus->cancel(this)) {
+        _txBuffer = -1;
+        startTransmit();
+      } else {
+        // a frame already on the bus can't be taken back
+        _regs[address] |= FLAG_TXREQ;
+      }
+    }
+  } else if (address == REG_CANINTF || address == REG_CANINTE) {
+    updateInt();
+  }
+}
+
+void MCP2515Model::modeChanged()
+{
+  uint8_t requested = _regs[REG_CANCTRL] & 0xe0;
+
+  if (requested > MODE_CONFIG) {
+    requested = MODE_CONFIG;
+  }
+
+  if (requested == mode()) {
+    return;
+  }
+
+  for (int i = 0; i < 8; i++) {
+    _regs[(i << 4) | 0x0e] = (_regs[REG_CANSTAT] & 0x1f) | requested;
+  }
+
+  if (requested == MODE_CONFIG || requested == MODE_SLEEP || requested == MODE_LISTEN_ONLY) {
+    // pending requests don't go out in these modes
+    abortTransmit(false);
+  } else {
+    startTransmit();
+  }
+}
+
+void MCP2515Model::requestTransmit(int n)
+{
+  _txRequested[n] = host::now();
+  _regs[REG_TXBnCTRL(n)] &= ~(FLAG_ABTF | 0x30);
+
+  uint8_t opmod = mode();
+
+  if (opmod == MODE_NORMAL || opmod == MODE_LOOPBACK) {
+    startTransmit();
+  } else if (opmod != MODE_CONFIG) {
+    // nothing goes out in listen only or sleep mode
+    _regs[REG_TXBnCTRL(n)] = (_regs[REG_TXBnCTRL(n)] & ~FLAG_TXREQ) | FLAG_ABTF;
+  }
+}
+
+void MCP2515Model::startTransmit()
+{
+  if (_txBuffer >= 0) {
+    return;
+  }
+
+  uint8_t opmod = mode();
+
+  if (opmod != MODE_NORMAL && opmod != MODE_LOOPBACK) {
+    return;
+  }
+
+  // highest TXP first, then the highest buffer number
+  int next = -1;
+
+  for (int n = 0; n < 3; n++) {
+    uint8_t ctrl = _regs[REG_TXBnCTRL(n)];
+
+    if ((ctrl & FLAG_TXREQ) && (next < 0 || (ctrl & 0x03) >= (_regs[REG_TXBnCTRL(next)] & 0x03))) {
+      next = n;
+    }
+  }
+
+  if (next < 0) {
+    return;
+  }
+
+  _txBuffer = next;
+
+  CANFrame frame = txFrame(next);
+
+  if (opmod == MODE_LOOPBACK) {
+    uint64_t frameTime = (uint64_t)HostCANBus::frameBits(frame) * 1000000000ULL / bitRate();
+
+    host::schedule(host::now() + frameTime, [this, frame]() {
+      if (_txBuffer >= 0 && mode() == MODE_LOOPBACK) {
+        receive(frame);
+        completeTransmit();
+      }
+    });
+  } else {
+    _bus->transmit(this, frame);
+  }
+}
+
+void MCP2515Model::abortTransmit(bool all)
+{
+  for (int n = 0; n < 3; n++) {
+    uint8_t& ctrl = _regs[REG_TXBnCTRL(n)];
+
+    if (!(ctrl & FLAG_TXREQ)) {
+      continue;
+    }
+
+    if (n == _txBuffer) {
+      if (!_bus->cancel(this)) {
+        // already on the bus, it completes
+        continue;
+      }
+
+      _txBuffer = -1;
+    } else if (!all && mode() == MODE_CONFIG) {
+      // config mode leaves the requests of the other buffers for later
+      continue;
+    }
+
+    ctrl = (ctrl & ~FLAG_TXREQ) | FLAG_ABTF;
+  }
+}
+
+CANFrame MCP2515Model::txFrame(int n)
+{
+  const uint8_t* regs = &_regs[REG_TXBnCTRL(n) + 1];
+  CANFrame frame;
+
+  bool extended = (regs[1] & 0x08) ? true : false;
+  long id = (regs[0] << 3) | (regs[1] >> 5);
+
+  if (extended) {
+    id = (id << 18) | ((long)(regs[1] & 0x03) << 16) | (regs[2] << 8) | regs[3];
+  }
+
+  frame.setId(id, extended, (regs[4] & 0x40) ? true : false);
+  frame.dlc = regs[4] & 0x0f;
+  frame.bus = 0;
+  frame.filter = -1;
+  frame.reserved = 0;
+  memset(frame.data, 0x00, sizeof(frame.data));
+  memcpy(frame.data, &regs[5], frame.packetLength());
+
+  return frame;
+}
+
+void MCP2515Model::completeTransmit()
+{
+  int n = _txBuffer;
+
+  if (n < 0) {
+    return;
+  }
+
+  _txBuffer = -1;
+
+  Transmission transmission = { txFrame(n), _txRequested[n], host::now() };
+  _transmitted.push_back(transmission);
+
+  _regs[REG_TXBnCTRL(n)] &= ~(FLAG_TXREQ | FLAG_ABTF | 0x30);
+  _regs[REG_CANINTF] |= FLAG_TXnIF(n);
+  updateInt();
+
+  startTransmit();
+}
+
+void MCP2515Model::receive(const CANFrame& frame)
+{
+  uint8_t opmod = mode();
+
+  if (opmod == MODE_CONFIG || opmod == MODE_SLEEP) {
+    return;
+  }
+
+  int hit = match(0, frame);
+
+  if (hit >= 0) {
+    if (!(_regs[REG_CANINTF] & FLAG_RXnIF(0))) {
+      store(0, frame, hit);
+    } else if (_regs[REG_RXBnCTRL(0)] & FLAG_BUKT) {
+      // rolls over into RXB1 whatever its filters say
+      if (!(_regs[REG_CANINTF] & FLAG_RXnIF(1))) {
+        store(1, frame, hit);
+      } else {
+        overflow(1);
+      }
+    } else {
+      overflow(0);
+    }
+
+    return;
+  }
+
+  hit = match(1, frame);
+
+  if (hit >= 0) {
+    if (!(_regs[REG_CANINTF] & FLAG_RXnIF(1))) {
+      store(1, frame, hit);
+    } else {
+      overflow(1);
+    }
+  }
+}
+
+int MCP2515Model::match(int buffer, const CANFrame& frame)
+{
+  uint8_t rxm = (_regs[REG_RXBnCTRL(buffer)] >> 5) & 0x03;
+
+  if (rxm == 0x03) {
+    // filters off, receive any packet
+    return buffer == 0 ? 0 : 2;
+  }
+
+  // RXM 01 and 10 take standard and extended packets only, as on the
+  // original MCP2515
+  if ((rxm == 0x01 && frame.packetExtended()) || (rxm == 0x02 && !frame.packetExtended())) {
+    return -1;
+  }
+
+  int first = (buffer == 0) ? 0 : 2;
+  int last = (buffer == 0) ? 1 : 5;
+
+  for (int filter = first; filter <= last; filter++) {
+    if (filterMatches(filter, buffer, frame)) {
+      return filter;
+    }
+  }
+
+  return -1;
+}
+
+bool MCP2515Model::filterMatches(int filter, int mask, const CANFrame& frame)
+{
+  const uint8_t* f = &_regs[REG_RXFn(filter)];
+  const uint8_t* m = &_regs[REG_RXMn(mask)];
+
+  bool extended = frame.packetExtended();
+
+  if (((f[1] & 0x08) ? true : false) != extended) {
+    return false;
+  }
+
+  uint32_t filterSid = (f[0] << 3) | (f[1] >> 5);
+  uint32_t maskSid = (m[0] << 3) | (m[1] >> 5);
+  uint32_t filterEid = ((uint32_t)(f[1] & 0x03) << 16) | (f[2] << 8) | f[3];
+  uint32_t maskEid = ((uint32_t)(m[1] & 0x03) << 16) | (m[2] << 8) | m[3];
+
+  uint32_t id = frame.packetId();
+
+  if (extended) {
+    return (((id >> 18) ^ filterSid) & maskSid) == 0 && (((id & 0x3ffff) ^ filterEid) & maskEid) == 0;
+  }
+
+  // EID8 and EID0 filter the first two data bytes of standard packets
+  int length = frame.packetLength();
+  uint32_t data = ((length > 0 ? frame.data[0] : 0) << 8) | (length > 1 ? frame.data[1] : 0);
+
+  return ((id ^ filterSid) & maskSid) == 0 && ((data ^ filterEid) & maskEid & 0xffff) == 0;
+}
+
+void MCP2515Model::store(int n, const CANFrame& frame, int filhit)
+{
+  uint8_t* regs = &_regs[REG_RXBnCTRL(n)];
+  long id = frame.packetId();
+  bool rtr = frame.packetRtr();
+
+  if (frame.packetExtended()) {
+    regs[1] = id >> 21;
+    regs[2] = (((id >> 18) & 0x07) << 5) | 0x08 | ((id >> 16) & 0x03);
+    regs[3] = (id >> 8) & 0xff;
+    regs[4] = id & 0xff;
+    regs[5] = (rtr ? 0x40 : 0x00) | (frame.dlc & 0x0f);
+  } else {
+    regs[1] = id >> 3;
+    regs[2] = ((id & 0x07) << 5) | (rtr ? 0x10 : 0x00);
+    regs[3] = 0x00;
+    regs[4] = 0x00;
+    regs[5] = frame.dlc & 0x0f;
+  }
+
+  memcpy(&regs[6], frame.data, 8);
+
+  // FILHIT, a rolled over packet reports filter 0 or 1
+  if (n == 0) {
+    regs[0] = (regs[0] & 0x64) | (rtr ? FLAG_RXRTR : 0) | (filhit & 0x01);
+  } else {
+    regs[0] = (regs[0] & 0x60) | (rtr ? FLAG_RXRTR : 0) | (filhit & 0x07);
+  }
+
+  _stored[n] = host::now();
+  _regs[REG_CANINTF] |= FLAG_RXnIF(n);
+
+  updateInt();
+}
+
+void MCP2515Model::overflow(int n)
+{
+  _overflows++;
+
+  _regs[REG_EFLG] |= (n == 0) ? FLAG_RX0OVR : FLAG_RX1OVR;
+  _regs[REG_CANINTF] |= FLAG_ERRIF;
+
+  updateInt();
+}
+
+uint8_t MCP2515Model::readStatus()
+{
+  uint8_t intf = _regs[REG_CANINTF];
+  uint8_t status = intf & 0x03;
+
+  for (int n = 0; n < 3; n++) {
+    if (_regs[REG_TXBnCTRL(n)] & FLAG_TXREQ) {
+      status |= 0x04 << (2 * n);
+    }
+    if (intf & FLAG_TXnIF(n)) {
+      status |= 0x08 << (2 * n);
+    }
+  }
+
+  return status;
+}
+
+uint8_t MCP2515Model::rxStatus()
+{
+  uint8_t intf = _regs[REG_CANINTF];
+  int n = (intf & FLAG_RXnIF(0)) ? 0 : 1;
+  uint8_t status = (intf & 0x03) << 6;
+
+  if (intf & 0x03) {
+    const uint8_t* regs = &_regs[REG_RXBnCTRL(n)];
+    bool extended = (regs[2] & 0x08) ? true : false;
+    bool rtr = (regs[0] & FLAG_RXRTR) ? true : false;
+
+    status |= (extended ? 0x10 : 0x00) | (rtr ? 0x08 : 0x00) | (regs[0] & 0x07);
+  }
+
+  return status;
+}
+
+void MCP2515Model::updateInt()
+{
+  host::setPin(_intPin, (_regs[REG_CANINTF] & _regs[REG_CANINTE]) ? LOW : HIGH);
+}
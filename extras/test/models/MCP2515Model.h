@@ -0,0 +1,114 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef MCP2515_MODEL_H
+#define MCP2515_MODEL_H
+
+#include <vector>
+
+#include <HostCore.h>
+
+#include "HostCANBus.h"
+
+// Register model of the MCP2515 behind the host SPI: the SPI instruction
+// set, operation modes, the bit timing from CNF1 - CNF3, acceptance filters
+// with RXB0 rollover and overflow flags, three TX buffers with priorities,
+// and the INT pin. Not modeled: bus errors and error counters, the RXnBF and
+// TXnRTS pins, one-shot mode, sleep wake-up and the clock out pin.
+class MCP2515Model : public host::SPIDevice, public HostCANNode {
+public:
+  MCP2515Model(HostCANBus& bus, int csPin = 10, int intPin = 2, long clockFrequency = 16000000);
+  virtual ~MCP2515Model();
+
+  virtual bool selected();
+  virtual uint8_t transfer(uint8_t value);
+
+  virtual long nodeBitRate();
+  virtual void frameReceived(const CANFrame& frame);
+  virtual void frameSent(const CANFrame& frame);
+
+  // for inspection, no side effects
+  uint8_t reg(uint8_t address);
+  uint8_t mode();
+  long bitRate();
+
+  // ground truth for the tests, independent of what the driver reports
+  unsigned long overflows();
+  unsigned long ignoredWrites();
+  uint64_t lastReadStored();
+
+  struct Transmission {
+    CANFrame frame;
+    uint64_t requested;
+    uint64_t completed;
+  };
+
+  const std::vector<Transmission>& transmitted();
+  void clearTransmitted();
+
+private:
+  enum State {
+    STATE_IDLE,
+    STATE_COMMAND,
+    STATE_READ_ADDRESS,
+    STATE_READ,
+    STATE_WRITE_ADDRESS,
+    STATE_WRITE,
+    STATE_MODIFY_ADDRESS,
+    STATE_MODIFY_MASK,
+    STATE_MODIFY_DATA,
+    STATE_READ_STATUS,
+    STATE_RX_STATUS,
+    STATE_DONE
+  };
+
+  void csChanged(int level);
+  void command(uint8_t value);
+
+  void resetRegisters();
+  uint8_t readReg(uint8_t address);
+  void writeReg(uint8_t address, uint8_t value, uint8_t mask);
+  uint8_t writableBits(uint8_t address);
+  bool configOnly(uint8_t address);
+
+  void modeChanged();
+  void requestTransmit(int n);
+  void startTransmit();
+  void abortTransmit(bool all);
+  CANFrame txFrame(int n);
+  void completeTransmit();
+
+  void receive(const CANFrame& frame);
+  int match(int buffer, const CANFrame& frame);
+  bool filterMatches(int filter, int mask, const CANFrame& frame);
+  void store(int n, const CANFrame& frame, int filhit);
+  void overflow(int n);
+
+  uint8_t readStatus();
+  uint8_t rxStatus();
+  void updateInt();
+
+private:
+  HostCANBus* _bus;
+  int _csPin;
+  int _intPin;
+  long _clockFrequency;
+
+  uint8_t _regs[128];
+  bool _selected;
+  State _state;
+  uint8_t _address;
+  uint8_t _mask;
+  int _rxRead;
+
+  int _txBuffer;
+  uint64_t _txRequested[3];
+  uint64_t _stored[2];
+  uint64_t _lastReadStored;
+
+  unsigned long _overflows;
+  unsigned long _ignoredWrites;
+  std::vector<Transmission> _transmitted;
+};
+
+#endif
@@ -0,0 +1,574 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "TWAIModel.h"
+
+#define REG_MOD                    0x00
+#define REG_CMR                    0x01
+#define REG_SR                     0x02
+#define REG_IR                     0x03
+#define REG_IER                    0x04
+#define REG_BTR0                   0x06
+#define REG_BTR1                   0x07
+#define REG_OCR                    0x08
+#define REG_ALC                    0x0b
+#define REG_ECC                    0x0c
+#define REG_EWLR                   0x0d
+#define REG_RXERR                  0x0e
+#define REG_TXERR                  0x0f
+#define REG_RMC                    0x1d
+#define REG_CDR                    0x1f
+
+#define MOD_RM                     0x01
+#define MOD_LOM                    0x02
+#define MOD_STM                    0x04
+#define MOD_AFM                    0x08
+#define MOD_SM                     0x10
+
+#define CMR_TR                     0x01
+#define CMR_AT                     0x02
+#define CMR_RRB                    0x04
+#define CMR_CDO                    0x08
+#define CMR_SRR                    0x10
+
+#define IR_RI                      0x01
+#define IR_TI                      0x02
+#define IR_DOI                     0x08
+
+#define FIFO_SIZE                  64
+
+TWAIModel::TWAIModel(HostCANBus& bus, uint32_t base, const Gates& gates, int intrSource, long clockFrequency) :
+  _bus(&bus),
+  _base(base),
+  _gates(gates),
+  _intrSource(intrSource),
+  _clockFrequency(clockFrequency),
+  _inReset(true),
+  _overruns(0),
+  _gatedAccesses(0),
+  _ignoredWrites(0),
+  _received(0),
+  _lastReleasedStored(0)
+{
+  resetRegisters();
+
+  bus.attach(this);
+  host::mapRegisters(base, 0x80, this);
+
+  // the reset bit can be set and released again without a register access
+  // in between, as end() and begin() do
+  host::onRegisterWrite(gates.resetReg, [this](uint32_t) { sync(); });
+}
+
+TWAIModel::~TWAIModel()
+{
+}
+
+uint32_t TWAIModel::read(uint32_t offset)
+{
+  sync();
+
+  if (!clocked()) {
+    _gatedAccesses++;
+    return 0;
+  }
+
+  uint8_t address = offset / 4;
+
+  if ((offset % 4) || address > REG_CDR) {
+    return 0;
+  }
+
+  switch (address) {
+    case REG_MOD:
+      return _mod;
+
+    case REG_SR:
+      return status();
+
+    case REG_IR: {
+      // reading clears everything but RI, which follows the FIFO
+      uint8_t ir = _ir | ((!_fifo.empty() && (_ier & IR_RI)) ? IR_RI : 0);
+
+      _ir = 0;
+      updateLine();
+
+      return ir;
+    }
+
+    case REG_IER:
+      return _ier;
+
+    case REG_BTR0:
+      return _btr0;
+
+    case REG_BTR1:
+      return _btr1;
+
+    case REG_OCR:
+      return _ocr;
+
+    case REG_EWLR:
+      return _ewlr;
+
+    case REG_RXERR:
+      return _rxerr;
+
+    case REG_TXERR:
+      return _txerr;
+
+    case REG_RMC:
+      return _fifo.size();
+
+    case REG_CDR:
+      return _cdr;
+
+    default:
+      break;
+  }
+
+  if (address >= 0x10 && address <= 0x1c) {
+    if (resetMode()) {
+      if (address < 0x14) {
+        return _acr[address - 0x10];
+      } else if (address < 0x18) {
+        return _amr[address - 0x14];
+      }
+
+      return 0;
+    }
+
+    // the RX window shows the packet at the head of the FIFO
+    if (!_fifo.empty() && (address - 0x10) < _fifo.front().length) {
+      return _fifo.front().bytes[address - 0x10];
+    }
+  }
+
+  // CMR, ALC and ECC read as 0, there are no errors
+  return 0;
+}
+
+void TWAIModel::write(uint32_t offset, uint32_t value)
+{
+  sync();
+
+  if (!clocked()) {
+    _gatedAccesses++;
+    return;
+  }
+
+  uint8_t address = offset / 4;
+  bool reset = resetMode();
+
+  if ((offset % 4) || address > REG_CDR) {
+    return;
+  }
+
+  value &= 0xff;
+
+  switch (address) {
+    case REG_MOD: {
+      // the mode bits other than RM and SM only change in reset mode
+      uint8_t writable = reset ? 0x1f : (MOD_RM | MOD_SM);
+
+      _mod = (_mod & ~writable) | (value & writable);
+
+      if (!reset && (_mod & MOD_RM)) {
+        enterResetMode();
+      }
+      return;
+    }
+
+    case REG_CMR:
+      if (!reset) {
+        command(value);
+      }
+      return;
+
+    case REG_IER:
+      _ier = value;
+      updateLine();
+      return;
+
+    default:
+      break;
+  }
+
+  if (address >= 0x10 && address <= 0x1c && !reset) {
+    _txBuffer[address - 0x10] = value;
+    return;
+  }
+
+  if (!reset) {
+    // the rest is only writable in reset mode
+    _ignoredWrites++;
+    return;
+  }
+
+  if (address >= 0x10 && address < 0x14) {
+    _acr[address - 0x10] = value;
+  } else if (address >= 0x14 && address < 0x18) {
+    _amr[address - 0x14] = value;
+  } else {
+    switch (address) {
+      case REG_BTR0: _btr0 = value; break;
+      case REG_BTR1: _btr1 = value; break;
+      case REG_OCR: _ocr = value; break;
+      case REG_EWLR: _ewlr = value; break;
+      case REG_RXERR: _rxerr = value; break;
+      case REG_TXERR: _txerr = value; break;
+      case REG_CDR: _cdr = value; break;
+      default: break;
+    }
+  }
+}
+
+long TWAIModel::nodeBitRate()
+{
+  sync();
+
+  if (!clocked() || resetMode()) {
+    return 0;
+  }
+
+  return bitRate();
+}
+
+void TWAIModel::frameReceived(const CANFrame& frame)
+{
+  if (accepts(frame)) {
+    push(frame);
+  }
+}
+
+void TWAIModel::frameSent(const CANFrame& frame)
+{
+  if (!_txPending) {
+    return;
+  }
+
+  _txPending = false;
+  _txComplete = true;
+
+  Transmission transmission = { frame, _txRequested, host::now() };
+  _transmitted.push_back(transmission);
+
+  if (_selfReception && accepts(frame)) {
+    push(frame);
+  }
+
+  raise(IR_TI);
+}
+
+bool TWAIModel::clocked()
+{
+  if ((host::peekRegister(_gates.clockReg) & _gates.clockMask) != _gates.clockMask) {
+    return false;
+  }
+
+  if (_gates.functionClockReg &&
+      (host::peekRegister(_gates.functionClockReg) & _gates.functionClockMask) != _gates.functionClockMask) {
+    return false;
+  }
+
+  return (host::peekRegister(_gates.resetReg) & _gates.resetMask) == 0;
+}
+
+bool TWAIModel::resetMode()
+{
+  return (_mod & MOD_RM) ? true : false;
+}
+
+uint8_t TWAIModel::modeBits()
+{
+  return _mod;
+}
+
+long TWAIModel::bitRate()
+{
+  long brp = (_btr0 & 0x3f) + 1;
+  long tseg1 = (_btr1 & 0x0f) + 1;
+  long tseg2 = ((_btr1 >> 4) & 0x07) + 1;
+
+  return _clockFrequency / (2 * brp * (1 + tseg1 + tseg2));
+}
+
+int TWAIModel::intrSource()
+{
+  return _intrSource;
+}
+
+unsigned long TWAIModel::overruns()
+{
+  return _overruns;
+}
+
+unsigned long TWAIModel::gatedAccesses()
+{
+  return _gatedAccesses;
+}
+
+unsigned long TWAIModel::ignoredWrites()
+{
+  return _ignoredWrites;
+}
+
+unsigned long TWAIModel::received()
+{
+  return _received;
+}
+
+uint64_t TWAIModel::lastReleasedStored()
+{
+  return _lastReleasedStored;
+}
+
+const std::vector<TWAIModel::Transmission>& TWAIModel::transmitted()
+{
+  return _transmitted;
+}
+
+void TWAIModel::clearTransmitted()
+{
+  _transmitted.clear();
+}
+
+void TWAIModel::sync()
+{
+  // the peripheral reset bit puts every register back to its reset value
+  if (host::peekRegister(_gates.resetReg) & _gates.resetMask) {
+    _inReset = true;
+  } else if (_inReset) {
+    _inReset = false;
+
+    resetRegisters();
+  }
+}
+
+void TWAIModel::resetRegisters()
+{
+  if (_txPending) {
+    _bus->cancel(this);
+  }
+
+  _mod = MOD_RM;
+  _ier = 0;
+  _ir = 0;
+  _btr0 = 0;
+  _btr1 = 0;
+  _ocr = 0;
+  _ewlr = 96;
+  _rxerr = 0;
+  _txerr = 0;
+  _cdr = 0;
+  memset(_acr, 0x00, sizeof(_acr));
+  memset(_amr, 0x00, sizeof(_amr));
+  memset(_txBuffer, 0x00, sizeof(_txBuffer));
+
+  _overrun = false;
+  _txPending = false;
+  _txComplete = true;
+  _selfReception = false;
+  _txRequested = 0;
+
+  _fifo.clear();
+  _fifoBytes = 0;
+
+  updateLine();
+}
+
+void TWAIModel::enterResetMode()
+{
+  // a pending request is dropped, the RX FIFO is cleared
+  if (_txPending && _bus->cancel(this)) {
+    _txPending = false;
+  }
+
+  _fifo.clear();
+  _fifoBytes = 0;
+  _overrun = false;
+
+  updateLine();
+}
+
+void TWAIModel::command(uint8_t value)
+{
+  if (value & (CMR_TR | CMR_SRR)) {
+    if (!_txPending && !(_mod & MOD_LOM)) {
+      _txPending = true;
+      _txComplete = false;
+      _selfReception = (value & CMR_SRR) ? true : false;
+      _txRequested = host::now();
+
+      _bus->transmit(this, txFrame());
+    }
+  } else if (value & CMR_AT) {
+    if (_txPending && _bus->cancel(this)) {
+      _txPending = false;
+
+      raise(IR_TI);
+    }
+  }
+
+  if ((value & CMR_RRB) && !_fifo.empty()) {
+    _lastReleasedStored = _fifo.front().stored;
+    _fifoBytes -= _fifo.front().length;
+    _fifo.pop_front();
+
+    updateLine();
+  }
+
+  if (value & CMR_CDO) {
+    _overrun = false;
+  }
+}
+
+bool TWAIModel::accepts(const CANFrame& frame)
+{
+  sync();
+
+  if (!clocked() || resetMode()) {
+    return false;
+  }
+
+  if (!(_mod & MOD_AFM)) {
+    // dual filter mode isn't modeled, the driver doesn't use it
+    return true;
+  }
+
+  long id = frame.packetId();
+  int length = frame.packetLength();
+  uint8_t bytes[4];
+  uint8_t used[4] = { 0xff, 0xff, 0xff, 0xff };
+
+  if (frame.packetExtended()) {
+    bytes[0] = id >> 21;
+    bytes[1] = id >> 13;
+    bytes[2] = id >> 5;
+    bytes[3] = (id << 3) | (frame.packetRtr() ? 0x04 : 0x00);
+    used[3] = 0xfc;
+  } else {
+    // standard packets are also filtered on their first two data bytes
+    bytes[0] = id >> 3;
+    bytes[1] = (id << 5) | (frame.packetRtr() ? 0x10 : 0x00);
+    bytes[2] = length > 0 ? frame.data[0] : 0;
+    bytes[3] = length > 1 ? frame.data[1] : 0;
+    used[1] = 0xf0;
+    used[2] = length > 0 ? 0xff : 0x00;
+    used[3] = length > 1 ? 0xff : 0x00;
+  }
+
+  for (int i = 0; i < 4; i++) {
+    if ((bytes[i] ^ _acr[i]) & ~_amr[i] & used[i]) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void TWAIModel::push(const CANFrame& frame)
+{
+  Entry entry;
+  long id = frame.packetId();
+  int length = frame.packetLength();
+
+  memset(entry.bytes, 0x00, sizeof(entry.bytes));
+  entry.bytes[0] = (frame.packetExtended() ? 0x80 : 0x00) | (frame.packetRtr() ? 0x40 : 0x00) | (frame.dlc & 0x0f);
+
+  if (frame.packetExtended()) {
+    entry.bytes[1] = id >> 21;
+    entry.bytes[2] = id >> 13;
+    entry.bytes[3] = id >> 5;
+    entry.bytes[4] = (id << 3) | (frame.packetRtr() ? 0x04 : 0x00);
+    memcpy(&entry.bytes[5], frame.data, length);
+    entry.length = 5 + length;
+  } else {
+    entry.bytes[1] = id >> 3;
+    entry.bytes[2] = (id << 5) | (frame.packetRtr() ? 0x10 : 0x00);
+    memcpy(&entry.bytes[3], frame.data, length);
+    entry.length = 3 + length;
+  }
+
+  entry.stored = host::now();
+
+  if (_fifoBytes + entry.length > FIFO_SIZE) {
+    _overruns++;
+    _overrun = true;
+
+    raise(IR_DOI);
+    return;
+  }
+
+  _fifo.push_back(entry);
+  _fifoBytes += entry.length;
+  _received++;
+
+  updateLine();
+}
+
+CANFrame TWAIModel::txFrame()
+{
+  CANFrame frame;
+  bool extended = (_txBuffer[0] & 0x80) ? true : false;
+  bool rtr = (_txBuffer[0] & 0x40) ? true : false;
+  long id;
+  int data;
+
+  if (extended) {
+    id = ((long)_txBuffer[1] << 21) | ((long)_txBuffer[2] << 13) | (_txBuffer[3] << 5) | (_txBuffer[4] >> 3);
+    data = 5;
+  } else {
+    id = (_txBuffer[1] << 3) | (_txBuffer[2] >> 5);
+    data = 3;
+  }
+
+  frame.setId(id, extended, rtr);
+  frame.dlc = _txBuffer[0] & 0x0f;
+  frame.bus = 0;
+  frame.filter = -1;
+  frame.reserved = 0;
+  memset(frame.data, 0x00, sizeof(frame.data));
+  memcpy(frame.data, &_txBuffer[data], frame.packetLength());
+
+  return frame;
+}
+
+uint8_t TWAIModel::status()
+{
+  uint8_t sr = 0;
+
+  if (!resetMode() && !_fifo.empty()) {
+    sr |= 0x01;
+  }
+  if (_overrun) {
+    sr |= 0x02;
+  }
+  if (!_txPending) {
+    sr |= 0x04;
+  }
+  if (_txComplete) {
+    sr |= 0x08;
+  }
+  if (_bus->transmitting(this)) {
+    sr |= 0x20;
+  }
+
+  return sr;
+}
+
+void TWAIModel::raise(uint8_t flag)
+{
+  if (_ier & flag) {
+    _ir |= flag;
+  }
+
+  updateLine();
+}
+
+void TWAIModel::updateLine()
+{
+  bool asserted = _ir || (!_fifo.empty() && (_ier & IR_RI));
+
+  host::setSource(_intrSource, asserted);
+}
@@ -0,0 +1,123 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef TWAI_MODEL_H
+#define TWAI_MODEL_H
+
+#include <deque>
+#include <vector>
+
+#include <HostCore.h>
+
+#include "HostCANBus.h"
+
+// Register model of an ESP32 TWAI controller (SJA1000 PeliCAN mode) mapped
+// at its register base: reset and operating modes, the bit timing from BTR0
+// and BTR1, the single acceptance filter, the 64 byte RX FIFO with data
+// overrun, the TX buffer with self reception, and the interrupt source. It
+// only answers while its clock gates are on and its reset bit is off, so
+// every controller has to be brought up through its own bits. Not modeled:
+// bus errors and error counters, dual filter mode, sleep and arbitration
+// lost capture.
+class TWAIModel : public host::RegisterDevice, public HostCANNode {
+public:
+  struct Gates {
+    uint32_t clockReg;
+    uint32_t clockMask;
+    uint32_t functionClockReg;
+    uint32_t functionClockMask;
+    uint32_t resetReg;
+    uint32_t resetMask;
+  };
+
+  TWAIModel(HostCANBus& bus, uint32_t base, const Gates& gates, int intrSource, long clockFrequency);
+  virtual ~TWAIModel();
+
+  virtual uint32_t read(uint32_t offset);
+  virtual void write(uint32_t offset, uint32_t value);
+
+  virtual long nodeBitRate();
+  virtual void frameReceived(const CANFrame& frame);
+  virtual void frameSent(const CANFrame& frame);
+
+  bool clocked();
+  bool resetMode();
+  uint8_t modeBits();
+  long bitRate();
+  int intrSource();
+
+  // ground truth for the tests, independent of what the driver reports
+  unsigned long overruns();
+  unsigned long gatedAccesses();
+  unsigned long ignoredWrites();
+  unsigned long received();
+  uint64_t lastReleasedStored();
+
+  struct Transmission {
+    CANFrame frame;
+    uint64_t requested;
+    uint64_t completed;
+  };
+
+  const std::vector<Transmission>& transmitted();
+  void clearTransmitted();
+
+private:
+  struct Entry {
+    uint8_t bytes[13];
+    int length;
+    uint64_t stored;
+  };
+
+  void sync();
+  void resetRegisters();
+  void enterResetMode();
+  void command(uint8_t value);
+  bool accepts(const CANFrame& frame);
+  void push(const CANFrame& frame);
+  CANFrame txFrame();
+  uint8_t status();
+  void raise(uint8_t flag);
+  void updateLine();
+
+private:
+  HostCANBus* _bus;
+  uint32_t _base;
+  Gates _gates;
+  int _intrSource;
+  long _clockFrequency;
+
+  bool _inReset;
+
+  uint8_t _mod;
+  uint8_t _ier;
+  uint8_t _ir;
+  uint8_t _btr0;
+  uint8_t _btr1;
+  uint8_t _ocr;
+  uint8_t _ewlr;
+  uint8_t _rxerr;
+  uint8_t _txerr;
+  uint8_t _cdr;
+  uint8_t _acr[4];
+  uint8_t _amr[4];
+  uint8_t _txBuffer[13];
+
+  bool _overrun;
+  bool _txPending;
+  bool _txComplete;
+  bool _selfReception;
+  uint64_t _txRequested;
+
+  std::deque<Entry> _fifo;
+  int _fifoBytes;
+
+  unsigned long _overruns;
+  unsigned long _gatedAccesses;
+  unsigned long _ignoredWrites;
+  unsigned long _received;
+  uint64_t _lastReleasedStored;
+  std::vector<Transmission> _transmitted;
+};
+
+#endif
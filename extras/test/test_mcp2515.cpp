@@ -0,0 +1,298 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// MCP2515 driver behavior that depends on the controller's state, against
+// the register model on the host.
+
+#include <CAN.h>
+#include <HostCore.h>
+
+#include "models/HostCANBus.h"
+#include "models/MCP2515Model.h"
+
+const long bitRate = 500E3;
+
+HostCANBus* bus;
+MCP2515Model* model;
+HostCANPeer* peer;
+
+int failures = 0;
+
+void check(bool condition, const char* what)
+{
+  if (!condition) {
+    fprintf(stderr, "FAIL: %s\n", what);
+    failures++;
+  }
+}
+
+void run(unsigned long us)
+{
+  uint64_t end = host::now() + (uint64_t)us * 1000;
+
+  while (host::now() < end) {
+    host::advance(10000);
+  }
+}
+
+void begin()
+{
+  host::reset();
+
+  bus = new HostCANBus(bitRate);
+  model = new MCP2515Model(*bus, MCP2515_DEFAULT_CS_PIN, MCP2515_DEFAULT_INT_PIN);
+  peer = new HostCANPeer(*bus);
+
+  peer->begin(bitRate);
+  check(CAN.begin(bitRate), "begin()");
+}
+
+void end()
+{
+  CAN.onReceive(NULL);
+  CAN.end();
+
+  delete peer;
+  delete model;
+  delete bus;
+}
+
+CANFrame frame(long id)
+{
+  CANFrame frame;
+
+  frame.setId(id, false, false);
+  frame.dlc = 1;
+  frame.bus = 0;
+  frame.filter = -1;
+  frame.reserved = 0;
+  memset(frame.data, 0x00, sizeof(frame.data));
+
+  return frame;
+}
+
+// arming a buffer for its TXnRTS pin reconfigures the controller, but it is
+// not a filter update or bit rate change
+void testArmKeepsOfflineTime()
+{
+  begin();
+
+  check(CAN.filter(0x100, 0x7ff), "filter()");
+
+  unsigned long offline = CAN.offlineTime();
+
+  CAN.beginPacket(0x10);
+  CAN.write(1);
+  check(CAN.armPacket(0), "armPacket()");
+
+  check(offline > 0 && CAN.offlineTime() == offline, "armPacket() leaves offlineTime() to the filter update");
+
+  end();
+}
+
+int callbacks;
+int callbacksMasked;
+int pendingFrame;
+
+void onReceive(int)
+{
+  callbacks++;
+
+  // in the interrupt, or in the sketch with interrupts enabled
+  if (!host::inInterrupt() && !host::interruptsEnabled()) {
+    callbacksMasked++;
+  }
+
+  CAN.read();
+}
+
+void receiveWhileDetached(int level)
+{
+  // a packet arrives while armPacket() has INT detached: in FALLING mode
+  // its edge is lost
+  if (pendingFrame >= 0 && level == LOW && !host::pinInterruptAttached(MCP2515_DEFAULT_INT_PIN)) {
+    model->frameReceived(frame(pendingFrame));
+    pendingFrame = -1;
+  }
+}
+
+void testFallingReattach()
+{
+  begin();
+
+  callbacks = 0;
+  callbacksMasked = 0;
+  pendingFrame = -1;
+
+  check(CAN.setInterruptMode(FALLING), "setInterruptMode(FALLING)");
+  CAN.onReceive(onReceive);
+
+  host::onPinWrite(MCP2515_DEFAULT_CS_PIN, receiveWhileDetached);
+
+  CAN.beginPacket(0x10);
+  CAN.write(1);
+
+  pendingFrame = 0x123;
+  check(CAN.armPacket(0), "armPacket()");
+
+  check(pendingFrame < 0, "the packet arrives while INT is detached");
+  check(callbacks == 1, "the packet from while INT was detached is handled");
+  check(callbacksMasked == 0, "the handler doesn't run with interrupts disabled outside an interrupt");
+  check(host::pin(MCP2515_DEFAULT_INT_PIN) == HIGH, "INT is released");
+  check(host::pinInterruptAttached(MCP2515_DEFAULT_INT_PIN), "INT is attached again");
+
+  // and the next one comes through the interrupt
+  peer->beginPacket(0x124);
+  peer->write(1);
+  peer->endPacket();
+
+  run(1000);
+
+  check(callbacks == 2, "the next packet is handled by the interrupt");
+
+  end();
+}
+
+void sendFrom(HostCANPeer* node, long id)
+{
+  node->beginPacket(id);
+  node->write(1);
+  node->endPacket();
+}
+
+// RXBnCTRL: RXM in bits 6 - 5, BUKT in bit 2; CANINTE: MERRE and ERRIE
+#define RXM(n)                     (model->reg(0x60 + n * 0x10) & 0x60)
+#define BUKT                       (model->reg(0x60) & 0x04)
+#define ERROR_INTERRUPTS           (model->reg(0x2b) & 0xa0)
+
+void testObserveRestores()
+{
+  begin();
+
+  check(CAN.filter(0x100, 0x7ff), "filter()");
+  check(RXM(0) == 0x20 && RXM(1) == 0x20 && !BUKT && !ERROR_INTERRUPTS, "standard frames only, no rollover");
+
+  check(CAN.observe(), "observe()");
+  check(RXM(0) == 0x60 && RXM(1) == 0x60 && BUKT && ERROR_INTERRUPTS == 0xa0, "observe() receives any frame");
+
+  check(CAN.wakeup(), "wakeup()");
+  check(model->mode() == 0x00, "normal mode");
+  check(RXM(0) == 0x20 && RXM(1) == 0x20, "leaving listen only mode restores the receive mode");
+  check(!BUKT, "leaving listen only mode restores the rollover");
+  check(!ERROR_INTERRUPTS, "leaving listen only mode restores the error interrupts");
+
+  sendFrom(peer, 0x200);
+  sendFrom(peer, 0x100);
+  run(2000);
+
+  check(CAN.parsePacket() && CAN.packetId() == 0x100, "the filter applies again");
+  check(!CAN.parsePacket(), "only the filtered packet is received");
+
+  end();
+}
+
+void testObserveKeepsNewFilter()
+{
+  begin();
+
+  check(CAN.observe(), "observe()");
+  check(CAN.filterExtended(0x12345), "filterExtended() while observing");
+  check(RXM(0) == 0x40 && RXM(1) == 0x40, "the filter applies while observing");
+
+  check(CAN.loopback(), "loopback()");
+  check(RXM(0) == 0x40 && RXM(1) == 0x40, "a filter set while observing is kept");
+  check(!BUKT && !ERROR_INTERRUPTS, "the rest is restored");
+
+  end();
+}
+
+std::vector<long> receivedIds()
+{
+  std::vector<long> ids;
+
+  while (CAN.parsePacket()) {
+    ids.push_back(CAN.packetId());
+  }
+
+  return ids;
+}
+
+void testFilterWithoutMask()
+{
+  begin();
+
+  check(CAN.setFilter(0, 0x123), "setFilter() on RXB0");
+  check(CAN.setFilter(2, 0x1234567, true), "setFilter() on RXB1");
+
+  sendFrom(peer, 0x124);
+  sendFrom(peer, 0x123);
+  peer->beginExtendedPacket(0x1234566);
+  peer->write(1);
+  peer->endPacket();
+  peer->beginExtendedPacket(0x1234567);
+  peer->write(1);
+  peer->endPacket();
+
+  run(2000);
+
+  std::vector<long> ids = receivedIds();
+
+  check(ids.size() == 2 && ids[0] == 0x123 && ids[1] == 0x1234567, "a filter without a mask compares the whole id");
+
+  end();
+}
+
+void testFilterKeepsMask()
+{
+  begin();
+
+  check(CAN.setMask(0, 0x700), "setMask()");
+  check(CAN.setFilter(0, 0x100), "setFilter()");
+  check(CAN.setFilter(2, 0x7ff), "setFilter() on RXB1");
+
+  sendFrom(peer, 0x1ab);
+  sendFrom(peer, 0x2ab);
+
+  run(2000);
+
+  std::vector<long> ids = receivedIds();
+
+  check(ids.size() == 1 && ids[0] == 0x1ab, "a mask set before the filter is kept");
+
+  end();
+}
+
+void testPacketFrameZeroesData()
+{
+  begin();
+
+  peer->beginPacket(0x321);
+  peer->write((const uint8_t*)"ab", 2);
+  peer->endPacket();
+
+  run(1000);
+
+  CANFrame frame;
+
+  memset(&frame, 0xa5, sizeof(frame));
+
+  check(CAN.parsePacket() == 2, "parsePacket()");
+  check(CAN.packetFrame(frame), "packetFrame()");
+  check(frame.packetId() == 0x321 && frame.dlc == 2 && memcmp(frame.data, "ab\0\0\0\0\0\0", 8) == 0,
+        "packetFrame() zeroes the data after the packet's bytes");
+
+  end();
+}
+
+int main()
+{
+  testArmKeepsOfflineTime();
+  testFallingReattach();
+  testObserveRestores();
+  testObserveKeepsNewFilter();
+  testFilterWithoutMask();
+  testFilterKeepsMask();
+  testPacketFrameZeroesData();
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,235 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// CAN and CAN1 on a part with two TWAI controllers, each on its own bus at
+// its own bit rate, against two register models that only answer through
+// their own clock and reset bits: both have to come up from their own
+// descriptor, receive and transmit at the same time without seeing each
+// other's traffic, and keep running when the other one ends.
+
+#include <CAN.h>
+#include <Esp32Host.h>
+#include <HostCore.h>
+
+#include "soc/gpio_sig_map.h"
+#include "soc/pcr_reg.h"
+
+#include "models/HostCANBus.h"
+#include "models/TWAIModel.h"
+
+const long bitRate0 = 500E3;
+const long bitRate1 = 250E3;
+
+const int rxPin1 = 6;
+const int txPin1 = 7;
+
+HostCANBus* bus0;
+HostCANBus* bus1;
+TWAIModel* model0;
+TWAIModel* model1;
+HostCANPeer* peer0;
+HostCANPeer* peer1;
+
+std::vector<long> received0;
+std::vector<long> received1;
+
+int failures = 0;
+
+void check(bool condition, const char* what)
+{
+  if (!condition) {
+    fprintf(stderr, "FAIL: %s\n", what);
+    failures++;
+  }
+}
+
+void onReceive0(int)
+{
+  received0.push_back(CAN.packetId());
+}
+
+void onReceive1(int)
+{
+  received1.push_back(CAN1.packetId());
+}
+
+void run(unsigned long us)
+{
+  uint64_t end = host::now() + (uint64_t)us * 1000;
+
+  while (host::now() < end) {
+    host::advance(10000);
+  }
+}
+
+void setup()
+{
+  host::reset();
+  host::esp32::reset();
+
+  TWAIModel::Gates gates0 = { PCR_TWAI0_CONF_REG, PCR_TWAI0_CLK_EN, PCR_TWAI0_FUNC_CLK_CONF_REG, PCR_TWAI0_FUNC_CLK_EN,
+                              PCR_TWAI0_CONF_REG, PCR_TWAI0_RST_EN };
+  TWAIModel::Gates gates1 = { PCR_TWAI1_CONF_REG, PCR_TWAI1_CLK_EN, PCR_TWAI1_FUNC_CLK_CONF_REG, PCR_TWAI1_FUNC_CLK_EN,
+                              PCR_TWAI1_CONF_REG, PCR_TWAI1_RST_EN };
+
+  bus0 = new HostCANBus(bitRate0);
+  bus1 = new HostCANBus(bitRate1);
+  model0 = new TWAIModel(*bus0, DR_REG_TWAI0_BASE, gates0, ETS_TWAI0_INTR_SOURCE, 40000000);
+  model1 = new TWAIModel(*bus1, DR_REG_TWAI1_BASE, gates1, ETS_TWAI1_INTR_SOURCE, 40000000);
+  peer0 = new HostCANPeer(*bus0);
+  peer1 = new HostCANPeer(*bus1);
+
+  peer0->begin(bitRate0);
+  peer1->begin(bitRate1);
+}
+
+void testBringUp()
+{
+  CAN1.setPins(rxPin1, txPin1);
+
+  check(CAN.begin(bitRate0), "CAN begins");
+  check(CAN1.begin(bitRate1), "CAN1 begins");
+
+  check(model0->clocked() && model1->clocked(), "both controllers are clocked and out of reset");
+  check(model0->gatedAccesses() == 0 && model1->gatedAccesses() == 0, "no register access while a controller is gated");
+  check(model0->ignoredWrites() == 0 && model1->ignoredWrites() == 0, "no configuration write outside reset mode");
+  check(model0->bitRate() == bitRate0, "CAN runs at its bit rate");
+  check(model1->bitRate() == bitRate1, "CAN1 runs at its bit rate");
+
+  check(host::esp32::inputPin(TWAI0_RX_PAD_IN_IDX) == DEFAULT_CAN_RX_PIN, "TWAI0 RX is routed from the default pin");
+  check(host::esp32::outputSignal(DEFAULT_CAN_TX_PIN) == TWAI0_TX_PAD_OUT_IDX, "TWAI0 TX is routed to the default pin");
+  check(host::esp32::inputPin(TWAI1_RX_PAD_IN_IDX) == rxPin1, "TWAI1 RX is routed from its pin");
+  check(host::esp32::outputSignal(txPin1) == TWAI1_TX_PAD_OUT_IDX, "TWAI1 TX is routed to its pin");
+
+  CAN.onReceive(onReceive0);
+  CAN1.onReceive(onReceive1);
+
+  check(host::esp32::allocatedInterrupts() == 2, "one interrupt per controller");
+  check(host::sourceAttached(ETS_TWAI0_INTR_SOURCE) && host::sourceArg(ETS_TWAI0_INTR_SOURCE) == &CAN,
+        "the TWAI0 interrupt goes to CAN");
+  check(host::sourceAttached(ETS_TWAI1_INTR_SOURCE) && host::sourceArg(ETS_TWAI1_INTR_SOURCE) == &CAN1,
+        "the TWAI1 interrupt goes to CAN1");
+}
+
+void testConcurrentReceive()
+{
+  const int packets = 200;
+
+  received0.clear();
+  received1.clear();
+
+  // the buses run at the same time, the interrupts of both controllers interleave
+  for (int i = 0; i < packets; i++) {
+    peer0->beginPacket(0x100 + (i % 0x100));
+    peer0->write((const uint8_t*)"twai0 rx", 8);
+    peer0->endPacket();
+
+    peer1->beginExtendedPacket(0x10000 + i);
+    peer1->write((const uint8_t*)"rx1", 3);
+    peer1->endPacket();
+  }
+
+  run(200000);
+
+  bool ordered0 = received0.size() == (size_t)packets;
+  bool ordered1 = received1.size() == (size_t)packets;
+
+  for (size_t i = 0; ordered0 && i < received0.size(); i++) {
+    ordered0 = received0[i] == (long)(0x100 + (i % 0x100));
+  }
+
+  for (size_t i = 0; ordered1 && i < received1.size(); i++) {
+    ordered1 = received1[i] == (long)(0x10000 + i);
+  }
+
+  check(ordered0, "CAN receives every packet of its bus, and only those");
+  check(ordered1, "CAN1 receives every packet of its bus, and only those");
+  check(model0->overruns() == 0 && model1->overruns() == 0, "no FIFO overrun");
+}
+
+void testTransmit()
+{
+  peer0->clearLog();
+  peer1->clearLog();
+
+  CAN.beginPacket(0x321);
+  CAN.write((const uint8_t*)"can", 3);
+  check(CAN.endPacket(), "CAN sends");
+
+  CAN1.beginExtendedPacket(0x1234567);
+  CAN1.write((const uint8_t*)"can1", 4);
+  check(CAN1.endPacket(), "CAN1 sends");
+
+  run(1000);
+
+  check(peer0->log().size() == 1 && peer0->log()[0].frame.packetId() == 0x321, "a CAN packet goes on its own bus");
+  check(peer1->log().size() == 1 && peer1->log()[0].frame.packetId() == 0x1234567 &&
+        peer1->log()[0].frame.packetExtended(), "a CAN1 packet goes on its own bus");
+  check(model0->transmitted().size() == 1 && model1->transmitted().size() == 1, "each controller sends its own packet");
+}
+
+void testEndOne()
+{
+  CAN.end();
+
+  check(!model0->clocked(), "CAN ends with its controller gated");
+  check(model1->clocked(), "CAN1 stays clocked");
+  check(!host::sourceAttached(ETS_TWAI0_INTR_SOURCE), "the TWAI0 interrupt is freed");
+  check(host::sourceAttached(ETS_TWAI1_INTR_SOURCE), "the TWAI1 interrupt stays");
+
+  received0.clear();
+  received1.clear();
+
+  peer1->beginPacket(0x55);
+  peer1->write((const uint8_t*)"still", 5);
+  peer1->endPacket();
+
+  run(1000);
+
+  check(received1.size() == 1 && received1[0] == 0x55, "CAN1 keeps receiving");
+  check(received0.empty(), "CAN doesn't receive once ended");
+
+  CAN1.beginPacket(0x56);
+  check(CAN1.endPacket(), "CAN1 keeps sending");
+
+  run(1000);
+
+  check(model1->gatedAccesses() == 0, "CAN1 never touches a gated controller");
+  check(model0->gatedAccesses() == 0, "nothing touches the ended controller");
+}
+
+void testEndOther()
+{
+  check(CAN.begin(bitRate0), "CAN begins again");
+  CAN.onReceive(onReceive0);
+
+  CAN1.end();
+
+  check(host::peekRegister(PCR_TWAI1_CONF_REG) & PCR_TWAI1_RST_EN, "CAN1 ends with its controller held in reset");
+  check(!(host::peekRegister(PCR_TWAI0_CONF_REG) & PCR_TWAI0_RST_EN), "CAN stays out of reset");
+  check(model0->clocked() && !model1->clocked(), "only CAN1's controller is gated");
+
+  received0.clear();
+
+  peer0->beginPacket(0x57);
+  peer0->endPacket();
+
+  run(1000);
+
+  check(received0.size() == 1 && received0[0] == 0x57, "CAN keeps receiving");
+
+  CAN.end();
+}
+
+int main()
+{
+  setup();
+
+  testBringUp();
+  testConcurrentReceive();
+  testTransmit();
+  testEndOne();
+  testEndOther();
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,350 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// Two CANUdpBridge instances on localhost, each with its own bus: packets
+// from a node on one bus go through the first bridge, a real UDP socket on
+// the loopback interface and the second bridge to a node on the other bus,
+// and back. The buses run on the simulated clock, the datagrams don't.
+
+#include <CANUdpBridge.h>
+#include <HostCore.h>
+#include <HostUDP.h>
+
+#include "models/HostCANBus.h"
+
+const long bitRate = 500E3;
+const IPAddress loopback(127, 0, 0, 1);
+
+// a datagram on loopback arrives in microseconds, this only bounds a failure
+const unsigned long datagramTimeout = 1000;
+
+struct Side {
+  HostCANBus bus;
+  HostCANPeer node;
+  HostCANPeer bridgeCan;
+  HostUDP udp;
+  CANUdpBridge bridge;
+
+  Side() : bus(bitRate), node(bus), bridgeCan(bus), bridge(bridgeCan, udp) {}
+};
+
+Side* a;
+Side* b;
+
+int failures = 0;
+
+void check(bool condition, const char* what)
+{
+  if (!condition) {
+    fprintf(stderr, "FAIL: %s\n", what);
+    failures++;
+  }
+}
+
+uint16_t freePort()
+{
+  HostUDP udp;
+
+  udp.begin(0);
+
+  return udp.localPort();
+}
+
+void begin()
+{
+  host::reset();
+
+  a = new Side();
+  b = new Side();
+
+  uint16_t portA = freePort();
+  uint16_t portB = freePort();
+
+  check(a->bridge.begin(loopback, portB, portA), "bridge A begins");
+  check(b->bridge.begin(loopback, portA, portB), "bridge B begins");
+
+  a->node.begin(bitRate);
+  a->bridgeCan.begin(bitRate);
+  b->node.begin(bitRate);
+  b->bridgeCan.begin(bitRate);
+}
+
+void end()
+{
+  a->bridge.end();
+  b->bridge.end();
+
+  delete a;
+  delete b;
+}
+
+void forward(Side* side)
+{
+  // parsePacket() returns 0 for packets without data too
+  while (side->bridgeCan.pending()) {
+    side->bridgeCan.parsePacket();
+    side->bridge.handlePacket();
+  }
+
+  side->bridge.update();
+}
+
+void deliver(Side* from, Side* to)
+{
+  while (to->bridge.datagramsReceived() < from->bridge.datagramsSent() && to->udp.wait(datagramTimeout)) {
+    to->bridge.update();
+  }
+}
+
+// runs both buses and both bridges for the given simulated time
+void run(unsigned long us)
+{
+  uint64_t end = host::now() + (uint64_t)us * 1000;
+
+  while (host::now() < end) {
+    host::advance(10000);
+
+    forward(a);
+    forward(b);
+    deliver(a, b);
+    deliver(b, a);
+  }
+}
+
+bool sameFrame(const CANFrame& sent, const CANFrame& received)
+{
+  return sent.id == received.id && sent.dlc == received.dlc &&
+         (sent.packetRtr() || memcmp(sent.data, received.data, sent.dlc) == 0);
+}
+
+void sendFrames(HostCANPeer& node, std::vector<CANFrame>& sent)
+{
+  const uint8_t data[] = { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88 };
+  CANFrame frame;
+
+  node.beginPacket(0x123);
+  node.write(data, 8);
+  node.endPacket();
+
+  node.beginExtendedPacket(0x1abcdef);
+  node.write(data, 3);
+  node.endPacket();
+
+  node.beginPacket(0x7ff, 4, true);
+  node.endPacket();
+
+  node.beginExtendedPacket(0x1fffffff, 2, true);
+  node.endPacket();
+
+  node.beginPacket(0x000);
+  node.endPacket();
+
+  frame.setId(0x123, false, false);
+  frame.dlc = 8;
+  memcpy(frame.data, data, 8);
+  sent.push_back(frame);
+
+  frame.setId(0x1abcdef, true, false);
+  frame.dlc = 3;
+  sent.push_back(frame);
+
+  frame.setId(0x7ff, false, true);
+  frame.dlc = 4;
+  sent.push_back(frame);
+
+  frame.setId(0x1fffffff, true, true);
+  frame.dlc = 2;
+  sent.push_back(frame);
+
+  frame.setId(0x000, false, false);
+  frame.dlc = 0;
+  sent.push_back(frame);
+}
+
+bool receivedAsSent(HostCANPeer& node, const std::vector<CANFrame>& sent)
+{
+  if (node.log().size() != sent.size()) {
+    return false;
+  }
+
+  for (size_t i = 0; i < sent.size(); i++) {
+    if (!sameFrame(sent[i], node.log()[i].frame)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void testBothDirections()
+{
+  begin();
+
+  std::vector<CANFrame> sentA;
+  std::vector<CANFrame> sentB;
+
+  sendFrames(a->node, sentA);
+  sendFrames(b->node, sentB);
+
+  run(5000);
+
+  check(receivedAsSent(b->node, sentA), "standard, extended and remote packets go from A to B as sent");
+  check(receivedAsSent(a->node, sentB), "standard, extended and remote packets go from B to A as sent");
+  check(a->bridge.packetsSent() == sentA.size() && b->bridge.packetsReceived() == sentA.size(), "A to B packet counters");
+  check(b->bridge.packetsSent() == sentB.size() && a->bridge.packetsReceived() == sentB.size(), "B to A packet counters");
+  check(a->bridge.errors() == 0 && b->bridge.errors() == 0, "no bridge errors");
+
+  // the packets a bridge sends on its bus don't come back to it
+  check(a->bridge.datagramsSent() == 1 && b->bridge.datagramsSent() == 1, "each direction fits in one window");
+
+  end();
+}
+
+void testBatchWindow()
+{
+  begin();
+
+  a->bridge.setBatchWindow(2000);
+
+  for (int i = 0; i < 3; i++) {
+    a->node.beginPacket(0x100 + i);
+    a->node.write(i);
+    a->node.endPacket();
+  }
+
+  // 3 frames take less than 300 us at 500 kbit/s
+  run(1000);
+
+  check(b->node.log().empty(), "packets are held until the batch window ends");
+  check(a->bridge.datagramsSent() == 0, "no datagram before the batch window ends");
+
+  run(1500);
+
+  check(b->node.log().size() == 3, "the batch is sent when the window ends");
+  check(a->bridge.datagramsSent() == 1 && b->bridge.datagramsReceived() == 1, "the batch is one datagram");
+
+  end();
+}
+
+void testBatchSize()
+{
+  const int packets = 20;
+
+  begin();
+
+  // a header and 4 packets of 8 bytes, the 5th doesn't fit
+  a->bridge.setBatchSize(64);
+  a->bridge.setBatchWindow(1000000);
+
+  for (int i = 0; i < packets; i++) {
+    a->node.beginPacket(0x100 + i);
+    a->node.write((const uint8_t*)"batching", 8);
+    a->node.endPacket();
+  }
+
+  run(10000);
+
+  check(a->bridge.datagramsSent() == packets / 4, "a datagram is sent when the next packet may not fit");
+  check(b->node.log().size() == packets, "every batched packet arrives");
+
+  end();
+}
+
+void testCanFdSkipped()
+{
+  begin();
+
+  HostUDP sender;
+
+  sender.begin(0);
+
+  // cannelloni data: a standard packet, a CAN FD packet with its flags byte
+  // and 12 data bytes, and an extended packet
+  const uint8_t datagram[] = {
+    2, 0, 0, 0, 3,
+    0x00, 0x00, 0x01, 0x23, 2, 0xaa, 0xbb,
+    0x00, 0x00, 0x04, 0x56, 0x80 | 12, 0x01, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12,
+    0x81, 0x23, 0x45, 0x67, 1, 0xcc
+  };
+
+  sender.beginPacket(loopback, b->udp.localPort());
+  sender.write(datagram, sizeof(datagram));
+  check(sender.endPacket(), "the raw datagram is sent");
+
+  check(b->udp.wait(datagramTimeout), "the raw datagram arrives");
+  check(!b->bridge.update(), "update() reports the CAN FD packet");
+
+  run(1000);
+
+  check(b->node.log().size() == 2, "the packets around the CAN FD packet are sent");
+  check(b->node.log().size() == 2 && b->node.log()[0].frame.packetId() == 0x123 &&
+        b->node.log()[1].frame.packetId() == 0x1234567 && b->node.log()[1].frame.packetExtended(),
+        "the packets around the CAN FD packet are decoded");
+  check(b->bridge.errors() == 1, "the CAN FD packet counts as an error");
+
+  end();
+}
+
+void testFullLoad()
+{
+  const unsigned long duration = 1000000;
+
+  begin();
+
+  uint32_t queued = 0;
+  uint64_t finish = host::now() + (uint64_t)duration * 1000;
+
+  // back to back 8 byte packets from A, as many as the bus carries, each
+  // with its index
+  while (host::now() < finish) {
+    while (a->node.queued() < 16) {
+      a->node.beginPacket(0x100 + (queued % 0x100));
+      a->node.write((const uint8_t*)&queued, sizeof(queued));
+      a->node.write((const uint8_t*)"fill", 4);
+      a->node.endPacket();
+      queued++;
+    }
+
+    run(100);
+  }
+
+  // let the last window and the B bus drain
+  run(5000);
+
+  unsigned long frames = a->bus.framesCarried() - a->bridge.packetsReceived();
+  unsigned long busMax = bitRate / (HOST_CAN_STANDARD_FRAME_BITS + 64);
+
+  printf("{\"bench\":\"udp_bridge_full_load\",\"bit_rate\":%ld,\"packets\":%lu,\"datagrams\":%lu,\"packets_per_datagram\":%lu}\n",
+         bitRate, a->bridge.packetsSent(), a->bridge.datagramsSent(),
+         a->bridge.datagramsSent() ? a->bridge.packetsSent() / a->bridge.datagramsSent() : 0);
+
+  check(frames >= busMax * 9 / 10, "the A bus is fully loaded");
+  check(a->bridge.packetsSent() == frames, "every packet on the A bus is bridged");
+  check(b->node.log().size() == frames, "every bridged packet arrives on the B bus");
+  check(a->bridge.datagramsSent() * 4 < frames, "a loaded bus takes far fewer datagrams than packets");
+  check(a->bridge.errors() == 0 && b->bridge.errors() == 0, "no bridge errors at full load");
+
+  bool ordered = true;
+
+  for (size_t i = 0; i < b->node.log().size(); i++) {
+    uint32_t index;
+
+    memcpy(&index, b->node.log()[i].frame.data, sizeof(index));
+    ordered &= (index == i);
+  }
+
+  check(ordered, "packets arrive in order");
+
+  end();
+}
+
+int main()
+{
+  testBothDirections();
+  testBatchWindow();
+  testBatchSize();
+  testCanFdSkipped();
+  testFullLoad();
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,45 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef CAN_AES_CMAC_H
+#define CAN_AES_CMAC_H
+
+#include <Arduino.h>
+
+#define CAN_AES_BLOCK_SIZE 16
+
+#if defined(ADAFRUIT_FEATHER_M4_CAN) && defined(AES)
+#define CAN_AES_HAS_HARDWARE 1
+#else
+#define CAN_AES_HAS_HARDWARE 0
+#endif
+
+class CANAesCmac {
+
+public:
+  CANAesCmac();
+  virtual ~CANAesCmac();
+
+  void setKey(const uint8_t* key);
+  int useHardware(bool enable);
+
+  void encrypt(const uint8_t* in, uint8_t* out);
+  void mac(const uint8_t* message, size_t length, uint8_t* tag);
+
+private:
+  void expandKey(const uint8_t* key);
+  void softwareEncrypt(const uint8_t* in, uint8_t* out);
+#if CAN_AES_HAS_HARDWARE
+  void hardwareSetKey(const uint8_t* key);
+  void hardwareEncrypt(const uint8_t* in, uint8_t* out);
+#endif
+
+private:
+  uint32_t _roundKeys[44];
+  uint8_t _k1[CAN_AES_BLOCK_SIZE];
+  uint8_t _k2[CAN_AES_BLOCK_SIZE];
+  uint8_t _key[CAN_AES_BLOCK_SIZE];
+  bool _hardware;
+};
+
+#endif
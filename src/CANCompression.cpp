@@ -0,0 +1,240 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CANCompression.h"
+
+#define FLAG_LITERAL               1
+#define FLAG_REFERENCE             0
+
+#define DISTANCE_BITS              8
+#define LENGTH_BITS                4
+
+// the last length code marks the end of a stream, so a stream can be split
+// across any number of transport messages
+#define LENGTH_END_OF_STREAM       0x0f
+
+CANCompressor::CANCompressor(Print& target) :
+  _target(&target)
+{
+  reset();
+
+  _bytesIn = 0;
+  _bytesOut = 0;
+}
+
+CANCompressor::~CANCompressor()
+{
+}
+
+size_t CANCompressor::write(uint8_t byte)
+{
+  _lookahead[_lookaheadLength++] = byte;
+  _bytesIn++;
+
+  if (_lookaheadLength == CAN_COMPRESSION_MAX_MATCH) {
+    encode();
+  }
+
+  return 1;
+}
+
+size_t CANCompressor::write(const uint8_t *buffer, size_t size)
+{
+  for (size_t i = 0; i < size; i++) {
+    write(buffer[i]);
+  }
+
+  return size;
+}
+
+void CANCompressor::flush()
+{
+  while (_lookaheadLength) {
+    encode();
+  }
+
+  putBits(FLAG_REFERENCE, 1);
+  putBits(0, DISTANCE_BITS);
+  putBits(LENGTH_END_OF_STREAM, LENGTH_BITS);
+
+  if (_bitCount) {
+    putBits(0, 8 - _bitCount);
+  }
+
+  reset();
+
+  _target->flush();
+}
+
+unsigned long CANCompressor::bytesIn()
+{
+  return _bytesIn;
+}
+
+unsigned long CANCompressor::bytesOut()
+{
+  return _bytesOut;
+}
+
+void CANCompressor::reset()
+{
+  _head = 0;
+  _windowFill = 0;
+  _lookaheadLength = 0;
+  _bits = 0;
+  _bitCount = 0;
+}
+
+void CANCompressor::encode()
+{
+  int bestLength = 0;
+  int bestDistance = 0;
+
+  for (int distance = 1; distance <= _windowFill; distance++) {
+    int length = 0;
+
+    while (length < _lookaheadLength && at(distance, length) == _lookahead[length]) {
+      length++;
+    }
+
+    if (length > bestLength) {
+      bestLength = length;
+      bestDistance = distance;
+
+      if (length == _lookaheadLength) {
+        break;
+      }
+    }
+  }
+
+  if (bestLength >= CAN_COMPRESSION_MIN_MATCH) {
+    putBits(FLAG_REFERENCE, 1);
+    putBits(bestDistance - 1, DISTANCE_BITS);
+    putBits(bestLength - CAN_COMPRESSION_MIN_MATCH, LENGTH_BITS);
+  } else {
+    bestLength = 1;
+
+    putBits(FLAG_LITERAL, 1);
+    putBits(_lookahead[0], 8);
+  }
+
+  for (int i = 0; i < bestLength; i++) {
+    _window[_head++] = _lookahead[i];
+  }
+
+  if (_windowFill < CAN_COMPRESSION_WINDOW) {
+    _windowFill += bestLength;
+
+    if (_windowFill > CAN_COMPRESSION_WINDOW) {
+      _windowFill = CAN_COMPRESSION_WINDOW;
+    }
+  }
+
+  _lookaheadLength -= bestLength;
+  memmove(_lookahead, &_lookahead[bestLength], _lookaheadLength);
+}
+
+void CANCompressor::putBits(uint16_t value, uint8_t count)
+{
+  while (count--) {
+    _bits = (_bits << 1) | ((value >> count) & 0x01);
+
+    if (++_bitCount == 8) {
+      _target->write(_bits);
+      _bytesOut++;
+
+      _bits = 0;
+      _bitCount = 0;
+    }
+  }
+}
+
+uint8_t CANCompressor::at(int distance, int index)
+{
+  // a match may run past the window into the bytes being encoded
+  if (index < distance) {
+    return _window[(uint8_t)(_head - distance + index)];
+  }
+
+  return _lookahead[index - distance];
+}
+
+CANDecompressor::CANDecompressor(Print& target) :
+  _target(&target),
+  _streams(0)
+{
+  reset();
+}
+
+CANDecompressor::~CANDecompressor()
+{
+}
+
+size_t CANDecompressor::write(uint8_t byte)
+{
+  _bits = (_bits << 8) | byte;
+  _bitCount += 8;
+
+  while (_bitCount) {
+    if ((_bits >> (_bitCount - 1)) & 0x01) {
+      if (_bitCount < 9) {
+        break;
+      }
+
+      _bitCount -= 9;
+      output(_bits >> _bitCount);
+    } else {
+      if (_bitCount < (1 + DISTANCE_BITS + LENGTH_BITS)) {
+        break;
+      }
+
+      _bitCount -= 1 + DISTANCE_BITS + LENGTH_BITS;
+
+      int distance = ((_bits >> (_bitCount + LENGTH_BITS)) & 0xff) + 1;
+      int length = (_bits >> _bitCount) & 0x0f;
+
+      if (length == LENGTH_END_OF_STREAM) {
+        // the rest of this byte is padding
+        reset();
+        _streams++;
+        break;
+      }
+
+      length += CAN_COMPRESSION_MIN_MATCH;
+
+      while (length--) {
+        output(_window[(uint8_t)(_head - distance)]);
+      }
+    }
+  }
+
+  return 1;
+}
+
+size_t CANDecompressor::write(const uint8_t *buffer, size_t size)
+{
+  for (size_t i = 0; i < size; i++) {
+    write(buffer[i]);
+  }
+
+  return size;
+}
+
+void CANDecompressor::reset()
+{
+  memset(_window, 0x00, sizeof(_window));
+  _head = 0;
+  _bits = 0;
+  _bitCount = 0;
+}
+
+unsigned long CANDecompressor::streams()
+{
+  return _streams;
+}
+
+void CANDecompressor::output(uint8_t byte)
+{
+  _target->write(byte);
+  _window[_head++] = byte;
+}
@@ -0,0 +1,83 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef CAN_COMPRESSION_H
+#define CAN_COMPRESSION_H
+
+#include <Arduino.h>
+
+#include "CANIsoTp.h"
+
+// LZSS in the style of heatshrink: a literal costs 9 bits, a back reference
+// 13 bits (8-bit distance into a 256 byte window, 4-bit length)
+#define CAN_COMPRESSION_WINDOW     256
+#define CAN_COMPRESSION_MIN_MATCH  2
+#define CAN_COMPRESSION_MAX_MATCH  16
+
+class CANCompressor : public Print {
+
+public:
+  CANCompressor(Print& target);
+  virtual ~CANCompressor();
+
+  // from Print
+  virtual size_t write(uint8_t byte);
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  virtual void flush();
+
+  unsigned long bytesIn();
+  unsigned long bytesOut();
+
+private:
+  void reset();
+  void encode();
+  void putBits(uint16_t value, uint8_t count);
+  uint8_t at(int distance, int index);
+
+private:
+  Print* _target;
+
+  uint8_t _window[CAN_COMPRESSION_WINDOW];
+  uint8_t _head;
+  int _windowFill;
+  uint8_t _lookahead[CAN_COMPRESSION_MAX_MATCH];
+  int _lookaheadLength;
+
+  uint8_t _bits;
+  uint8_t _bitCount;
+
+  unsigned long _bytesIn;
+  unsigned long _bytesOut;
+};
+
+class CANDecompressor : public CANIsoTpSink {
+
+public:
+  CANDecompressor(Print& target);
+  virtual ~CANDecompressor();
+
+  // from Print
+  virtual size_t write(uint8_t byte);
+  virtual size_t write(const uint8_t *buffer, size_t size);
+
+  // from CANIsoTpSink
+  virtual void reset();
+
+  unsigned long streams();
+
+private:
+  void output(uint8_t byte);
+
+private:
+  Print* _target;
+
+  uint8_t _window[CAN_COMPRESSION_WINDOW];
+  uint8_t _head;
+
+  uint32_t _bits;
+  uint8_t _bitCount;
+
+  unsigned long _streams;
+};
+
+#endif
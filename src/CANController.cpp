@@ -12,13 +12,17 @@ CANControllerClass::CANControllerClass() :
   _txRtr(false),
   _txDlc(0),
   _txLength(0),
+  _txTimestamp(0),
+  _offlineTime(0),
 
   _rxId(-1),
   _rxExtended(false),
   _rxRtr(false),
   _rxDlc(0),
   _rxLength(0),
-  _rxIndex(0)
+  _rxIndex(0),
+  _rxTimestamp(0),
+  _rxFilter(-1)
 {
   // overide Stream timeout value
   setTimeout(0);
@@ -35,12 +39,16 @@ int CANControllerClass::begin(long /*baudRate*/)
   _txRtr =false;
   _txDlc = 0;
   _txLength = 0;
+  _txTimestamp = 0;
+  _offlineTime = 0;
 
   _rxId = -1;
   _rxRtr = false;
   _rxDlc = 0;
   _rxLength = 0;
   _rxIndex = 0;
+  _rxTimestamp = 0;
+  _rxFilter = -1;
 
   return 1;
 }
@@ -49,6 +57,75 @@ void CANControllerClass::end()
 {
 }
 
+long CANControllerClass::beginAuto(unsigned long timeout)
+{
+  const long BAUD_RATES[] = {
+    (long)1000E3, (long)500E3, (long)250E3, (long)125E3,
+    (long)100E3, (long)50E3, (long)20E3, (long)10E3
+  };
+  const int count = sizeof(BAUD_RATES) / sizeof(BAUD_RATES[0]);
+  unsigned long window = timeout / count;
+
+  bool started = false;
+
+  for (int i = 0; i < count; i++) {
+    if (started) {
+      // stays in listen only mode, skip rates the driver can't do
+      if (!setBitRate(BAUD_RATES[i])) {
+        continue;
+      }
+    } else {
+      // listen only, so a wrong guess neither acknowledges nor destroys
+      // packets of the other nodes
+      if (!begin(BAUD_RATES[i]) || !observe()) {
+        end();
+        continue;
+      }
+      started = true;
+    }
+
+    unsigned long errors = errorFrameCount();
+    unsigned long start = millis();
+    bool detected = false;
+
+    while ((millis() - start) < window) {
+      // packets without data parse as 0, so look at the id instead
+      _rxId = -1;
+      parsePacket();
+      if (_rxId != -1) {
+        detected = (errorFrameCount() == errors);
+        break;
+      }
+      if (errorFrameCount() != errors) {
+        break;
+      }
+      yield();
+    }
+
+    if (detected) {
+      end();
+
+      return begin(BAUD_RATES[i]) ? BAUD_RATES[i] : 0;
+    }
+  }
+
+  if (started) {
+    end();
+  }
+
+  return 0;
+}
+
+int CANControllerClass::setBitRate(long /*baudRate*/)
+{
+  return 0;
+}
+
+unsigned long CANControllerClass::offlineTime()
+{
+  return _offlineTime;
+}
+
 int CANControllerClass::beginPacket(int id, int dlc, bool rtr)
 {
   if (id < 0 || id > 0x7FF) {
@@ -132,6 +209,38 @@ int CANControllerClass::packetDlc()
   return _rxDlc;
 }
 
+unsigned long CANControllerClass::packetTimestamp()
+{
+  return _rxTimestamp;
+}
+
+int CANControllerClass::packetFilter()
+{
+  return _rxFilter;
+}
+
+int CANControllerClass::packetFrame(CANFrame& frame)
+{
+  if (_rxId == -1) {
+    return 0;
+  }
+
+  frame.setId(_rxId, _rxExtended, _rxRtr);
+  frame.dlc = _rxDlc;
+  frame.bus = 0;
+  frame.filter = _rxFilter;
+  frame.reserved = 0;
+  memcpy(frame.data, _rxData, _rxLength);
+  memset(frame.data + _rxLength, 0x00, sizeof(frame.data) - _rxLength);
+
+  return 1;
+}
+
+unsigned long CANControllerClass::txTimestamp()
+{
+  return _txTimestamp;
+}
+
 size_t CANControllerClass::write(uint8_t byte)
 {
   return write(&byte, sizeof(byte));
@@ -214,3 +323,27 @@ int CANControllerClass::wakeup()
 {
   return 0;
 }
+
+unsigned long CANControllerClass::errorFrameCount()
+{
+  return 0;
+}
+
+int CANControllerClass::errorState()
+{
+  return CAN_ERROR_ACTIVE;
+}
+
+void CANControllerClass::loadFrame(const CANFrame& frame, unsigned long timestamp)
+{
+  _rxId = frame.packetId();
+  _rxExtended = frame.packetExtended();
+  _rxRtr = frame.packetRtr();
+  _rxDlc = frame.dlc;
+  _rxLength = frame.packetLength();
+  _rxIndex = 0;
+  _rxTimestamp = timestamp;
+  _rxFilter = frame.filter;
+
+  memcpy(_rxData, frame.data, _rxLength);
+}
@@ -6,12 +6,23 @@
 
 #include <Arduino.h>
 
+#include "CANFrame.h"
+
+#define CAN_ERROR_ACTIVE           0
+#define CAN_ERROR_PASSIVE          1
+#define CAN_BUS_OFF                2
+
 class CANControllerClass : public Stream {
 
 public:
   virtual int begin(long baudRate);
   virtual void end();
 
+  long beginAuto(unsigned long timeout = 2000);
+
+  virtual int setBitRate(long baudRate);
+  unsigned long offlineTime();
+
   int beginPacket(int id, int dlc = -1, bool rtr = false);
   int beginExtendedPacket(long id, int dlc = -1, bool rtr = false);
   virtual int endPacket();
@@ -21,6 +32,11 @@ public:
   bool packetExtended();
   bool packetRtr();
   int packetDlc();
+  unsigned long packetTimestamp();
+  int packetFilter();
+  int packetFrame(CANFrame& frame);
+
+  unsigned long txTimestamp();
 
   // from Print
   virtual size_t write(uint8_t byte);
@@ -44,10 +60,15 @@ public:
   virtual int sleep();
   virtual int wakeup();
 
+  virtual unsigned long errorFrameCount();
+  virtual int errorState();
+
 protected:
   CANControllerClass();
   virtual ~CANControllerClass();
 
+  void loadFrame(const CANFrame& frame, unsigned long timestamp);
+
 protected:
   void (*_onReceive)(int);
 
@@ -58,6 +79,8 @@ protected:
   int _txDlc;
   int _txLength;
   uint8_t _txData[8];
+  unsigned long _txTimestamp;
+  unsigned long _offlineTime;
 
   long _rxId;
   bool _rxExtended;
@@ -66,6 +89,8 @@ protected:
   int _rxLength;
   int _rxIndex;
   uint8_t _rxData[8];
+  unsigned long _rxTimestamp;
+  int _rxFilter;
 };
 
 #endif
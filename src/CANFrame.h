@@ -0,0 +1,46 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef CAN_FRAME_H
+#define CAN_FRAME_H
+
+#include <Arduino.h>
+
+#define CAN_FRAME_EXTENDED         0x80000000UL
+#define CAN_FRAME_RTR              0x40000000UL
+#define CAN_FRAME_ID_MASK          0x1fffffffUL
+
+// 32-bit parts copy a frame with two 64-bit moves, AVR has nothing to gain
+#if defined(__AVR__)
+#define CAN_FRAME_ALIGNED
+#else
+#define CAN_FRAME_ALIGNED          __attribute__((aligned(8)))
+#endif
+
+// a received or queued packet in 16 bytes, independent of the controller it
+// came from: the id word also carries the IDE and RTR bits, the DLC doesn't
+// fit next to a 29-bit id and leads the second word, so does the bus the
+// packet came from and the filter that matched it, or -1. Queues that keep
+// the receive time store it next to the frame.
+struct CAN_FRAME_ALIGNED CANFrame {
+  uint32_t id;
+  uint8_t dlc;
+  uint8_t bus;
+  int8_t filter;
+  uint8_t reserved;
+  uint8_t data[8];
+
+  void setId(long packetId, bool extended, bool rtr)
+  {
+    id = (packetId & CAN_FRAME_ID_MASK) | (extended ? CAN_FRAME_EXTENDED : 0) | (rtr ? CAN_FRAME_RTR : 0);
+  }
+
+  long packetId() const { return id & CAN_FRAME_ID_MASK; }
+  bool packetExtended() const { return (id & CAN_FRAME_EXTENDED) != 0; }
+  bool packetRtr() const { return (id & CAN_FRAME_RTR) != 0; }
+  int packetLength() const { return packetRtr() ? 0 : (dlc > 8 ? 8 : dlc); }
+};
+
+static_assert(sizeof(CANFrame) == 16, "CANFrame must stay 16 bytes");
+
+#endif
@@ -0,0 +1,408 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CANIsoTp.h"
+
+#define TYPE_SINGLE                0x00
+#define TYPE_FIRST                 0x10
+#define TYPE_CONSECUTIVE           0x20
+#define TYPE_FLOW_CONTROL          0x30
+
+#define FC_CONTINUE                0x00
+#define FC_WAIT                    0x01
+#define FC_OVERFLOW                0x02
+
+CANIsoTp::CANIsoTp(CANControllerClass& can, long txId, long rxId) :
+  _can(&can),
+  _txId(txId),
+  _rxId(rxId),
+
+  _txLength(0),
+
+  _txWaiting(false),
+  _fcStatus(FC_CONTINUE),
+  _fcBlockSize(0),
+  _fcSeparationTime(0),
+  _txWaitStart(0),
+
+  _sink(NULL),
+  _resetSink(NULL),
+  _onMessage(NULL),
+  _onError(NULL),
+  _blockSize(0),
+  _separationTime(0),
+
+  _rxActive(false),
+  _rxLength(0),
+  _rxRemaining(0),
+  _rxSequence(0),
+  _rxBlockCount(0),
+  _rxLastFrame(0)
+{
+}
+
+CANIsoTp::~CANIsoTp()
+{
+}
+
+int CANIsoTp::send(const uint8_t* data, size_t length)
+{
+  uint8_t frame[8];
+
+  if (length == 0 || length > CAN_ISOTP_MAX_LENGTH) {
+    return 0;
+  }
+
+  if (length <= 7) {
+    frame[0] = TYPE_SINGLE | length;
+    memcpy(&frame[1], data, length);
+
+    return sendFrame(frame, length + 1);
+  }
+
+  frame[0] = TYPE_FIRST | (length >> 8);
+  frame[1] = length & 0xff;
+  memcpy(&frame[2], data, 6);
+
+  expectFlowControl();
+
+  if (!sendFrame(frame, 8)) {
+    _txWaiting = false;
+
+    return 0;
+  }
+
+  size_t offset = 6;
+  uint8_t sequence = 1;
+
+  while (offset < length) {
+    if (!waitFlowControl()) {
+      return 0;
+    }
+
+    // the next flow control may arrive before this block is done
+    uint8_t blockSize = _fcBlockSize;
+    uint8_t separationTime = _fcSeparationTime;
+
+    for (int n = 0; offset < length && (blockSize == 0 || n < blockSize); n++) {
+      size_t chunk = length - offset;
+
+      if (chunk > 7) {
+        chunk = 7;
+      }
+
+      if (n > 0) {
+        separationDelay(separationTime);
+      }
+
+      frame[0] = TYPE_CONSECUTIVE | (sequence & 0x0f);
+      memcpy(&frame[1], &data[offset], chunk);
+
+      if (blockSize && n == blockSize - 1 && (offset + chunk) < length) {
+        expectFlowControl();
+      }
+
+      if (!sendFrame(frame, chunk + 1)) {
+        _txWaiting = false;
+
+        return 0;
+      }
+
+      offset += chunk;
+      sequence++;
+    }
+  }
+
+  return 1;
+}
+
+size_t CANIsoTp::write(uint8_t byte)
+{
+  return write(&byte, sizeof(byte));
+}
+
+size_t CANIsoTp::write(const uint8_t *buffer, size_t size)
+{
+  size_t written = 0;
+
+  while (written < size) {
+    if (_txLength == sizeof(_txBuffer)) {
+      flush();
+
+      if (_txLength) {
+        break;
+      }
+    }
+
+    size_t chunk = sizeof(_txBuffer) - _txLength;
+
+    if (chunk > (size - written)) {
+      chunk = size - written;
+    }
+
+    memcpy(&_txBuffer[_txLength], &buffer[written], chunk);
+    _txLength += chunk;
+    written += chunk;
+  }
+
+  return written;
+}
+
+void CANIsoTp::flush()
+{
+  if (_txLength && send(_txBuffer, _txLength)) {
+    _txLength = 0;
+  }
+}
+
+int CANIsoTp::handlePacket()
+{
+  if (_can->packetId() != _rxId || _can->packetExtended() != (_rxId > 0x7FF) || _can->packetRtr()) {
+    return 0;
+  }
+
+  uint8_t frame[8];
+  int length = _can->readBytes(frame, sizeof(frame));
+
+  if (length < 1) {
+    return 1;
+  }
+
+  // the sender went quiet in the middle of a message
+  update();
+
+  switch (frame[0] & 0xf0) {
+    case TYPE_SINGLE: {
+      int size = frame[0] & 0x0f;
+
+      if (size == 0 || size > (length - 1)) {
+        break;
+      }
+
+      if (_rxActive) {
+        abortReceive(CAN_ISOTP_ERROR_ABORTED);
+      }
+
+      if (_sink) {
+        _sink->write(&frame[1], size);
+      }
+
+      if (_onMessage) {
+        _onMessage(size);
+      }
+      break;
+    }
+
+    case TYPE_FIRST: {
+      int size = ((frame[0] & 0x0f) << 8) | frame[1];
+
+      if (length < 8 || size < 8) {
+        break;
+      }
+
+      if (_rxActive) {
+        abortReceive(CAN_ISOTP_ERROR_ABORTED);
+      }
+
+      _rxActive = true;
+      _rxLastFrame = millis();
+      _rxLength = size;
+      _rxRemaining = size - 6;
+      _rxSequence = 1;
+      _rxBlockCount = 0;
+
+      if (_sink) {
+        _sink->write(&frame[2], 6);
+      }
+
+      sendFlowControl(FC_CONTINUE);
+      break;
+    }
+
+    case TYPE_CONSECUTIVE: {
+      if (!_rxActive) {
+        break;
+      }
+
+      if ((frame[0] & 0x0f) != (_rxSequence & 0x0f)) {
+        // lost a frame, drop the rest of the message
+        abortReceive(CAN_ISOTP_ERROR_SEQUENCE);
+        break;
+      }
+
+      _rxLastFrame = millis();
+
+      int chunk = length - 1;
+
+      if (chunk > _rxRemaining) {
+        chunk = _rxRemaining;
+      }
+
+      if (_sink) {
+        _sink->write(&frame[1], chunk);
+      }
+
+      _rxRemaining -= chunk;
+      _rxSequence++;
+
+      if (_rxRemaining == 0) {
+        _rxActive = false;
+
+        if (_onMessage) {
+          _onMessage(_rxLength);
+        }
+      } else if (_blockSize && ++_rxBlockCount >= _blockSize) {
+        _rxBlockCount = 0;
+
+        sendFlowControl(FC_CONTINUE);
+      }
+      break;
+    }
+
+    case TYPE_FLOW_CONTROL:
+      if (_txWaiting && length >= 3) {
+        if ((frame[0] & 0x0f) == FC_WAIT) {
+          // receiver asked for more time, restart the timeout
+          _txWaitStart = millis();
+          break;
+        }
+
+        _fcStatus = frame[0] & 0x0f;
+        _fcBlockSize = frame[1];
+        _fcSeparationTime = frame[2];
+
+        CAN_MEMORY_BARRIER();
+        _txWaiting = false;
+      }
+      break;
+  }
+
+  return 1;
+}
+
+int CANIsoTp::update()
+{
+  // N_Cr, the time allowed between consecutive frames
+  if (_rxActive && (millis() - _rxLastFrame) >= CAN_ISOTP_TIMEOUT) {
+    abortReceive(CAN_ISOTP_ERROR_TIMEOUT);
+
+    return 1;
+  }
+
+  return 0;
+}
+
+void CANIsoTp::setSink(Print& sink)
+{
+  _sink = &sink;
+  _resetSink = NULL;
+}
+
+void CANIsoTp::setSink(CANIsoTpSink& sink)
+{
+  _sink = &sink;
+  _resetSink = &sink;
+}
+
+void CANIsoTp::onMessage(void(*callback)(int))
+{
+  _onMessage = callback;
+}
+
+void CANIsoTp::onError(void(*callback)(int))
+{
+  _onError = callback;
+}
+
+void CANIsoTp::setBlockSize(uint8_t blockSize)
+{
+  _blockSize = blockSize;
+}
+
+void CANIsoTp::setSeparationTime(uint8_t separationTime)
+{
+  _separationTime = separationTime;
+}
+
+int CANIsoTp::sendFrame(const uint8_t* data, int length)
+{
+  if (_txId > 0x7FF) {
+    if (!_can->beginExtendedPacket(_txId)) {
+      return 0;
+    }
+  } else {
+    if (!_can->beginPacket(_txId)) {
+      return 0;
+    }
+  }
+
+  _can->write(data, length);
+
+  return _can->endPacket();
+}
+
+int CANIsoTp::sendFlowControl(uint8_t status)
+{
+  uint8_t frame[3] = { (uint8_t)(TYPE_FLOW_CONTROL | status), _blockSize, _separationTime };
+
+  return sendFrame(frame, sizeof(frame));
+}
+
+void CANIsoTp::expectFlowControl()
+{
+  // before the frame asking for it is sent, the reply may be handled in the
+  // receive interrupt before sendFrame() returns
+  _txWaitStart = millis();
+
+  CAN_MEMORY_BARRIER();
+  _txWaiting = true;
+}
+
+int CANIsoTp::waitFlowControl()
+{
+  // the flow control frame comes in through handlePacket() in the receive
+  // callback, reading packets here would drop everyone else's
+  while (_txWaiting) {
+    noInterrupts();
+    unsigned long start = _txWaitStart;
+    interrupts();
+
+    if ((millis() - start) >= CAN_ISOTP_TIMEOUT) {
+      _txWaiting = false;
+
+      return 0;
+    }
+
+    yield();
+  }
+
+  CAN_MEMORY_BARRIER();
+
+  return (_fcStatus == FC_CONTINUE) ? 1 : 0;
+}
+
+void CANIsoTp::abortReceive(int error)
+{
+  // part of the message already went to the sink, let it start over
+  _rxActive = false;
+
+  if (_resetSink) {
+    _resetSink->reset();
+  }
+
+  if (_onError) {
+    _onError(error);
+  }
+}
+
+void CANIsoTp::separationDelay(uint8_t separationTime)
+{
+  if (separationTime <= 0x7f) {
+    delay(separationTime);
+  } else if (separationTime >= 0xf1 && separationTime <= 0xf9) {
+    delayMicroseconds((separationTime - 0xf0) * 100);
+  } else {
+    // reserved values are treated as the maximum
+    delay(0x7f);
+  }
+}
@@ -0,0 +1,90 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef CAN_ISOTP_H
+#define CAN_ISOTP_H
+
+#include "CANController.h"
+#include "CANRingBuffer.h"
+
+#ifndef CAN_ISOTP_BUFFER_SIZE
+#define CAN_ISOTP_BUFFER_SIZE      256
+#endif
+
+#define CAN_ISOTP_MAX_LENGTH       4095
+#define CAN_ISOTP_TIMEOUT          1000
+
+#define CAN_ISOTP_ERROR_SEQUENCE   1
+#define CAN_ISOTP_ERROR_TIMEOUT    2
+#define CAN_ISOTP_ERROR_ABORTED    3
+
+// a sink that keeps state across writes, reset when a message it already got
+// part of is dropped
+class CANIsoTpSink : public Print {
+
+public:
+  virtual void reset() = 0;
+};
+
+class CANIsoTp : public Print {
+
+public:
+  CANIsoTp(CANControllerClass& can, long txId, long rxId);
+  virtual ~CANIsoTp();
+
+  int send(const uint8_t* data, size_t length);
+
+  // from Print
+  virtual size_t write(uint8_t byte);
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  virtual void flush();
+
+  int handlePacket();
+  int update();
+
+  void setSink(Print& sink);
+  void setSink(CANIsoTpSink& sink);
+  void onMessage(void(*callback)(int));
+  void onError(void(*callback)(int));
+
+  void setBlockSize(uint8_t blockSize);
+  void setSeparationTime(uint8_t separationTime);
+
+private:
+  int sendFrame(const uint8_t* data, int length);
+  int sendFlowControl(uint8_t status);
+  void expectFlowControl();
+  int waitFlowControl();
+  void separationDelay(uint8_t separationTime);
+  void abortReceive(int error);
+
+private:
+  CANControllerClass* _can;
+  long _txId;
+  long _rxId;
+
+  uint8_t _txBuffer[CAN_ISOTP_BUFFER_SIZE];
+  size_t _txLength;
+
+  volatile bool _txWaiting;
+  volatile uint8_t _fcStatus;
+  volatile uint8_t _fcBlockSize;
+  volatile uint8_t _fcSeparationTime;
+  volatile unsigned long _txWaitStart;
+
+  Print* _sink;
+  CANIsoTpSink* _resetSink;
+  void (*_onMessage)(int);
+  void (*_onError)(int);
+  uint8_t _blockSize;
+  uint8_t _separationTime;
+
+  bool _rxActive;
+  int _rxLength;
+  int _rxRemaining;
+  uint8_t _rxSequence;
+  uint8_t _rxBlockCount;
+  unsigned long _rxLastFrame;
+};
+
+#endif
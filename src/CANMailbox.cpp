@@ -0,0 +1,129 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CANMailbox.h"
+
+CANMailbox::CANMailbox(CANControllerClass& can) :
+  _can(&can),
+  _count(0)
+{
+}
+
+CANMailbox::~CANMailbox()
+{
+}
+
+int CANMailbox::addId(long id)
+{
+  return add(id, false);
+}
+
+int CANMailbox::addExtendedId(long id)
+{
+  return add(id, true);
+}
+
+void CANMailbox::clearIds()
+{
+  _count = 0;
+}
+
+int CANMailbox::handlePacket()
+{
+  Entry* entry = find(_can->packetId(), _can->packetExtended());
+
+  if (entry == NULL) {
+    return 0;
+  }
+
+  entry->sequence = entry->sequence + 1;
+  CAN_MEMORY_BARRIER();
+
+  entry->length = _can->packetRtr() ? 0 : _can->readBytes(entry->data, sizeof(entry->data));
+  entry->timestamp = _can->packetTimestamp();
+  entry->received = true;
+
+  CAN_MEMORY_BARRIER();
+  entry->sequence = entry->sequence + 1;
+
+  return 1;
+}
+
+int CANMailbox::getLatest(long id, uint8_t* data, unsigned long* age)
+{
+  return read(find(id, false), data, age);
+}
+
+int CANMailbox::getLatestExtended(long id, uint8_t* data, unsigned long* age)
+{
+  return read(find(id, true), data, age);
+}
+
+int CANMailbox::add(long id, bool extended)
+{
+  if (find(id, extended) != NULL) {
+    return 1;
+  }
+
+  if (_count >= CAN_MAILBOX_MAX_IDS) {
+    return 0;
+  }
+
+  Entry* entry = &_entries[_count];
+
+  entry->id = id;
+  entry->extended = extended;
+  entry->sequence = 0;
+  entry->received = false;
+  entry->length = 0;
+  entry->timestamp = 0;
+
+  // the interrupt may look the id up as soon as it is counted
+  CAN_MEMORY_BARRIER();
+  _count++;
+
+  return 1;
+}
+
+CANMailbox::Entry* CANMailbox::find(long id, bool extended)
+{
+  for (int i = 0; i < _count; i++) {
+    if (_entries[i].id == id && _entries[i].extended == extended) {
+      return &_entries[i];
+    }
+  }
+
+  return NULL;
+}
+
+int CANMailbox::read(Entry* entry, uint8_t* data, unsigned long* age)
+{
+  if (entry == NULL || !entry->received) {
+    return -1;
+  }
+
+  can_sequence_t sequence;
+  int length = 0;
+  unsigned long timestamp = 0;
+
+  do {
+    sequence = entry->sequence;
+
+    if (sequence & 1) {
+      // the writer is in the middle of an update on another core
+      continue;
+    }
+
+    CAN_MEMORY_BARRIER();
+    length = entry->length;
+    memcpy(data, entry->data, length);
+    timestamp = entry->timestamp;
+    CAN_MEMORY_BARRIER();
+  } while ((sequence & 1) || entry->sequence != sequence);
+
+  if (age) {
+    *age = micros() - timestamp;
+  }
+
+  return length;
+}
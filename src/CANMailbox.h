@@ -0,0 +1,63 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef CAN_MAILBOX_H
+#define CAN_MAILBOX_H
+
+#include "CANController.h"
+#include "CANRingBuffer.h"
+
+#ifndef CAN_MAILBOX_MAX_IDS
+#define CAN_MAILBOX_MAX_IDS        16
+#endif
+
+// the sequence counter must be read in one access, AVR only reads 8 bits at once
+#if defined(__AVR__)
+typedef uint8_t can_sequence_t;
+#else
+typedef uint32_t can_sequence_t;
+#endif
+
+// keeps the last packet of each configured id, written by the receive
+// interrupt and read from loop() or other tasks without disabling
+// interrupts: the writer makes the sequence counter odd while it updates a
+// slot, readers copy the slot and retry if the counter changed meanwhile
+
+class CANMailbox {
+
+public:
+  CANMailbox(CANControllerClass& can);
+  virtual ~CANMailbox();
+
+  int addId(long id);
+  int addExtendedId(long id);
+  void clearIds();
+
+  int handlePacket();
+
+  int getLatest(long id, uint8_t* data, unsigned long* age = NULL);
+  int getLatestExtended(long id, uint8_t* data, unsigned long* age = NULL);
+
+private:
+  struct Entry {
+    long id;
+    bool extended;
+    volatile can_sequence_t sequence;
+    volatile bool received;
+    uint8_t length;
+    uint8_t data[8];
+    unsigned long timestamp;
+  };
+
+  int add(long id, bool extended);
+  Entry* find(long id, bool extended);
+  int read(Entry* entry, uint8_t* data, unsigned long* age);
+
+private:
+  CANControllerClass* _can;
+
+  Entry _entries[CAN_MAILBOX_MAX_IDS];
+  int _count;
+};
+
+#endif
@@ -0,0 +1,178 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CANMerge.h"
+
+CANMerge::CANMerge() :
+  _buses(0),
+
+  _window(CAN_MERGE_DEFAULT_WINDOW),
+
+  _heapSize(0),
+
+  _emitted(false),
+  _lastTimestamp(0),
+
+  _late(0)
+{
+  memset(_can, 0x00, sizeof(_can));
+  memset(_queued, 0x00, sizeof(_queued));
+  memset((void*)_dropped, 0x00, sizeof(_dropped));
+}
+
+CANMerge::~CANMerge()
+{
+}
+
+int CANMerge::addBus(CANControllerClass& can)
+{
+  if (_buses >= CAN_MERGE_MAX_BUSES) {
+    return -1;
+  }
+
+  _can[_buses] = &can;
+
+  return _buses++;
+}
+
+void CANMerge::setWindow(unsigned long microseconds)
+{
+  _window = microseconds;
+}
+
+int CANMerge::handlePacket(int bus)
+{
+  if (bus < 0 || bus >= _buses) {
+    return 0;
+  }
+
+  CANControllerClass* can = _can[bus];
+  Entry entry;
+
+  if (!can->packetFrame(entry.frame)) {
+    return 0;
+  }
+  entry.frame.bus = bus;
+  entry.timestamp = can->packetTimestamp();
+
+  if (!_queue[bus].push(entry)) {
+    _dropped[bus]++;
+
+    return 0;
+  }
+
+  return 1;
+}
+
+int CANMerge::read(CANFrame& frame, unsigned long* timestamp)
+{
+  fill();
+
+  if (_heapSize == 0) {
+    return -1;
+  }
+
+  int bus = _heap[0];
+
+  // with a packet from every bus at hand the oldest one can't be overtaken,
+  // otherwise wait for the window in case a quiet bus has an older one
+  if (_heapSize < _buses && (long)(micros() - _next[bus].timestamp) < (long)_window) {
+    return -1;
+  }
+
+  frame = _next[bus].frame;
+  unsigned long time = _next[bus].timestamp;
+  _queued[bus] = false;
+
+  _heap[0] = _heap[--_heapSize];
+  siftDown(0);
+
+  if (_emitted && (long)(time - _lastTimestamp) < 0) {
+    _late++;
+  } else {
+    _lastTimestamp = time;
+  }
+
+  if (timestamp) {
+    *timestamp = time;
+  }
+  _emitted = true;
+
+  return bus;
+}
+
+unsigned long CANMerge::dropped()
+{
+  unsigned long total = 0;
+
+  for (int bus = 0; bus < _buses; bus++) {
+    total += _dropped[bus];
+  }
+
+  return total;
+}
+
+unsigned long CANMerge::late()
+{
+  return _late;
+}
+
+void CANMerge::fill()
+{
+  for (int bus = 0; bus < _buses; bus++) {
+    if (!_queued[bus] && _queue[bus].pop(_next[bus])) {
+      _queued[bus] = true;
+
+      _heap[_heapSize] = bus;
+      siftUp(_heapSize++);
+    }
+  }
+}
+
+bool CANMerge::before(uint8_t a, uint8_t b)
+{
+  // micros() wraps, compare the difference
+  return (long)(_next[a].timestamp - _next[b].timestamp) < 0;
+}
+
+void CANMerge::siftUp(int n)
+{
+  while (n > 0) {
+    int parent = (n - 1) / 2;
+
+    if (!before(_heap[n], _heap[parent])) {
+      break;
+    }
+
+    uint8_t bus = _heap[n];
+    _heap[n] = _heap[parent];
+    _heap[parent] = bus;
+    n = parent;
+  }
+}
+
+void CANMerge::siftDown(int n)
+{
+  for (;;) {
+    int smallest = n;
+    int left = 2 * n + 1;
+    int right = left + 1;
+
+    if (left < _heapSize && before(_heap[left], _heap[smallest])) {
+      smallest = left;
+    }
+
+    if (right < _heapSize && before(_heap[right], _heap[smallest])) {
+      smallest = right;
+    }
+
+    if (smallest == n) {
+      break;
+    }
+
+    uint8_t bus = _heap[n];
+    _heap[n] = _heap[smallest];
+    _heap[smallest] = bus;
+    n = smallest;
+  }
+}
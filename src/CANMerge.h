@@ -0,0 +1,73 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef CAN_MERGE_H
+#define CAN_MERGE_H
+
+#include "CANController.h"
+#include "CANFrame.h"
+#include "CANRingBuffer.h"
+
+#ifndef CAN_MERGE_MAX_BUSES
+#define CAN_MERGE_MAX_BUSES        4
+#endif
+
+// packets queued per bus, must be a power of two
+#ifndef CAN_MERGE_QUEUE_SIZE
+#define CAN_MERGE_QUEUE_SIZE       16
+#endif
+
+#define CAN_MERGE_DEFAULT_WINDOW   2000
+
+// merges the packets of several controllers into one stream ordered by
+// packetTimestamp(), each controller's packets must arrive in order
+
+class CANMerge {
+
+public:
+  CANMerge();
+  virtual ~CANMerge();
+
+  int addBus(CANControllerClass& can);
+
+  void setWindow(unsigned long microseconds);
+
+  int handlePacket(int bus);
+  int read(CANFrame& frame, unsigned long* timestamp = NULL);
+
+  unsigned long dropped();
+  unsigned long late();
+
+private:
+  struct Entry {
+    CANFrame frame;
+    unsigned long timestamp;
+  };
+
+  void fill();
+  bool before(uint8_t a, uint8_t b);
+  void siftUp(int n);
+  void siftDown(int n);
+
+private:
+  CANControllerClass* _can[CAN_MERGE_MAX_BUSES];
+  int _buses;
+
+  unsigned long _window;
+
+  CANRingBuffer<Entry, CAN_MERGE_QUEUE_SIZE> _queue[CAN_MERGE_MAX_BUSES];
+
+  // the oldest packet of each bus, a min-heap of bus numbers orders them
+  Entry _next[CAN_MERGE_MAX_BUSES];
+  bool _queued[CAN_MERGE_MAX_BUSES];
+  uint8_t _heap[CAN_MERGE_MAX_BUSES];
+  int _heapSize;
+
+  bool _emitted;
+  unsigned long _lastTimestamp;
+
+  volatile unsigned long _dropped[CAN_MERGE_MAX_BUSES];
+  unsigned long _late;
+};
+
+#endif
@@ -0,0 +1,241 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CANRedundancy.h"
+
+// key 0 marks a free table entry, so every key has this bit set
+#define KEY_USED                   0x80000000UL
+#define KEY_EXTENDED               0x40000000UL
+
+CANRedundancy::CANRedundancy(CANControllerClass& bus0, CANControllerClass& bus1) :
+  _duplicates(0),
+  _failovers(0),
+  _failures(0)
+{
+  _can[0] = &bus0;
+  _can[1] = &bus1;
+  _state[0] = CAN_ERROR_ACTIVE;
+  _state[1] = CAN_ERROR_ACTIVE;
+
+  memset(_txTable, 0x00, sizeof(_txTable));
+  memset(_rxTable, 0x00, sizeof(_rxTable));
+}
+
+CANRedundancy::~CANRedundancy()
+{
+}
+
+int CANRedundancy::send(long id, const uint8_t* data, int length)
+{
+  return sendFrame(id, false, data, length);
+}
+
+int CANRedundancy::sendExtended(long id, const uint8_t* data, int length)
+{
+  return sendFrame(id, true, data, length);
+}
+
+int CANRedundancy::addId(long id)
+{
+  if (id < 0 || id > 0x7ff) {
+    return 0;
+  }
+
+  return lookup(_rxTable, id, false, true) ? 1 : 0;
+}
+
+int CANRedundancy::addExtendedId(long id)
+{
+  if (id < 0 || id > 0x1fffffff) {
+    return 0;
+  }
+
+  return lookup(_rxTable, id, true, true) ? 1 : 0;
+}
+
+void CANRedundancy::clearIds()
+{
+  memset(_rxTable, 0x00, sizeof(_rxTable));
+}
+
+int CANRedundancy::handlePacket(int bus, CANFrame& frame)
+{
+  if (bus < 0 || bus > 1) {
+    return 0;
+  }
+
+  CANControllerClass* can = _can[bus];
+
+  // only added ids carry a sequence number
+  Entry* entry = lookup(_rxTable, can->packetId(), can->packetExtended(), false);
+
+  if (entry == NULL) {
+    return CAN_REDUNDANCY_NOT_REDUNDANT;
+  }
+
+  if (can->packetRtr()) {
+    return 0;
+  }
+
+  if (!can->packetFrame(frame) || frame.packetLength() == 0) {
+    return 0;
+  }
+  frame.bus = bus;
+
+  // strip the sequence number
+  frame.dlc = frame.packetLength() - 1;
+  uint8_t sequence = frame.data[frame.dlc];
+
+  unsigned long now = millis();
+  bool recent = entry->valid && (now - entry->time) < CAN_REDUNDANCY_COPY_TIMEOUT;
+  int8_t ahead = (int8_t)(sequence - entry->sequence);
+
+  // 0 after a high sequence number is a restarted sender, after a low one
+  // it may still be the late copy of the first packet
+  if (recent && ahead <= 0 && ahead > -CAN_REDUNDANCY_WINDOW) {
+    _duplicates++;
+
+    return 0;
+  }
+
+  entry->sequence = sequence;
+  entry->valid = true;
+  entry->time = now;
+
+  return 1;
+}
+
+int CANRedundancy::update()
+{
+  int healthy = 0;
+
+  for (int bus = 0; bus < 2; bus++) {
+    int state = _can[bus]->errorState();
+
+    if (state == CAN_BUS_OFF && _state[bus] != CAN_BUS_OFF) {
+      _failovers++;
+    }
+
+    _state[bus] = state;
+
+    if (state != CAN_BUS_OFF) {
+      healthy++;
+    }
+  }
+
+  return healthy;
+}
+
+int CANRedundancy::busState(int bus)
+{
+  if (bus < 0 || bus > 1) {
+    return CAN_BUS_OFF;
+  }
+
+  return _state[bus];
+}
+
+unsigned long CANRedundancy::duplicates()
+{
+  return _duplicates;
+}
+
+unsigned long CANRedundancy::failovers()
+{
+  return _failovers;
+}
+
+unsigned long CANRedundancy::failures()
+{
+  return _failures;
+}
+
+int CANRedundancy::sendFrame(long id, bool extended, const uint8_t* data, int length)
+{
+  if (length < 0 || length > 7) {
+    return 0;
+  }
+
+  Entry* entry = lookup(_txTable, id, extended, true);
+
+  if (entry == NULL) {
+    return 0;
+  }
+
+  // 0 marks the first packet after a start, later ones skip it
+  uint8_t sequence = 0;
+
+  if (entry->valid) {
+    sequence = entry->sequence + 1;
+
+    if (sequence == 0) {
+      sequence = 1;
+    }
+  }
+
+  entry->sequence = sequence;
+  entry->valid = true;
+
+  bool allDown = (_state[0] == CAN_BUS_OFF) && (_state[1] == CAN_BUS_OFF);
+  int sent = 0;
+
+  for (int bus = 0; bus < 2; bus++) {
+    // skip a failed bus while the other one works
+    if (_state[bus] == CAN_BUS_OFF && !allDown) {
+      continue;
+    }
+
+    CANControllerClass* can = _can[bus];
+
+    if (extended) {
+      can->beginExtendedPacket(id);
+    } else {
+      can->beginPacket(id);
+    }
+    can->write(data, length);
+    can->write(sequence);
+
+    if (can->endPacket()) {
+      sent++;
+    } else {
+      _failures++;
+
+      // check at once whether the bus failed instead of waiting for update()
+      int state = can->errorState();
+      if (state == CAN_BUS_OFF && _state[bus] != CAN_BUS_OFF) {
+        _failovers++;
+      }
+      _state[bus] = state;
+    }
+  }
+
+  return sent ? 1 : 0;
+}
+
+CANRedundancy::Entry* CANRedundancy::lookup(Entry* table, long id, bool extended, bool insert)
+{
+  uint32_t key = (id & 0x1fffffff) | KEY_USED | (extended ? KEY_EXTENDED : 0);
+
+  // multiplicative hash, then linear probing over a bounded table
+  uint32_t index = (key * 2654435761UL) >> 16;
+
+  for (int i = 0; i < CAN_REDUNDANCY_TABLE_SIZE; i++) {
+    Entry* entry = &table[(index + i) & (CAN_REDUNDANCY_TABLE_SIZE - 1)];
+
+    if (entry->key == key) {
+      return entry;
+    }
+
+    if (entry->key == 0) {
+      if (!insert) {
+        return NULL;
+      }
+
+      entry->key = key;
+
+      return entry;
+    }
+  }
+
+  return NULL;
+}
@@ -0,0 +1,76 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef CAN_REDUNDANCY_H
+#define CAN_REDUNDANCY_H
+
+#include "CANController.h"
+#include "CANFrame.h"
+
+// ids tracked for sequence numbers, sent and received ones each have a
+// table of this size, must be a power of two
+#ifndef CAN_REDUNDANCY_TABLE_SIZE
+#define CAN_REDUNDANCY_TABLE_SIZE  32
+#endif
+
+// a sequence number this far behind the last one is taken as a restarted
+// sender instead of a late copy
+#define CAN_REDUNDANCY_WINDOW      16
+
+// the second copy of a packet arrives within this many milliseconds, a
+// sequence number seen before after a longer time is a restarted sender
+#define CAN_REDUNDANCY_COPY_TIMEOUT 100
+
+#define CAN_REDUNDANCY_NOT_REDUNDANT -1
+
+// the same packets are sent on two buses, the last data byte carries a
+// sequence number per id, so the receiver keeps only the first copy. The
+// first packet of an id after the sender starts carries sequence number 0,
+// the following ones count from 1 to 255, so a restart is seen at once
+
+class CANRedundancy {
+
+public:
+  CANRedundancy(CANControllerClass& bus0, CANControllerClass& bus1);
+  virtual ~CANRedundancy();
+
+  int send(long id, const uint8_t* data, int length);
+  int sendExtended(long id, const uint8_t* data, int length);
+
+  int addId(long id);
+  int addExtendedId(long id);
+  void clearIds();
+
+  int handlePacket(int bus, CANFrame& frame);
+  int update();
+
+  int busState(int bus);
+
+  unsigned long duplicates();
+  unsigned long failovers();
+  unsigned long failures();
+
+private:
+  struct Entry {
+    uint32_t key;
+    uint8_t sequence;
+    bool valid;
+    unsigned long time;
+  };
+
+  int sendFrame(long id, bool extended, const uint8_t* data, int length);
+  Entry* lookup(Entry* table, long id, bool extended, bool insert);
+
+private:
+  CANControllerClass* _can[2];
+  int _state[2];
+
+  Entry _txTable[CAN_REDUNDANCY_TABLE_SIZE];
+  Entry _rxTable[CAN_REDUNDANCY_TABLE_SIZE];
+
+  unsigned long _duplicates;
+  unsigned long _failovers;
+  unsigned long _failures;
+};
+
+#endif
@@ -0,0 +1,224 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CANRequestTracker.h"
+
+// replies may be handled in the receive interrupt, slots are claimed and
+// released with it masked, restoring the previous state so this also works
+// from the callback
+#if defined(__AVR__)
+#define CAN_REQUEST_LOCK()         uint8_t sreg = SREG; cli()
+#define CAN_REQUEST_UNLOCK()       SREG = sreg
+#elif defined(ARDUINO_ARCH_ESP32)
+static portMUX_TYPE requestMux = portMUX_INITIALIZER_UNLOCKED;
+#define CAN_REQUEST_LOCK()         portENTER_CRITICAL_SAFE(&requestMux)
+#define CAN_REQUEST_UNLOCK()       portEXIT_CRITICAL_SAFE(&requestMux)
+#elif defined(__arm__)
+#define CAN_REQUEST_LOCK()         uint32_t primask = __get_PRIMASK(); __disable_irq()
+#define CAN_REQUEST_UNLOCK()       __set_PRIMASK(primask)
+#else
+#define CAN_REQUEST_LOCK()         noInterrupts()
+#define CAN_REQUEST_UNLOCK()       interrupts()
+#endif
+
+CANRequestTracker::CANRequestTracker(CANControllerClass& can) :
+  _can(&can),
+  _order(0),
+  _timeouts(0)
+{
+  memset(_entries, 0x00, sizeof(_entries));
+}
+
+CANRequestTracker::~CANRequestTracker()
+{
+}
+
+int CANRequestTracker::send(const CANFrame& request, long responseId, long responseMask,
+                            void(*callback)(int, const CANFrame*), unsigned long timeout)
+{
+  int slot;
+
+  CAN_REQUEST_LOCK();
+
+  for (slot = 0; slot < CAN_REQUEST_MAX_PENDING; slot++) {
+    if (!_entries[slot].active) {
+      break;
+    }
+  }
+
+  if (slot == CAN_REQUEST_MAX_PENDING) {
+    CAN_REQUEST_UNLOCK();
+
+    return -1;
+  }
+
+  // wait for the reply before sending, it may arrive in the receive
+  // interrupt before endPacket() returns
+  Entry* entry = &_entries[slot];
+
+  entry->extended = request.packetExtended();
+  entry->responseId = responseId & responseMask;
+  entry->responseMask = responseMask;
+  entry->callback = callback;
+  entry->start = millis();
+  entry->timeout = timeout;
+  entry->order = _order++;
+
+  CAN_MEMORY_BARRIER();
+  entry->active = true;
+
+  // the slot may be completed and taken again before send returns
+  int n = handle(slot);
+
+  CAN_REQUEST_UNLOCK();
+
+  int result;
+
+  if (request.packetExtended()) {
+    result = _can->beginExtendedPacket(request.packetId(), request.dlc, request.packetRtr());
+  } else {
+    result = _can->beginPacket(request.packetId(), request.dlc, request.packetRtr());
+  }
+
+  if (result) {
+    _can->write(request.data, request.packetLength());
+
+    result = _can->endPacket();
+  }
+
+  if (!result) {
+    release(slot, n);
+
+    return -1;
+  }
+
+  return n;
+}
+
+void CANRequestTracker::cancel(int request)
+{
+  int slot = request & ((1 << CAN_REQUEST_SLOT_BITS) - 1);
+
+  if (request < 0 || slot >= CAN_REQUEST_MAX_PENDING) {
+    return;
+  }
+
+  release(slot, request);
+}
+
+int CANRequestTracker::handlePacket()
+{
+  long id = _can->packetId();
+  bool extended = _can->packetExtended();
+  int match = -1;
+
+  for (int i = 0; i < CAN_REQUEST_MAX_PENDING; i++) {
+    Entry* entry = &_entries[i];
+
+    if (!entry->active || entry->extended != extended || (id & entry->responseMask) != entry->responseId) {
+      continue;
+    }
+
+    // replies to the same id come back in the order the requests were sent
+    if (match == -1 || (long)(entry->order - _entries[match].order) < 0) {
+      match = i;
+    }
+  }
+
+  if (match == -1) {
+    return 0;
+  }
+
+  CANFrame response;
+
+  _can->packetFrame(response);
+
+  return complete(match, &response, false) ? 1 : 0;
+}
+
+int CANRequestTracker::update()
+{
+  int count = 0;
+
+  for (int i = 0; i < CAN_REQUEST_MAX_PENDING; i++) {
+    Entry* entry = &_entries[i];
+
+    if (!entry->active) {
+      continue;
+    }
+
+    if (complete(i, NULL, true)) {
+      _timeouts++;
+    } else if (entry->active) {
+      count++;
+    }
+  }
+
+  return count;
+}
+
+int CANRequestTracker::pending()
+{
+  int count = 0;
+
+  for (int i = 0; i < CAN_REQUEST_MAX_PENDING; i++) {
+    if (_entries[i].active) {
+      count++;
+    }
+  }
+
+  return count;
+}
+
+unsigned long CANRequestTracker::timeouts()
+{
+  return _timeouts;
+}
+
+int CANRequestTracker::handle(int slot)
+{
+  // keep the handle positive where int is 16 bits
+  unsigned long generation = _entries[slot].order & (0x7fff >> CAN_REQUEST_SLOT_BITS);
+
+  return (int)((generation << CAN_REQUEST_SLOT_BITS) | slot);
+}
+
+bool CANRequestTracker::complete(int slot, const CANFrame* response, bool expired)
+{
+  Entry* entry = &_entries[slot];
+
+  // a reply and a timeout may both try, only the first one calls back
+  CAN_REQUEST_LOCK();
+
+  if (!entry->active || (expired && (millis() - entry->start) < entry->timeout)) {
+    CAN_REQUEST_UNLOCK();
+
+    return false;
+  }
+
+  void (*callback)(int, const CANFrame*) = entry->callback;
+  int request = handle(slot);
+
+  // free the slot first, so the callback can send the next request
+  entry->active = false;
+
+  CAN_REQUEST_UNLOCK();
+
+  if (callback) {
+    callback(request, response);
+  }
+
+  return true;
+}
+
+void CANRequestTracker::release(int slot, int request)
+{
+  CAN_REQUEST_LOCK();
+
+  // a stale handle must not free the slot of a newer request
+  if (_entries[slot].active && handle(slot) == request) {
+    _entries[slot].active = false;
+  }
+
+  CAN_REQUEST_UNLOCK();
+}
@@ -0,0 +1,67 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef CAN_REQUEST_TRACKER_H
+#define CAN_REQUEST_TRACKER_H
+
+#include "CANController.h"
+#include "CANFrame.h"
+#include "CANRingBuffer.h"
+
+#ifndef CAN_REQUEST_MAX_PENDING
+#define CAN_REQUEST_MAX_PENDING    8
+#endif
+
+#define CAN_REQUEST_TIMEOUT        1000
+
+// a request handle is the slot in the low bits and a generation count
+// above, so a stale handle can't cancel a newer request in the same slot
+#define CAN_REQUEST_SLOT_BITS      4
+
+// sends requests and matches the replies to them, so several requests can
+// be outstanding at once: each one waits for a reply id under a mask, the
+// oldest matching request takes a reply, requests without a reply time out
+
+class CANRequestTracker {
+
+  static_assert(CAN_REQUEST_MAX_PENDING <= (1 << CAN_REQUEST_SLOT_BITS), "too many pending requests for the handle");
+
+public:
+  CANRequestTracker(CANControllerClass& can);
+  virtual ~CANRequestTracker();
+
+  int send(const CANFrame& request, long responseId, long responseMask,
+           void(*callback)(int, const CANFrame*), unsigned long timeout = CAN_REQUEST_TIMEOUT);
+  void cancel(int request);
+
+  int handlePacket();
+  int update();
+
+  int pending();
+  unsigned long timeouts();
+
+private:
+  struct Entry {
+    volatile bool active;
+    bool extended;
+    long responseId;
+    long responseMask;
+    void (*callback)(int, const CANFrame*);
+    unsigned long start;
+    unsigned long timeout;
+    unsigned long order;
+  };
+
+  int handle(int slot);
+  bool complete(int slot, const CANFrame* response, bool expired);
+  void release(int slot, int request);
+
+private:
+  CANControllerClass* _can;
+
+  Entry _entries[CAN_REQUEST_MAX_PENDING];
+  unsigned long _order;
+  unsigned long _timeouts;
+};
+
+#endif
@@ -0,0 +1,89 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef CAN_RING_BUFFER_H
+#define CAN_RING_BUFFER_H
+
+#include <Arduino.h>
+
+// orders the element copy against the index update, on multi-core parts the
+// other core must not see the new index before the element
+#if defined(__AVR__)
+#define CAN_MEMORY_BARRIER()       __asm__ __volatile__ ("" ::: "memory")
+#else
+#define CAN_MEMORY_BARRIER()       __sync_synchronize()
+#endif
+
+// AVR can't read a 16-bit index atomically
+#if defined(__AVR__)
+typedef uint8_t can_ring_index_t;
+#else
+typedef uint32_t can_ring_index_t;
+#endif
+
+// lock-free ring for one producer (an interrupt or a task) and one consumer,
+// N must be a power of two
+template <typename T, unsigned int N>
+class CANRingBuffer {
+
+  static_assert((N & (N - 1)) == 0, "size must be a power of two");
+  static_assert(N <= ((can_ring_index_t)-1 / 2 + 1), "size too large for the index type");
+
+public:
+  CANRingBuffer() :
+    _head(0),
+    _tail(0)
+  {
+  }
+
+  bool push(const T& item)
+  {
+    can_ring_index_t head = _head;
+
+    if ((can_ring_index_t)(head - _tail) >= N) {
+      return false;
+    }
+
+    _items[head & (N - 1)] = item;
+
+    CAN_MEMORY_BARRIER();
+    _head = head + 1;
+
+    return true;
+  }
+
+  bool pop(T& item)
+  {
+    can_ring_index_t tail = _tail;
+
+    if (tail == _head) {
+      return false;
+    }
+
+    CAN_MEMORY_BARRIER();
+    item = _items[tail & (N - 1)];
+
+    CAN_MEMORY_BARRIER();
+    _tail = tail + 1;
+
+    return true;
+  }
+
+  unsigned int available()
+  {
+    return (can_ring_index_t)(_head - _tail);
+  }
+
+  // only safe while the producer is stopped
+  void clear()
+  {
+    _tail = _head;
+  }
+
+private:
+  T _items[N];
+  volatile can_ring_index_t _head;
+  volatile can_ring_index_t _tail;
+};
+
+#endif
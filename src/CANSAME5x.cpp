@@ -6,6 +6,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include "CANRingBuffer.h"
 #include "CANSAME5x.h"
 #include "wiring_private.h"
 
@@ -31,8 +32,14 @@ namespace {
 #define GCLK_CAN1 GCLK_PCHCTRL_GEN_GCLK1_Val
 #define GCLK_CAN0 GCLK_PCHCTRL_GEN_GCLK1_Val
 #define ADAFRUIT_ZEROCAN_TX_BUFFER_SIZE (1)
-#define ADAFRUIT_ZEROCAN_RX_FILTER_SIZE (1)
+#define ADAFRUIT_ZEROCAN_TX_EVENT_SIZE (2)
+// the filter list is searched in order and the first match wins, so the
+// latest-value filters come first and the filter set by filter() or
+// filterExtended() is the last element
+#define ADAFRUIT_ZEROCAN_RX_FILTER_SIZE (ADAFRUIT_ZEROCAN_LATEST_SIZE + 1)
+#define ADAFRUIT_ZEROCAN_PRIMARY_FILTER (ADAFRUIT_ZEROCAN_LATEST_SIZE)
 #define ADAFRUIT_ZEROCAN_RX_FIFO_SIZE (8)
+#define ADAFRUIT_ZEROCAN_RX_WATERMARK (4)
 #define ADAFRUIT_ZEROCAN_MAX_MESSAGE_LENGTH (8)
 
 namespace {
@@ -96,9 +103,17 @@ struct _canSAME5x_rx_fifo {
   __attribute((aligned(4))) uint8_t data[ADAFRUIT_ZEROCAN_MAX_MESSAGE_LENGTH];
 } can_rx_fifo_t;
 
+struct _canSAME5x_rx_buf {
+  CAN_RXBE_0_Type rxb0;
+  CAN_RXBE_1_Type rxb1;
+  __attribute((aligned(4))) uint8_t data[ADAFRUIT_ZEROCAN_MAX_MESSAGE_LENGTH];
+};
+
 struct _canSAME5x_state {
   _canSAME5x_tx_buf tx_buffer[ADAFRUIT_ZEROCAN_TX_BUFFER_SIZE];
+  CanMramTxefe tx_event[ADAFRUIT_ZEROCAN_TX_EVENT_SIZE];
   _canSAME5x_rx_fifo rx_fifo[ADAFRUIT_ZEROCAN_RX_FIFO_SIZE];
+  _canSAME5x_rx_buf rx_buffer[ADAFRUIT_ZEROCAN_LATEST_SIZE];
   CanMramSidfe standard_rx_filter[ADAFRUIT_ZEROCAN_RX_FILTER_SIZE];
   CanMramXifde extended_rx_filter[ADAFRUIT_ZEROCAN_RX_FILTER_SIZE];
 };
@@ -146,6 +161,18 @@ EPioType find_pin(const can_function *table, size_t n, int arduino_pin,
   return (EPioType)-1;
 }
 
+// RX FIFO elements and dedicated RX buffer elements share one layout
+template <class R0, class R1>
+void read_element(const R0 &r0, const R1 &r1, const uint8_t *data,
+                  CANFrame &frame) {
+  frame.setId(r0.bit.XTD ? r0.bit.ID : r0.bit.ID >> 18, r0.bit.XTD, r0.bit.RTR);
+  frame.dlc = r1.bit.DLC;
+  frame.bus = 0;
+  frame.filter = r1.bit.ANMF ? -1 : r1.bit.FIDX;
+  frame.reserved = 0;
+  memcpy(frame.data, data, frame.packetLength());
+}
+
 } // namespace
 
 CANSAME5x::CANSAME5x(uint8_t TX_PIN, uint8_t RX_PIN)
@@ -218,6 +245,12 @@ int CANSAME5x::begin(long baudrate) {
   _state = reinterpret_cast<void *>(&can_state[_idx]);
 
   memset(state, 0, sizeof(*state));
+  _fifoOverwrite = false;
+  _errorFrames = 0;
+  _latestCount = 0;
+  _ring = 0;
+  _ringTimestamps = 0;
+  _latestFresh = 0;
 
   pinPeripheral(_tx, tx_function);
   pinPeripheral(_rx, rx_function);
@@ -249,6 +282,15 @@ int CANSAME5x::begin(long baudrate) {
     hw->TXBC.reg = bc.reg;
   }
 
+  // Set up the TX event FIFO, it holds the start of frame timestamp of
+  // each packet sent
+  {
+    CAN_TXEFC_Type efc = {};
+    efc.bit.EFSA = (uint32_t)state->tx_event;
+    efc.bit.EFS = ADAFRUIT_ZEROCAN_TX_EVENT_SIZE;
+    hw->TXEFC.reg = efc.reg;
+  }
+
   // All RX data has an 8 byte payload (max)
   {
     CAN_RXESC_Type esc = {};
@@ -266,6 +308,13 @@ int CANSAME5x::begin(long baudrate) {
     hw->RXF0C.reg = rxf.reg;
   }
 
+  // Set up dedicated RX buffers, one per latest-value filter
+  {
+    CAN_RXBC_Type bc = {};
+    bc.bit.RBSA = (uint32_t)state->rx_buffer;
+    hw->RXBC.reg = bc.reg;
+  }
+
   // Reject all packets not explicitly requested
   {
     CAN_GFC_Type gfc = {};
@@ -275,16 +324,19 @@ int CANSAME5x::begin(long baudrate) {
     hw->GFC.reg = gfc.reg;
   }
 
-  // Initially, receive all standard and extended packets to FIFO 0
-  state->standard_rx_filter[0].SIDFE_0.bit.SFID1 = 0; // ID
-  state->standard_rx_filter[0].SIDFE_0.bit.SFID2 = 0; // mask
-  state->standard_rx_filter[0].SIDFE_0.bit.SFEC = CAN_SIDFE_0_SFEC_STF0M_Val;
-  state->standard_rx_filter[0].SIDFE_0.bit.SFT = CAN_SIDFE_0_SFT_CLASSIC_Val;
+  // Initially, receive all standard and extended packets to FIFO 0. The
+  // latest-value filters before it stay disabled until filterLatest()
+  auto &standard_filter = state->standard_rx_filter[ADAFRUIT_ZEROCAN_PRIMARY_FILTER];
+  standard_filter.SIDFE_0.bit.SFID1 = 0; // ID
+  standard_filter.SIDFE_0.bit.SFID2 = 0; // mask
+  standard_filter.SIDFE_0.bit.SFEC = CAN_SIDFE_0_SFEC_STF0M_Val;
+  standard_filter.SIDFE_0.bit.SFT = CAN_SIDFE_0_SFT_CLASSIC_Val;
 
-  state->extended_rx_filter[0].XIDFE_0.bit.EFID1 = 0; // ID
-  state->extended_rx_filter[0].XIDFE_0.bit.EFEC = CAN_XIDFE_0_EFEC_STF0M_Val;
-  state->extended_rx_filter[0].XIDFE_1.bit.EFID2 = 0; // mask
-  state->extended_rx_filter[0].XIDFE_1.bit.EFT = CAN_XIDFE_1_EFT_CLASSIC_Val;
+  auto &extended_filter = state->extended_rx_filter[ADAFRUIT_ZEROCAN_PRIMARY_FILTER];
+  extended_filter.XIDFE_0.bit.EFID1 = 0; // ID
+  extended_filter.XIDFE_0.bit.EFEC = CAN_XIDFE_0_EFEC_STF0M_Val;
+  extended_filter.XIDFE_1.bit.EFID2 = 0; // mask
+  extended_filter.XIDFE_1.bit.EFT = CAN_XIDFE_1_EFT_CLASSIC_Val;
 
   // Set up standard RX filters
   {
@@ -304,16 +356,28 @@ int CANSAME5x::begin(long baudrate) {
 
   // Enable receive IRQ (masked until enabled in NVIC)
   hw->IE.bit.RF0NE = true;
+  hw->IE.bit.DRXE = true;
   if (_idx == 0) {
     hw->ILE.bit.EINT0 = true;
   } else {
     hw->ILE.bit.EINT1 = true;
   }
   hw->ILS.bit.RF0NL = _idx;
+  hw->ILS.bit.DRXL = _idx;
 
   // Set nominal baud rate
   hw->NBTP.reg = nbtp.reg;
 
+  // Timestamp counter increments once per nominal bit time, so received
+  // messages can be back-dated to the moment they were stored
+  {
+    CAN_TSCC_Type tscc = {};
+    tscc.bit.TSS = CAN_TSCC_TSS_INC_Val;
+    tscc.bit.TCP = 0;
+    hw->TSCC.reg = tscc.reg;
+  }
+  _bitTimeNs = DIV_ROUND(1000000000UL, baudrate);
+
   // hardware is ready for use
   hw->CCCR.bit.CCE = 0;
   hw->CCCR.bit.INIT = 0;
@@ -327,6 +391,8 @@ int CANSAME5x::begin(long baudrate) {
 
 void CANSAME5x::end() {
   instances[_idx] = 0;
+  _latestCount = 0;
+  _ring = 0;
   pinMode(_tx, INPUT);
   pinMode(_rx, INPUT);
   // reset and disable clock
@@ -359,7 +425,7 @@ int CANSAME5x::endPacket() {
     buf.txb0.bit.ID = _txId << 18;
   }
   buf.txb1.bit.MM = 0;
-  buf.txb1.bit.EFC = 0;
+  buf.txb1.bit.EFC = 1;
   buf.txb1.bit.FDF = 0;
   buf.txb1.bit.BRS = 0;
   buf.txb1.bit.DLC = _txLength;
@@ -374,6 +440,7 @@ int CANSAME5x::endPacket() {
   // wait 8ms (hard coded for now) for TX to occur
   for (int i = 0; i < 8000; i++) {
     if (hw->TXBTO.reg & 1) {
+      readTxEvent();
       return true;
     }
     yield();
@@ -388,11 +455,19 @@ int CANSAME5x::_parsePacket() {
   }
 
   int index = hw->RXF0S.bit.F0GI;
+  if (_fifoOverwrite && hw->RXF0S.bit.F0F) {
+    // in overwrite mode the next packet replaces the element at the get
+    // index, so read the one after it; acknowledging it drops both
+    index = (index + 1) % ADAFRUIT_ZEROCAN_RX_FIFO_SIZE;
+  }
   auto &hw_message = state->rx_fifo[index];
 
+  _rxTimestamp = rxTimestamp(hw_message.rxf1.bit.RXTS);
+
   _rxExtended = hw_message.rxf0.bit.XTD;
   _rxRtr = hw_message.rxf0.bit.RTR;
   _rxDlc = hw_message.rxf1.bit.DLC;
+  _rxFilter = hw_message.rxf1.bit.ANMF ? -1 : hw_message.rxf1.bit.FIDX;
 
   if (_rxExtended) {
     _rxId = hw_message.rxf0.bit.ID;
@@ -415,6 +490,10 @@ int CANSAME5x::_parsePacket() {
 }
 
 int CANSAME5x::parsePacket() {
+  if (_ring) {
+    return parseRing();
+  }
+
   cpu_irq_enter_critical();
   bus_autorecover();
   int result = _parsePacket();
@@ -422,11 +501,273 @@ int CANSAME5x::parsePacket() {
   return result;
 }
 
+int CANSAME5x::parseRing() {
+  uint32_t tail = _ringTail;
+  if (tail == _ringHead) {
+    return 0;
+  }
+  CAN_MEMORY_BARRIER();
+
+  uint32_t index = tail & (_ringSize - 1);
+  loadFrame(_ring[index], _ringTimestamps ? _ringTimestamps[index] : 0);
+
+  CAN_MEMORY_BARRIER();
+  _ringTail = tail + 1;
+
+  return _rxDlc;
+}
+
+int CANSAME5x::drainFifo() {
+  bus_autorecover();
+
+  int count = hw->RXF0S.bit.F0FL;
+  int index = hw->RXF0S.bit.F0GI;
+  if (!count) {
+    return 0;
+  }
+  if (_fifoOverwrite && hw->RXF0S.bit.F0F) {
+    // see _parsePacket(), the element at the get index may be overwritten
+    index = (index + 1) % ADAFRUIT_ZEROCAN_RX_FIFO_SIZE;
+    count--;
+  }
+
+  uint32_t head = _ringHead;
+  int last = index;
+  for (int i = 0; i < count; i++) {
+    last = (index + i) % ADAFRUIT_ZEROCAN_RX_FIFO_SIZE;
+    if (head - _ringTail == _ringSize) {
+      _ringDropped++;
+      continue;
+    }
+
+    auto &hw_message = state->rx_fifo[last];
+    uint32_t slot = head & (_ringSize - 1);
+    read_element(hw_message.rxf0, hw_message.rxf1, hw_message.data,
+                 _ring[slot]);
+    if (_ringTimestamps) {
+      _ringTimestamps[slot] = rxTimestamp(hw_message.rxf1.bit.RXTS);
+    }
+    head++;
+  }
+
+  CAN_MEMORY_BARRIER();
+  _ringHead = head;
+
+  // acknowledging the last element releases the whole batch, writing TOCV
+  // presets the timeout counter for the next one
+  hw->RXF0A.bit.F0AI = last;
+  hw->TOCV.reg = 0;
+
+  return count;
+}
+
+int CANSAME5x::setRxRing(CANFrame *ring, int size, unsigned long latency,
+                         unsigned long *timestamps) {
+  if (!_hw || (ring && (size < 2 || (size & (size - 1))))) {
+    return 0;
+  }
+
+  auto irq = _idx == 0 ? CAN0_IRQn : CAN1_IRQn;
+  NVIC_DisableIRQ(irq);
+
+  _ring = ring;
+  _ringTimestamps = timestamps;
+  _ringSize = size;
+  _ringLatency = latency;
+  _ringHead = 0;
+  _ringTail = 0;
+  _ringDropped = 0;
+
+  hw->CCCR.bit.INIT = 1;
+  while (!hw->CCCR.bit.INIT) {
+  }
+  hw->CCCR.bit.CCE = 1;
+
+  // interrupt once the FIFO reaches the watermark, or when the oldest packet
+  // in it has waited for the timeout, instead of once per packet
+  hw->RXF0C.bit.F0WM = ring ? ADAFRUIT_ZEROCAN_RX_WATERMARK : 0;
+  {
+    CAN_TOCC_Type tocc = {};
+    tocc.bit.ETOC = ring != 0;
+    tocc.bit.TOS = CAN_TOCC_TOS_RXF0_Val;
+    tocc.bit.TOP = ringTimeout();
+    hw->TOCC.reg = tocc.reg;
+  }
+
+  hw->CCCR.bit.CCE = 0;
+  hw->CCCR.bit.INIT = 0;
+  while (hw->CCCR.bit.INIT) {
+  }
+
+  hw->IE.bit.RF0NE = !ring;
+  hw->IE.bit.RF0WE = ring != 0;
+  hw->IE.bit.TOOE = ring != 0;
+  hw->ILS.bit.RF0WL = _idx;
+  hw->ILS.bit.TOOL = _idx;
+
+  if (ring || _onReceive || _latestCount) {
+    NVIC_EnableIRQ(irq);
+  }
+
+  return 1;
+}
+
+unsigned long CANSAME5x::rxRingDropped() { return _ringDropped; }
+
+uint16_t CANSAME5x::ringTimeout() {
+  // the timeout counter shares the timestamp prescaler, one count per bit
+  uint64_t timeout = ((uint64_t)_ringLatency * 1000) / _bitTimeNs;
+  timeout = max(timeout, (uint64_t)1);
+  timeout = min(timeout, (uint64_t)0xffff);
+  return timeout;
+}
+
+void CANSAME5x::readTxEvent() {
+  _txTimestamp = micros();
+
+  // the event of the packet just sent is the newest one, TXTS uses the
+  // same start of frame reference as RXTS
+  while (hw->TXEFS.bit.EFFL) {
+    int index = hw->TXEFS.bit.EFGI;
+    _txTimestamp =
+        rxTimestamp(state->tx_event[index].TXEFE_1.bit.TXTS);
+    hw->TXEFA.bit.EFAI = index;
+  }
+}
+
+unsigned long CANSAME5x::rxTimestamp(uint16_t rxts) {
+  // RXTS and TXTS hold the timestamp counter value captured at start of
+  // frame
+  unsigned long now = micros();
+  uint16_t age = hw->TSCV.bit.TSC - rxts;
+  return now - (unsigned long)(((uint64_t)age * _bitTimeNs) / 1000);
+}
+
+void CANSAME5x::captureLatest() {
+  uint32_t ndat = hw->NDAT1.reg;
+
+  for (int slot = 0; slot < _latestCount; slot++) {
+    uint32_t bit = 1UL << slot;
+    if (!(ndat & bit)) {
+      continue;
+    }
+
+    auto &hw_message = state->rx_buffer[slot];
+    CANFrame &frame = _latest[slot];
+
+    read_element(hw_message.rxb0, hw_message.rxb1, hw_message.data, frame);
+    frame.filter = slot;
+    _latestTimestamp[slot] = rxTimestamp(hw_message.rxb1.bit.RXTS);
+
+    // a dedicated buffer is locked while its new data flag is set, so
+    // release it right away and keep the copy instead, that way the slot
+    // always holds the last packet received rather than the first unread
+    hw->NDAT1.reg = bit;
+    _latestFresh |= bit;
+  }
+}
+
+int CANSAME5x::filterLatest(long id, bool extended) {
+  if (!_hw) {
+    return -1;
+  }
+
+  cpu_irq_enter_critical();
+
+  int slot;
+  for (slot = 0; slot < _latestCount; slot++) {
+    if (_latest[slot].packetId() == id &&
+        _latest[slot].packetExtended() == extended) {
+      cpu_irq_leave_critical();
+      return slot;
+    }
+  }
+
+  if (_latestCount == ADAFRUIT_ZEROCAN_LATEST_SIZE) {
+    cpu_irq_leave_critical();
+    return -1;
+  }
+
+  memset(&_latest[slot], 0, sizeof(_latest[slot]));
+  _latest[slot].setId(id, extended, false);
+  _latestTimestamp[slot] = 0;
+  _latestCount++;
+
+  // store matching packets in dedicated RX buffer number `slot`
+  if (extended) {
+    CAN_XIDFE_1_Type xidfe1 = {};
+    xidfe1.bit.EFID2 = slot;
+    state->extended_rx_filter[slot].XIDFE_1.reg = xidfe1.reg;
+
+    CAN_XIDFE_0_Type xidfe0 = {};
+    xidfe0.bit.EFID1 = id;
+    xidfe0.bit.EFEC = CAN_XIDFE_0_EFEC_STRXBUF_Val;
+    state->extended_rx_filter[slot].XIDFE_0.reg = xidfe0.reg;
+  } else {
+    CAN_SIDFE_0_Type sidfe0 = {};
+    sidfe0.bit.SFID1 = id;
+    sidfe0.bit.SFID2 = slot;
+    sidfe0.bit.SFEC = CAN_SIDFE_0_SFEC_STRXBUF_Val;
+    state->standard_rx_filter[slot].SIDFE_0.reg = sidfe0.reg;
+  }
+
+  cpu_irq_leave_critical();
+
+  // the interrupt keeps the slots up to date, with or without onReceive
+  NVIC_EnableIRQ(_idx == 0 ? CAN0_IRQn : CAN1_IRQn);
+
+  return slot;
+}
+
+int CANSAME5x::parseLatest(int slot) {
+  if (slot < 0 || slot >= _latestCount) {
+    return 0;
+  }
+
+  uint32_t bit = 1UL << slot;
+
+  cpu_irq_enter_critical();
+  bus_autorecover();
+  captureLatest();
+
+  if (!(_latestFresh & bit)) {
+    cpu_irq_leave_critical();
+    return 0;
+  }
+  _latestFresh &= ~bit;
+
+  loadFrame(_latest[slot], _latestTimestamp[slot]);
+
+  cpu_irq_leave_critical();
+
+  return _rxDlc;
+}
+
+int CANSAME5x::setFifoOverwrite(bool overwrite) {
+  if (!_hw) {
+    return 0;
+  }
+
+  hw->CCCR.bit.INIT = 1;
+  while (!hw->CCCR.bit.INIT) {
+  }
+  hw->CCCR.bit.CCE = 1;
+
+  hw->RXF0C.bit.F0OM = overwrite;
+  _fifoOverwrite = overwrite;
+
+  hw->CCCR.bit.CCE = 0;
+  hw->CCCR.bit.INIT = 0;
+  while (hw->CCCR.bit.INIT) {
+  }
+  return 1;
+}
+
 void CANSAME5x::onReceive(void (*callback)(int)) {
   CANControllerClass::onReceive(callback);
 
   auto irq = _idx == 0 ? CAN0_IRQn : CAN1_IRQn;
-  if (callback) {
+  if (callback || _latestCount || _ring) {
     NVIC_EnableIRQ(irq);
   } else {
     NVIC_DisableIRQ(irq);
@@ -436,7 +777,18 @@ void CANSAME5x::onReceive(void (*callback)(int)) {
 void CANSAME5x::handleInterrupt() {
   uint32_t ir = hw->IR.reg;
 
-  if (ir & CAN_IR_RF0N) {
+  if (ir & CAN_IR_DRX) {
+    captureLatest();
+  }
+
+  if (_ring) {
+    if (ir & (CAN_IR_RF0W | CAN_IR_TOO)) {
+      int count = drainFifo();
+      if (count && _onReceive) {
+        _onReceive(count);
+      }
+    }
+  } else if ((ir & CAN_IR_RF0N) && _onReceive) {
     while (int i = parsePacket())
       _onReceive(i);
   }
@@ -445,33 +797,69 @@ void CANSAME5x::handleInterrupt() {
 }
 
 int CANSAME5x::filter(int id, int mask) {
+  auto &standard_filter = state->standard_rx_filter[ADAFRUIT_ZEROCAN_PRIMARY_FILTER];
+  auto &extended_filter = state->extended_rx_filter[ADAFRUIT_ZEROCAN_PRIMARY_FILTER];
+
   // accept matching standard messages
-  state->standard_rx_filter[0].SIDFE_0.bit.SFID1 = id;
-  state->standard_rx_filter[0].SIDFE_0.bit.SFID2 = mask;
-  state->standard_rx_filter[0].SIDFE_0.bit.SFEC = CAN_SIDFE_0_SFEC_STF0M_Val;
-  state->standard_rx_filter[0].SIDFE_0.bit.SFT = CAN_SIDFE_0_SFT_CLASSIC_Val;
+  standard_filter.SIDFE_0.bit.SFID1 = id;
+  standard_filter.SIDFE_0.bit.SFID2 = mask;
+  standard_filter.SIDFE_0.bit.SFEC = CAN_SIDFE_0_SFEC_STF0M_Val;
+  standard_filter.SIDFE_0.bit.SFT = CAN_SIDFE_0_SFT_CLASSIC_Val;
 
   // reject all extended messages
-  state->extended_rx_filter[0].XIDFE_0.bit.EFID1 = 0; // ID
-  state->extended_rx_filter[0].XIDFE_0.bit.EFEC = CAN_XIDFE_0_EFEC_REJECT_Val;
-  state->extended_rx_filter[0].XIDFE_1.bit.EFID2 = 0; // mask
-  state->extended_rx_filter[0].XIDFE_1.bit.EFT = CAN_XIDFE_1_EFT_CLASSIC_Val;
+  extended_filter.XIDFE_0.bit.EFID1 = 0; // ID
+  extended_filter.XIDFE_0.bit.EFEC = CAN_XIDFE_0_EFEC_REJECT_Val;
+  extended_filter.XIDFE_1.bit.EFID2 = 0; // mask
+  extended_filter.XIDFE_1.bit.EFT = CAN_XIDFE_1_EFT_CLASSIC_Val;
 
   return 1;
 }
 
 int CANSAME5x::filterExtended(long id, long mask) {
+  auto &standard_filter = state->standard_rx_filter[ADAFRUIT_ZEROCAN_PRIMARY_FILTER];
+  auto &extended_filter = state->extended_rx_filter[ADAFRUIT_ZEROCAN_PRIMARY_FILTER];
+
   // reject all standard messages
-  state->standard_rx_filter[0].SIDFE_0.bit.SFID1 = 0;
-  state->standard_rx_filter[0].SIDFE_0.bit.SFID2 = 0;
-  state->standard_rx_filter[0].SIDFE_0.bit.SFEC = CAN_SIDFE_0_SFEC_REJECT_Val;
-  state->standard_rx_filter[0].SIDFE_0.bit.SFT = CAN_SIDFE_0_SFT_CLASSIC_Val;
+  standard_filter.SIDFE_0.bit.SFID1 = 0;
+  standard_filter.SIDFE_0.bit.SFID2 = 0;
+  standard_filter.SIDFE_0.bit.SFEC = CAN_SIDFE_0_SFEC_REJECT_Val;
+  standard_filter.SIDFE_0.bit.SFT = CAN_SIDFE_0_SFT_CLASSIC_Val;
 
   // accept matching extended messages
-  state->extended_rx_filter[0].XIDFE_0.bit.EFID1 = id;
-  state->extended_rx_filter[0].XIDFE_0.bit.EFEC = CAN_XIDFE_0_EFEC_STF0M_Val;
-  state->extended_rx_filter[0].XIDFE_1.bit.EFID2 = mask;
-  state->extended_rx_filter[0].XIDFE_1.bit.EFT = CAN_XIDFE_1_EFT_CLASSIC_Val;
+  extended_filter.XIDFE_0.bit.EFID1 = id;
+  extended_filter.XIDFE_0.bit.EFEC = CAN_XIDFE_0_EFEC_STF0M_Val;
+  extended_filter.XIDFE_1.bit.EFID2 = mask;
+  extended_filter.XIDFE_1.bit.EFT = CAN_XIDFE_1_EFT_CLASSIC_Val;
+
+  return 1;
+}
+
+int CANSAME5x::setBitRate(long baudrate) {
+  CAN_NBTP_Type nbtp;
+  if (!_hw || !compute_nbtp(baudrate, nbtp)) {
+    return 0;
+  }
+
+  unsigned long start = micros();
+
+  // filters in message RAM and the MON and TEST mode bits survive INIT
+  hw->CCCR.bit.INIT = 1;
+  while (!hw->CCCR.bit.INIT) {
+  }
+  hw->CCCR.bit.CCE = 1;
+
+  hw->NBTP.reg = nbtp.reg;
+  _bitTimeNs = DIV_ROUND(1000000000UL, baudrate);
+  if (_ring) {
+    hw->TOCC.bit.TOP = ringTimeout();
+  }
+
+  hw->CCCR.bit.CCE = 0;
+  hw->CCCR.bit.INIT = 0;
+  while (hw->CCCR.bit.INIT) {
+  }
+
+  _offlineTime = micros() - start;
 
   return 1;
 }
@@ -531,6 +919,26 @@ int CANSAME5x::wakeup() {
   return 1;
 }
 
+unsigned long CANSAME5x::errorFrameCount() {
+  // CEL counts the protocol errors that raised an error counter and is
+  // cleared by reading it
+  _errorFrames += hw->ECR.bit.CEL;
+  return _errorFrames;
+}
+
+int CANSAME5x::errorState() {
+  CAN_PSR_Type psr;
+  psr.reg = hw->PSR.reg;
+
+  if (psr.bit.BO) {
+    return CAN_BUS_OFF;
+  }
+  if (psr.bit.EP) {
+    return CAN_ERROR_PASSIVE;
+  }
+  return CAN_ERROR_ACTIVE;
+}
+
 void CANSAME5x::bus_autorecover() {
   if (hw->PSR.bit.BO) {
     DEBUG_PRINTLN("bus autorecovery activated");
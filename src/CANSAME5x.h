@@ -3,6 +3,9 @@
 // license information.
 
 #include "CANController.h"
+#include "CANFrame.h"
+
+#define ADAFRUIT_ZEROCAN_LATEST_SIZE (8)
 
 class CANSAME5x : public CANControllerClass {
 public:
@@ -24,11 +27,24 @@ public:
   using CANControllerClass::filterExtended;
   int filterExtended(long id, long mask) final;
 
+  int filterLatest(long id, bool extended = false);
+  int parseLatest(int slot);
+  int setFifoOverwrite(bool overwrite);
+
+  int setRxRing(CANFrame *ring, int size, unsigned long latency = 1000,
+                unsigned long *timestamps = NULL);
+  unsigned long rxRingDropped();
+
   int observe() final;
   int loopback() final;
   int sleep() final;
   int wakeup() final;
 
+  int setBitRate(long baudRate) final;
+
+  unsigned long errorFrameCount() final;
+  int errorState() final;
+
   void dumpRegisters(Stream &out);
 
 private:
@@ -37,10 +53,30 @@ private:
   void handleInterrupt();
 
   int _parsePacket();
+  void captureLatest();
+  int parseRing();
+  int drainFifo();
+  uint16_t ringTimeout();
+  void readTxEvent();
+  unsigned long rxTimestamp(uint16_t rxts);
 
 private:
   int8_t _tx, _rx;
   int8_t _idx;
+  uint32_t _bitTimeNs;
+  unsigned long _errorFrames;
+  bool _fifoOverwrite;
+  int8_t _latestCount;
+  volatile uint32_t _latestFresh;
+  CANFrame _latest[ADAFRUIT_ZEROCAN_LATEST_SIZE];
+  unsigned long _latestTimestamp[ADAFRUIT_ZEROCAN_LATEST_SIZE];
+  CANFrame *_ring;
+  unsigned long *_ringTimestamps;
+  uint32_t _ringSize;
+  unsigned long _ringLatency;
+  volatile uint32_t _ringHead;
+  volatile uint32_t _ringTail;
+  volatile unsigned long _ringDropped;
   // intr_handle_t _intrHandle;
   void *_state;
   void *_hw;
@@ -0,0 +1,286 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CANSecOC.h"
+
+#define FLAG_EXTENDED              0x80000000UL
+
+CANSecOC::CANSecOC(CANControllerClass& can) :
+  _can(&can),
+  _count(0),
+  _window(CAN_SECOC_DEFAULT_WINDOW),
+  _failures(0)
+{
+}
+
+CANSecOC::~CANSecOC()
+{
+}
+
+void CANSecOC::setKey(const uint8_t* key)
+{
+  _cmac.setKey(key);
+}
+
+int CANSecOC::useHardwareAes(bool enable)
+{
+  return _cmac.useHardware(enable);
+}
+
+int CANSecOC::addId(long id, int dataLength, int freshnessLength, int macLength)
+{
+  if (id < 0 || id > 0x7FF) {
+    return 0;
+  }
+
+  return add(id, false, dataLength, freshnessLength, macLength);
+}
+
+int CANSecOC::addExtendedId(long id, int dataLength, int freshnessLength, int macLength)
+{
+  if (id < 0 || id > 0x1FFFFFFF) {
+    return 0;
+  }
+
+  return add(id, true, dataLength, freshnessLength, macLength);
+}
+
+void CANSecOC::clearIds()
+{
+  _count = 0;
+}
+
+int CANSecOC::send(long id, const uint8_t* data, int length)
+{
+  return sendEntry(find(id, false), data, length);
+}
+
+int CANSecOC::sendExtended(long id, const uint8_t* data, int length)
+{
+  return sendEntry(find(id, true), data, length);
+}
+
+int CANSecOC::handlePacket(uint8_t* data)
+{
+  Entry* entry = find(_can->packetId(), _can->packetExtended());
+
+  if (entry == NULL || _can->packetRtr()) {
+    return CAN_SECOC_NOT_PROTECTED;
+  }
+
+  uint8_t payload[8];
+  int length = _can->readBytes(payload, sizeof(payload));
+
+  if (length != (entry->dataLength + entry->freshnessLength + entry->macLength)) {
+    _failures++;
+    return CAN_SECOC_FAILED;
+  }
+
+  // rebuild the full freshness value from its truncated low bits, it must
+  // always move forward to reject replayed frames
+  uint32_t truncated = 0;
+  for (int i = 0; i < entry->freshnessLength; i++) {
+    truncated = (truncated << 8) | payload[entry->dataLength + i];
+  }
+
+  uint32_t freshness = truncated;
+  int attempts = 1;
+  uint32_t step = 0;
+
+  if (entry->freshnessLength < 4) {
+    uint32_t mask = (1UL << (8 * entry->freshnessLength)) - 1;
+
+    freshness = (entry->rxFreshness & ~mask) | truncated;
+    step = mask + 1;
+    if (freshness <= entry->rxFreshness) {
+      freshness += step;
+    }
+
+    // after lost packets or a restart of this node the counter may be
+    // further ahead, try the following wraps as well
+    attempts += _window;
+  }
+
+  bool valid = false;
+
+  for (int i = 0; i < attempts && freshness > entry->rxFreshness; i++, freshness += step) {
+    if (checkMac(entry, payload, freshness)) {
+      valid = true;
+      break;
+    }
+  }
+
+  if (!valid) {
+    _failures++;
+    return CAN_SECOC_FAILED;
+  }
+
+  entry->rxFreshness = freshness;
+  memcpy(data, payload, entry->dataLength);
+
+  return entry->dataLength;
+}
+
+void CANSecOC::setWindow(int wraps)
+{
+  _window = (wraps < 0) ? 0 : wraps;
+}
+
+int CANSecOC::setFreshness(long id, uint32_t txFreshness, uint32_t rxFreshness)
+{
+  return setEntryFreshness(find(id, false), txFreshness, rxFreshness);
+}
+
+int CANSecOC::setFreshnessExtended(long id, uint32_t txFreshness, uint32_t rxFreshness)
+{
+  return setEntryFreshness(find(id, true), txFreshness, rxFreshness);
+}
+
+int CANSecOC::getFreshness(long id, uint32_t* txFreshness, uint32_t* rxFreshness)
+{
+  return getEntryFreshness(find(id, false), txFreshness, rxFreshness);
+}
+
+int CANSecOC::getFreshnessExtended(long id, uint32_t* txFreshness, uint32_t* rxFreshness)
+{
+  return getEntryFreshness(find(id, true), txFreshness, rxFreshness);
+}
+
+unsigned long CANSecOC::failures()
+{
+  return _failures;
+}
+
+int CANSecOC::add(long id, bool extended, int dataLength, int freshnessLength, int macLength)
+{
+  if (dataLength < 0 || freshnessLength < 1 || freshnessLength > 4 || macLength < 1 ||
+      (dataLength + freshnessLength + macLength) > 8) {
+    return 0;
+  }
+
+  Entry* entry = find(id, extended);
+
+  if (entry == NULL) {
+    if (_count >= CAN_SECOC_MAX_IDS) {
+      return 0;
+    }
+
+    entry = &_entries[_count++];
+  }
+
+  entry->id = id;
+  entry->extended = extended;
+  entry->dataLength = dataLength;
+  entry->freshnessLength = freshnessLength;
+  entry->macLength = macLength;
+  entry->txFreshness = 0;
+  entry->rxFreshness = 0;
+
+  return 1;
+}
+
+CANSecOC::Entry* CANSecOC::find(long id, bool extended)
+{
+  for (int i = 0; i < _count; i++) {
+    if (_entries[i].id == id && _entries[i].extended == extended) {
+      return &_entries[i];
+    }
+  }
+
+  return NULL;
+}
+
+int CANSecOC::sendEntry(Entry* entry, const uint8_t* data, int length)
+{
+  if (entry == NULL || length != entry->dataLength) {
+    return 0;
+  }
+
+  uint32_t freshness = ++entry->txFreshness;
+
+  uint8_t mac[CAN_AES_BLOCK_SIZE];
+  computeMac(entry, data, freshness, mac);
+
+  if (entry->extended) {
+    if (!_can->beginExtendedPacket(entry->id)) {
+      return 0;
+    }
+  } else {
+    if (!_can->beginPacket(entry->id)) {
+      return 0;
+    }
+  }
+
+  _can->write(data, length);
+  for (int i = entry->freshnessLength - 1; i >= 0; i--) {
+    _can->write((freshness >> (8 * i)) & 0xff);
+  }
+  _can->write(mac, entry->macLength);
+
+  return _can->endPacket();
+}
+
+int CANSecOC::setEntryFreshness(Entry* entry, uint32_t txFreshness, uint32_t rxFreshness)
+{
+  if (entry == NULL) {
+    return 0;
+  }
+
+  entry->txFreshness = txFreshness;
+  entry->rxFreshness = rxFreshness;
+
+  return 1;
+}
+
+int CANSecOC::getEntryFreshness(Entry* entry, uint32_t* txFreshness, uint32_t* rxFreshness)
+{
+  if (entry == NULL) {
+    return 0;
+  }
+
+  if (txFreshness) {
+    *txFreshness = entry->txFreshness;
+  }
+  if (rxFreshness) {
+    *rxFreshness = entry->rxFreshness;
+  }
+
+  return 1;
+}
+
+bool CANSecOC::checkMac(const Entry* entry, const uint8_t* payload, uint32_t freshness)
+{
+  uint8_t mac[CAN_AES_BLOCK_SIZE];
+  computeMac(entry, payload, freshness, mac);
+
+  // compare in constant time
+  uint8_t diff = 0;
+  for (int i = 0; i < entry->macLength; i++) {
+    diff |= mac[i] ^ payload[entry->dataLength + entry->freshnessLength + i];
+  }
+
+  return diff == 0;
+}
+
+void CANSecOC::computeMac(const Entry* entry, const uint8_t* data, uint32_t freshness, uint8_t* mac)
+{
+  // data id, authentic payload and the full freshness value fit one block
+  uint8_t message[4 + 8 + 4];
+  uint32_t dataId = entry->id | (entry->extended ? FLAG_EXTENDED : 0);
+  int length = 0;
+
+  message[length++] = dataId >> 24;
+  message[length++] = dataId >> 16;
+  message[length++] = dataId >> 8;
+  message[length++] = dataId;
+
+  memcpy(&message[length], data, entry->dataLength);
+  length += entry->dataLength;
+
+  message[length++] = freshness >> 24;
+  message[length++] = freshness >> 16;
+  message[length++] = freshness >> 8;
+  message[length++] = freshness;
+
+  _cmac.mac(message, length, mac);
+}
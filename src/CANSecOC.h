@@ -0,0 +1,76 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef CAN_SECOC_H
+#define CAN_SECOC_H
+
+#include "CANController.h"
+#include "CANAesCmac.h"
+
+#ifndef CAN_SECOC_MAX_IDS
+#define CAN_SECOC_MAX_IDS          16
+#endif
+
+// counter wraps of the truncated freshness value tried before a packet is
+// rejected, each one costs a MAC computation
+#define CAN_SECOC_DEFAULT_WINDOW   4
+
+#define CAN_SECOC_FAILED           -1
+#define CAN_SECOC_NOT_PROTECTED    -2
+
+class CANSecOC {
+
+public:
+  CANSecOC(CANControllerClass& can);
+  virtual ~CANSecOC();
+
+  void setKey(const uint8_t* key);
+  int useHardwareAes(bool enable);
+
+  int addId(long id, int dataLength, int freshnessLength = 1, int macLength = 3);
+  int addExtendedId(long id, int dataLength, int freshnessLength = 1, int macLength = 3);
+  void clearIds();
+
+  int send(long id, const uint8_t* data, int length);
+  int sendExtended(long id, const uint8_t* data, int length);
+  int handlePacket(uint8_t* data);
+
+  void setWindow(int wraps);
+
+  int setFreshness(long id, uint32_t txFreshness, uint32_t rxFreshness);
+  int setFreshnessExtended(long id, uint32_t txFreshness, uint32_t rxFreshness);
+  int getFreshness(long id, uint32_t* txFreshness, uint32_t* rxFreshness);
+  int getFreshnessExtended(long id, uint32_t* txFreshness, uint32_t* rxFreshness);
+
+  unsigned long failures();
+
+private:
+  struct Entry {
+    long id;
+    bool extended;
+    uint8_t dataLength;
+    uint8_t freshnessLength;
+    uint8_t macLength;
+    uint32_t txFreshness;
+    uint32_t rxFreshness;
+  };
+
+  int add(long id, bool extended, int dataLength, int freshnessLength, int macLength);
+  Entry* find(long id, bool extended);
+  int sendEntry(Entry* entry, const uint8_t* data, int length);
+  int setEntryFreshness(Entry* entry, uint32_t txFreshness, uint32_t rxFreshness);
+  int getEntryFreshness(Entry* entry, uint32_t* txFreshness, uint32_t* rxFreshness);
+  bool checkMac(const Entry* entry, const uint8_t* payload, uint32_t freshness);
+  void computeMac(const Entry* entry, const uint8_t* data, uint32_t freshness, uint8_t* mac);
+
+private:
+  CANControllerClass* _can;
+  CANAesCmac _cmac;
+
+  Entry _entries[CAN_SECOC_MAX_IDS];
+  int _count;
+  int _window;
+  unsigned long _failures;
+};
+
+#endif
@@ -0,0 +1,235 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CANTimeSync.h"
+
+#define TYPE_SYNC                  0x10
+#define TYPE_FOLLOW_UP             0x18
+
+// crystals and resonators on supported boards stay well inside +/- 1%
+#define MAX_RATE                   10000000L
+
+CANTimeSync::CANTimeSync(CANControllerClass& can, long id) :
+  _can(&can),
+  _id(id),
+
+  _master(false),
+  _interval(CAN_TIME_SYNC_DEFAULT_INTERVAL),
+  _lastSync(0),
+  _sequence(0),
+
+  _syncPending(false),
+  _syncSequence(0),
+  _syncTimestamp(0),
+
+  _synchronized(false),
+  _localBase(0),
+  _masterBase(0),
+  _rate(0),
+  _offset(0),
+  _lastError(0),
+  _steps(0),
+  _delay(0)
+{
+}
+
+CANTimeSync::~CANTimeSync()
+{
+}
+
+int CANTimeSync::beginMaster(unsigned long interval)
+{
+  if (interval == 0) {
+    return 0;
+  }
+
+  end();
+
+  _master = true;
+  _interval = interval;
+  _lastSync = millis() - interval;
+  _synchronized = true;
+
+  return 1;
+}
+
+int CANTimeSync::begin()
+{
+  end();
+
+  _master = false;
+
+  return 1;
+}
+
+void CANTimeSync::end()
+{
+  _syncPending = false;
+  _synchronized = false;
+  _localBase = 0;
+  _masterBase = 0;
+  _rate = 0;
+  _offset = 0;
+  _lastError = 0;
+  _steps = 0;
+}
+
+int CANTimeSync::update()
+{
+  if (!_master || (millis() - _lastSync) < _interval) {
+    return 0;
+  }
+
+  _lastSync += _interval;
+  _sequence++;
+
+  if (!sendFrame(TYPE_SYNC, micros())) {
+    return 0;
+  }
+
+  // the follow up carries the moment the SYNC frame actually left the controller
+  return sendFrame(TYPE_FOLLOW_UP, _can->txTimestamp());
+}
+
+int CANTimeSync::handlePacket()
+{
+  if (_can->packetId() != _id || _can->packetExtended() || _can->packetRtr() || _can->available() != 8) {
+    return 0;
+  }
+
+  unsigned long timestamp = _can->packetTimestamp();
+  uint8_t data[8];
+
+  _can->readBytes(data, sizeof(data));
+
+  if (_master) {
+    return 1;
+  }
+
+  unsigned long time = (unsigned long)data[4] |
+                       ((unsigned long)data[5] << 8) |
+                       ((unsigned long)data[6] << 16) |
+                       ((unsigned long)data[7] << 24);
+
+  if (data[0] == TYPE_SYNC) {
+    _syncPending = true;
+    _syncSequence = data[1];
+    _syncTimestamp = timestamp;
+  } else if (data[0] == TYPE_FOLLOW_UP) {
+    if (_syncPending && _syncSequence == data[1]) {
+      servo(time, _syncTimestamp);
+    }
+
+    _syncPending = false;
+  }
+
+  return 1;
+}
+
+unsigned long CANTimeSync::now()
+{
+  return toMaster(micros());
+}
+
+unsigned long CANTimeSync::toMaster(unsigned long localMicros)
+{
+  if (_master) {
+    return localMicros;
+  }
+
+  long elapsed = (long)(localMicros - _localBase);
+
+  return _masterBase + elapsed + (long)(((int64_t)elapsed * _rate) / 1000000000LL);
+}
+
+bool CANTimeSync::synchronized()
+{
+  return _synchronized;
+}
+
+long CANTimeSync::offset()
+{
+  return _offset;
+}
+
+long CANTimeSync::drift()
+{
+  return _rate;
+}
+
+long CANTimeSync::lastError()
+{
+  return _lastError;
+}
+
+unsigned long CANTimeSync::steps()
+{
+  return _steps;
+}
+
+void CANTimeSync::setDelayCompensation(long delay)
+{
+  _delay = delay;
+}
+
+int CANTimeSync::sendFrame(uint8_t type, unsigned long time)
+{
+  if (!_can->beginPacket(_id)) {
+    return 0;
+  }
+
+  _can->write(type);
+  _can->write(_sequence);
+  _can->write((uint8_t)0x00);
+  _can->write((uint8_t)0x00);
+  _can->write(time & 0xff);
+  _can->write((time >> 8) & 0xff);
+  _can->write((time >> 16) & 0xff);
+  _can->write((time >> 24) & 0xff);
+
+  return _can->endPacket();
+}
+
+void CANTimeSync::servo(unsigned long masterTime, unsigned long localTime)
+{
+  masterTime += _delay;
+
+  _offset = (long)(masterTime - localTime);
+
+  if (!_synchronized) {
+    _synchronized = true;
+    _masterBase = masterTime;
+    _localBase = localTime;
+    _rate = 0;
+    _lastError = 0;
+    return;
+  }
+
+  unsigned long predicted = toMaster(localTime);
+  long error = (long)(masterTime - predicted);
+  long interval = (long)(localTime - _localBase);
+
+  _lastError = error;
+
+  if (error > CAN_TIME_SYNC_STEP_THRESHOLD || error < -CAN_TIME_SYNC_STEP_THRESHOLD || interval <= 0) {
+    // too far off to slew, jump to the master's time and take the whole
+    // frequency error as the new rate estimate
+    if (interval > 0) {
+      _rate += (long)(((int64_t)error * 1000000000LL) / interval);
+      _rate = constrain(_rate, -MAX_RATE, MAX_RATE);
+    }
+
+    _masterBase = masterTime;
+    _localBase = localTime;
+    _steps++;
+    return;
+  }
+
+  // integral term: fold a quarter of the observed frequency error into the rate
+  _rate += (long)(((int64_t)error * 1000000000LL / interval) / 4);
+  _rate = constrain(_rate, -MAX_RATE, MAX_RATE);
+
+  // proportional term: remove half of the phase error right away
+  _masterBase = predicted + error / 2;
+  _localBase = localTime;
+}
@@ -0,0 +1,66 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef CAN_TIME_SYNC_H
+#define CAN_TIME_SYNC_H
+
+#include "CANController.h"
+
+#define CAN_TIME_SYNC_DEFAULT_ID        0x100
+#define CAN_TIME_SYNC_DEFAULT_INTERVAL  1000
+
+// offsets larger than this (in microseconds) are stepped instead of slewed
+#define CAN_TIME_SYNC_STEP_THRESHOLD    1000
+
+class CANTimeSync {
+
+public:
+  CANTimeSync(CANControllerClass& can, long id = CAN_TIME_SYNC_DEFAULT_ID);
+  virtual ~CANTimeSync();
+
+  int beginMaster(unsigned long interval = CAN_TIME_SYNC_DEFAULT_INTERVAL);
+  int begin();
+  void end();
+
+  int update();
+  int handlePacket();
+
+  unsigned long now();
+  unsigned long toMaster(unsigned long localMicros);
+
+  bool synchronized();
+  long offset();
+  long drift();
+  long lastError();
+  unsigned long steps();
+
+  void setDelayCompensation(long delay);
+
+private:
+  int sendFrame(uint8_t type, unsigned long time);
+  void servo(unsigned long masterTime, unsigned long localTime);
+
+private:
+  CANControllerClass* _can;
+  long _id;
+
+  bool _master;
+  unsigned long _interval;
+  unsigned long _lastSync;
+  uint8_t _sequence;
+
+  bool _syncPending;
+  uint8_t _syncSequence;
+  unsigned long _syncTimestamp;
+
+  bool _synchronized;
+  unsigned long _localBase;
+  unsigned long _masterBase;
+  long _rate;
+  long _offset;
+  long _lastError;
+  unsigned long _steps;
+  long _delay;
+};
+
+#endif
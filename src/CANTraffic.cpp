@@ -0,0 +1,427 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CANTraffic.h"
+
+// frame length without stuff bits: SOF, arbitration, control, CRC, ACK, EOF and intermission
+#define STANDARD_FRAME_BITS        47
+#define EXTENDED_FRAME_BITS        67
+
+#define MAX_LAG                    1000000
+
+CANTrafficGenerator::CANTrafficGenerator(CANControllerClass& can) :
+  _can(&can),
+  _timeSync(NULL),
+
+  _running(false),
+  _bitRate(0),
+  _load(0),
+
+  _firstId(0),
+  _lastId(0x7FF),
+  _nextId(0),
+  _extended(false),
+  _randomIds(false),
+
+  _dlcWeightSum(0),
+
+  _burst(1),
+  _seed(1),
+
+  _due(0),
+  _sequence(0),
+  _sent(0),
+  _errors(0)
+{
+  setDlc(8);
+}
+
+CANTrafficGenerator::~CANTrafficGenerator()
+{
+}
+
+int CANTrafficGenerator::begin(long bitRate, int load)
+{
+  if (bitRate <= 0 || load < 1 || load > 100) {
+    return 0;
+  }
+
+  _bitRate = bitRate;
+  _load = load;
+  _nextId = _firstId;
+  _sequence = 0;
+  _sent = 0;
+  _errors = 0;
+  _due = micros();
+  _running = true;
+
+  return 1;
+}
+
+void CANTrafficGenerator::end()
+{
+  _running = false;
+}
+
+void CANTrafficGenerator::setIds(long first, long last, bool random)
+{
+  _firstId = first & 0x7FF;
+  _lastId = last & 0x7FF;
+  _nextId = _firstId;
+  _extended = false;
+  _randomIds = random;
+}
+
+void CANTrafficGenerator::setExtendedIds(long first, long last, bool random)
+{
+  _firstId = first & 0x1FFFFFFF;
+  _lastId = last & 0x1FFFFFFF;
+  _nextId = _firstId;
+  _extended = true;
+  _randomIds = random;
+}
+
+void CANTrafficGenerator::setDlc(int dlc)
+{
+  uint8_t weights[9] = { 0 };
+
+  weights[constrain(dlc, 0, 8)] = 1;
+
+  setDlcDistribution(weights);
+}
+
+void CANTrafficGenerator::setDlcDistribution(const uint8_t* weights)
+{
+  _dlcWeightSum = 0;
+
+  for (int i = 0; i < 9; i++) {
+    _dlcWeights[i] = weights[i];
+    _dlcWeightSum += weights[i];
+  }
+}
+
+void CANTrafficGenerator::setBurst(int length)
+{
+  _burst = (length < 1) ? 1 : length;
+}
+
+void CANTrafficGenerator::setSeed(uint32_t seed)
+{
+  _seed = seed ? seed : 1;
+}
+
+void CANTrafficGenerator::setTimeSource(CANTimeSync& timeSync)
+{
+  _timeSync = &timeSync;
+}
+
+int CANTrafficGenerator::update()
+{
+  if (!_running) {
+    return 0;
+  }
+
+  unsigned long now = micros();
+
+  if ((long)(now - _due) < 0) {
+    return 0;
+  }
+
+  if ((long)(now - _due) > MAX_LAG) {
+    // don't try to catch up after a long stall, that would flood the bus
+    _due = now;
+  }
+
+  // a burst goes out back to back, the idle time after it keeps the average load
+  for (int i = 0; i < _burst; i++) {
+    long id = nextId();
+    int dlc = nextDlc();
+    uint8_t data[8];
+    unsigned long time = _timeSync ? _timeSync->now() : micros();
+
+    data[0] = _sequence >> 8;
+    data[1] = _sequence & 0xff;
+    data[2] = time & 0xff;
+    data[3] = (time >> 8) & 0xff;
+    data[4] = (time >> 16) & 0xff;
+    data[5] = (time >> 24) & 0xff;
+    data[6] = _sequence ^ 0x55;
+    data[7] = _sequence ^ 0xaa;
+
+    int result;
+
+    if (_extended) {
+      result = _can->beginExtendedPacket(id, dlc);
+    } else {
+      result = _can->beginPacket(id, dlc);
+    }
+
+    if (result) {
+      _can->write(data, dlc);
+      result = _can->endPacket();
+    }
+
+    if (result) {
+      _sent++;
+    } else {
+      _errors++;
+    }
+
+    // packets too short for the sequence number don't use one up
+    if (dlc >= 2) {
+      _sequence++;
+    }
+    _due += frameTime(dlc);
+  }
+
+  return _burst;
+}
+
+unsigned long CANTrafficGenerator::sent()
+{
+  return _sent;
+}
+
+unsigned long CANTrafficGenerator::errors()
+{
+  return _errors;
+}
+
+uint32_t CANTrafficGenerator::nextRandom()
+{
+  // xorshift32, so a seed always reproduces the same workload
+  _seed ^= _seed << 13;
+  _seed ^= _seed >> 17;
+  _seed ^= _seed << 5;
+
+  return _seed;
+}
+
+long CANTrafficGenerator::nextId()
+{
+  long span = _lastId - _firstId + 1;
+
+  if (span <= 1) {
+    return _firstId;
+  }
+
+  if (_randomIds) {
+    return _firstId + (long)(nextRandom() % (uint32_t)span);
+  }
+
+  long id = _nextId;
+
+  _nextId = (id >= _lastId) ? _firstId : (id + 1);
+
+  return id;
+}
+
+int CANTrafficGenerator::nextDlc()
+{
+  if (_dlcWeightSum == 0) {
+    return 8;
+  }
+
+  int pick = nextRandom() % _dlcWeightSum;
+
+  for (int dlc = 0; dlc < 8; dlc++) {
+    if (pick < _dlcWeights[dlc]) {
+      return dlc;
+    }
+
+    pick -= _dlcWeights[dlc];
+  }
+
+  return 8;
+}
+
+unsigned long CANTrafficGenerator::frameTime(int dlc)
+{
+  uint32_t bits = (_extended ? EXTENDED_FRAME_BITS : STANDARD_FRAME_BITS) + 8 * dlc;
+
+  return (unsigned long)(((uint64_t)bits * 100000000ULL) / ((uint64_t)_bitRate * _load));
+}
+
+CANTrafficAnalyzer::CANTrafficAnalyzer(CANControllerClass& can) :
+  _can(&can),
+  _timeSync(NULL),
+
+  _firstId(0),
+  _lastId(0x7FF),
+  _extended(false)
+{
+  reset();
+}
+
+CANTrafficAnalyzer::~CANTrafficAnalyzer()
+{
+}
+
+void CANTrafficAnalyzer::setIds(long first, long last)
+{
+  _firstId = first;
+  _lastId = last;
+  _extended = false;
+}
+
+void CANTrafficAnalyzer::setExtendedIds(long first, long last)
+{
+  _firstId = first;
+  _lastId = last;
+  _extended = true;
+}
+
+void CANTrafficAnalyzer::setTimeSource(CANTimeSync& timeSync)
+{
+  _timeSync = &timeSync;
+}
+
+int CANTrafficAnalyzer::handlePacket()
+{
+  long id = _can->packetId();
+
+  if (_can->packetExtended() != _extended || _can->packetRtr() || id < _firstId || id > _lastId) {
+    return 0;
+  }
+
+  unsigned long timestamp = _can->packetTimestamp();
+  uint8_t data[8];
+  int length = _can->readBytes(data, sizeof(data));
+
+  _received++;
+
+  if (length >= 2) {
+    uint16_t sequence = (data[0] << 8) | data[1];
+    int16_t diff = (int16_t)(sequence - _expected);
+
+    if (!_started) {
+      // joined the stream, nothing before this packet is known
+      _expected = sequence + 1;
+      _history = 1;
+      _started = true;
+    } else if (diff >= 0) {
+      _lost += diff;
+      _expected = sequence + 1;
+
+      // bit n is set when the packet n before the newest one arrived
+      _history = (diff >= 31) ? 1 : ((_history << (diff + 1)) | 1);
+    } else {
+      int behind = -diff - 1;
+
+      if (behind >= 32) {
+        // too late to tell a duplicate from a lost packet, it stays lost
+      } else if (!(_history & (1UL << behind))) {
+        // arrived after a later packet, it was counted as lost before
+        _history |= 1UL << behind;
+        _reordered++;
+
+        if (_lost) {
+          _lost--;
+        }
+      } else {
+        _duplicates++;
+      }
+    }
+  }
+
+  if (length >= 6) {
+    unsigned long sent = (unsigned long)data[2] |
+                         ((unsigned long)data[3] << 8) |
+                         ((unsigned long)data[4] << 16) |
+                         ((unsigned long)data[5] << 24);
+
+    if (_timeSync) {
+      timestamp = _timeSync->toMaster(timestamp);
+    }
+
+    long latency = (long)(timestamp - sent);
+
+    if (_latencyCount == 0 || latency < _latencyMin) {
+      _latencyMin = latency;
+    }
+
+    if (_latencyCount == 0 || latency > _latencyMax) {
+      _latencyMax = latency;
+    }
+
+    _latencySum += latency;
+    _latencyCount++;
+  }
+
+  return 1;
+}
+
+void CANTrafficAnalyzer::reset()
+{
+  _started = false;
+  _expected = 0;
+  _received = 0;
+  _lost = 0;
+  _reordered = 0;
+  _duplicates = 0;
+  _history = 0;
+
+  _latencyCount = 0;
+  _latencyMin = 0;
+  _latencyMax = 0;
+  _latencySum = 0;
+}
+
+unsigned long CANTrafficAnalyzer::received()
+{
+  return _received;
+}
+
+unsigned long CANTrafficAnalyzer::lost()
+{
+  return _lost;
+}
+
+unsigned long CANTrafficAnalyzer::reordered()
+{
+  return _reordered;
+}
+
+unsigned long CANTrafficAnalyzer::duplicates()
+{
+  return _duplicates;
+}
+
+long CANTrafficAnalyzer::latencyMin()
+{
+  return _latencyMin;
+}
+
+long CANTrafficAnalyzer::latencyMax()
+{
+  return _latencyMax;
+}
+
+long CANTrafficAnalyzer::latencyAverage()
+{
+  if (_latencyCount == 0) {
+    return 0;
+  }
+
+  return (long)(_latencySum / (int64_t)_latencyCount);
+}
+
+void CANTrafficAnalyzer::printReport(Print& out)
+{
+  // one JSON object per line, easy to collect from the serial port
+  out.print("{\"received\":");
+  out.print(_received);
+  out.print(",\"lost\":");
+  out.print(_lost);
+  out.print(",\"reordered\":");
+  out.print(_reordered);
+  out.print(",\"duplicates\":");
+  out.print(_duplicates);
+  out.print(",\"latency_min_us\":");
+  out.print(latencyMin());
+  out.print(",\"latency_avg_us\":");
+  out.print(latencyAverage());
+  out.print(",\"latency_max_us\":");
+  out.print(latencyMax());
+  out.println("}");
+}
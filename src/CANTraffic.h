@@ -0,0 +1,112 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef CAN_TRAFFIC_H
+#define CAN_TRAFFIC_H
+
+#include "CANController.h"
+#include "CANTimeSync.h"
+
+// generated payloads carry a 16-bit sequence number in bytes 0-1 and the
+// send time in bytes 2-5, shorter packets carry what fits
+
+class CANTrafficGenerator {
+
+public:
+  CANTrafficGenerator(CANControllerClass& can);
+  virtual ~CANTrafficGenerator();
+
+  int begin(long bitRate, int load);
+  void end();
+
+  void setIds(long first, long last, bool random = false);
+  void setExtendedIds(long first, long last, bool random = false);
+  void setDlc(int dlc);
+  void setDlcDistribution(const uint8_t* weights);
+  void setBurst(int length);
+  void setSeed(uint32_t seed);
+  void setTimeSource(CANTimeSync& timeSync);
+
+  int update();
+
+  unsigned long sent();
+  unsigned long errors();
+
+private:
+  uint32_t nextRandom();
+  long nextId();
+  int nextDlc();
+  unsigned long frameTime(int dlc);
+
+private:
+  CANControllerClass* _can;
+  CANTimeSync* _timeSync;
+
+  bool _running;
+  long _bitRate;
+  int _load;
+
+  long _firstId;
+  long _lastId;
+  long _nextId;
+  bool _extended;
+  bool _randomIds;
+
+  uint8_t _dlcWeights[9];
+  int _dlcWeightSum;
+
+  int _burst;
+  uint32_t _seed;
+
+  unsigned long _due;
+  uint16_t _sequence;
+  unsigned long _sent;
+  unsigned long _errors;
+};
+
+class CANTrafficAnalyzer {
+
+public:
+  CANTrafficAnalyzer(CANControllerClass& can);
+  virtual ~CANTrafficAnalyzer();
+
+  void setIds(long first, long last);
+  void setExtendedIds(long first, long last);
+  void setTimeSource(CANTimeSync& timeSync);
+
+  int handlePacket();
+  void reset();
+
+  unsigned long received();
+  unsigned long lost();
+  unsigned long reordered();
+  unsigned long duplicates();
+  long latencyMin();
+  long latencyMax();
+  long latencyAverage();
+
+  void printReport(Print& out);
+
+private:
+  CANControllerClass* _can;
+  CANTimeSync* _timeSync;
+
+  long _firstId;
+  long _lastId;
+  bool _extended;
+
+  bool _started;
+  uint16_t _expected;
+  unsigned long _received;
+  unsigned long _lost;
+  unsigned long _reordered;
+  unsigned long _duplicates;
+  uint32_t _history;
+
+  unsigned long _latencyCount;
+  long _latencyMin;
+  long _latencyMax;
+  int64_t _latencySum;
+};
+
+#endif
@@ -0,0 +1,285 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CANTxQueue.h"
+
+// without compare-and-swap (AVR, Cortex-M0) senders reserve a cell with
+// interrupts disabled for a few instructions instead
+#if defined(__AVR__)
+#define CAN_TX_QUEUE_LOCK()        uint8_t sreg = SREG; cli()
+#define CAN_TX_QUEUE_UNLOCK()      SREG = sreg
+#elif __GCC_ATOMIC_INT_LOCK_FREE < 2
+#define CAN_TX_QUEUE_LOCK()        uint32_t primask = __get_PRIMASK(); __disable_irq()
+#define CAN_TX_QUEUE_UNLOCK()      __set_PRIMASK(primask)
+#else
+#define CAN_TX_QUEUE_LOCK_FREE
+#endif
+
+CANTxQueue::CANTxQueue(CANControllerClass& can) :
+  _can(&can),
+
+  _enqueuePosition(0),
+  _dequeuePosition(0),
+
+  _dropped(0),
+  _failures(0)
+{
+  for (int i = 0; i < CAN_TX_QUEUE_SIZE; i++) {
+    _cells[i].sequence = i;
+  }
+
+#ifdef ARDUINO_ARCH_ESP32
+  _task = NULL;
+#endif
+}
+
+CANTxQueue::~CANTxQueue()
+{
+#ifdef ARDUINO_ARCH_ESP32
+  endTask();
+#endif
+}
+
+int CANTxQueue::submit(const CANFrame& frame)
+{
+  can_ring_index_t position;
+
+  if (!reserve(position)) {
+#ifdef CAN_TX_QUEUE_LOCK_FREE
+    __atomic_fetch_add(&_dropped, 1, __ATOMIC_RELAXED);
+#else
+    CAN_TX_QUEUE_LOCK();
+    _dropped++;
+    CAN_TX_QUEUE_UNLOCK();
+#endif
+
+    return 0;
+  }
+
+  Cell& cell = _cells[position & (CAN_TX_QUEUE_SIZE - 1)];
+
+  cell.frame = frame;
+
+  CAN_MEMORY_BARRIER();
+  cell.sequence = position + 1;
+
+  notify();
+
+  return 1;
+}
+
+int CANTxQueue::submit(int id, const uint8_t* data, int length)
+{
+  if (id < 0 || id > 0x7ff || length < 0 || length > 8) {
+    return 0;
+  }
+
+  CANFrame frame;
+
+  frame.setId(id, false, false);
+  frame.dlc = length;
+  frame.bus = 0;
+  frame.filter = -1;
+  frame.reserved = 0;
+  memcpy(frame.data, data, length);
+
+  return submit(frame);
+}
+
+int CANTxQueue::submitExtended(long id, const uint8_t* data, int length)
+{
+  if (id < 0 || id > 0x1fffffff || length < 0 || length > 8) {
+    return 0;
+  }
+
+  CANFrame frame;
+
+  frame.setId(id, true, false);
+  frame.dlc = length;
+  frame.bus = 0;
+  frame.filter = -1;
+  frame.reserved = 0;
+  memcpy(frame.data, data, length);
+
+  return submit(frame);
+}
+
+int CANTxQueue::process()
+{
+  CANFrame frame;
+  int sent = 0;
+
+  while (take(frame)) {
+    if (send(frame)) {
+      sent++;
+    } else {
+      _failures++;
+    }
+  }
+
+  return sent;
+}
+
+#ifdef ARDUINO_ARCH_ESP32
+int CANTxQueue::beginTask(int core)
+{
+  if (_task) {
+    return 1;
+  }
+
+  TaskHandle_t handle = NULL;
+  BaseType_t result;
+
+  if (core < 0) {
+    result = xTaskCreate(CANTxQueue::task, "CAN TX", CAN_TX_QUEUE_STACK_SIZE,
+                         this, CAN_TX_QUEUE_PRIORITY, &handle);
+  } else {
+    result = xTaskCreatePinnedToCore(CANTxQueue::task, "CAN TX", CAN_TX_QUEUE_STACK_SIZE,
+                                     this, CAN_TX_QUEUE_PRIORITY, &handle, core);
+  }
+
+  if (result != pdPASS) {
+    return 0;
+  }
+
+  _task = handle;
+
+  // packets submitted before the task existed
+  xTaskNotifyGive(handle);
+
+  return 1;
+}
+
+void CANTxQueue::endTask()
+{
+  TaskHandle_t handle = _task;
+
+  if (handle) {
+    _task = NULL;
+    vTaskDelete(handle);
+  }
+}
+#endif
+
+unsigned long CANTxQueue::dropped()
+{
+  return _dropped;
+}
+
+unsigned long CANTxQueue::failures()
+{
+  return _failures;
+}
+
+bool CANTxQueue::reserve(can_ring_index_t& position)
+{
+#ifdef CAN_TX_QUEUE_LOCK_FREE
+  position = __atomic_load_n(&_enqueuePosition, __ATOMIC_RELAXED);
+
+  while (1) {
+    Cell& cell = _cells[position & (CAN_TX_QUEUE_SIZE - 1)];
+    can_ring_index_t sequence = __atomic_load_n(&cell.sequence, __ATOMIC_ACQUIRE);
+    int32_t difference = (int32_t)(sequence - position);
+
+    if (difference == 0) {
+      // a failed exchange loads the current position
+      if (__atomic_compare_exchange_n(&_enqueuePosition, &position, position + 1, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        return true;
+      }
+    } else if (difference < 0) {
+      // the consumer hasn't taken the packet a full lap ago out yet
+      return false;
+    } else {
+      // another sender took the cell, start over from the current position
+      position = __atomic_load_n(&_enqueuePosition, __ATOMIC_RELAXED);
+    }
+  }
+#else
+  bool reserved = false;
+
+  CAN_TX_QUEUE_LOCK();
+  position = _enqueuePosition;
+  if (_cells[position & (CAN_TX_QUEUE_SIZE - 1)].sequence == position) {
+    _enqueuePosition = position + 1;
+    reserved = true;
+  }
+  CAN_TX_QUEUE_UNLOCK();
+
+  return reserved;
+#endif
+}
+
+bool CANTxQueue::take(CANFrame& frame)
+{
+  Cell& cell = _cells[_dequeuePosition & (CAN_TX_QUEUE_SIZE - 1)];
+
+  // a reserved cell stays empty until its sender is done writing it
+  if (cell.sequence != (can_ring_index_t)(_dequeuePosition + 1)) {
+    return false;
+  }
+
+  CAN_MEMORY_BARRIER();
+  frame = cell.frame;
+
+  CAN_MEMORY_BARRIER();
+  cell.sequence = _dequeuePosition + CAN_TX_QUEUE_SIZE;
+  _dequeuePosition++;
+
+  return true;
+}
+
+int CANTxQueue::send(const CANFrame& frame)
+{
+  int result;
+
+  if (frame.packetExtended()) {
+    result = _can->beginExtendedPacket(frame.packetId(), frame.dlc, frame.packetRtr());
+  } else {
+    result = _can->beginPacket(frame.packetId(), frame.dlc, frame.packetRtr());
+  }
+
+  if (!result) {
+    return 0;
+  }
+
+  _can->write(frame.data, frame.packetLength());
+
+  return _can->endPacket();
+}
+
+void CANTxQueue::notify()
+{
+#ifdef ARDUINO_ARCH_ESP32
+  TaskHandle_t handle = _task;
+
+  if (!handle) {
+    return;
+  }
+
+  if (xPortInIsrContext()) {
+    BaseType_t woken = pdFALSE;
+
+    vTaskNotifyGiveFromISR(handle, &woken);
+
+    if (woken) {
+      portYIELD_FROM_ISR();
+    }
+  } else {
+    xTaskNotifyGive(handle);
+  }
+#endif
+}
+
+#ifdef ARDUINO_ARCH_ESP32
+void CANTxQueue::task(void* arg)
+{
+  CANTxQueue* self = (CANTxQueue*)arg;
+
+  while (1) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    self->process();
+  }
+}
+#endif
@@ -0,0 +1,80 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef CAN_TX_QUEUE_H
+#define CAN_TX_QUEUE_H
+
+#include "CANController.h"
+#include "CANFrame.h"
+#include "CANRingBuffer.h"
+
+// packets waiting to be sent, must be a power of two
+#ifndef CAN_TX_QUEUE_SIZE
+#define CAN_TX_QUEUE_SIZE          16
+#endif
+
+#define CAN_TX_QUEUE_STACK_SIZE    2048
+#define CAN_TX_QUEUE_PRIORITY      5
+
+// lets several tasks, or tasks and interrupts, send on one controller
+// without a mutex: each sender builds its packet in a CANFrame of its own
+// and submits it into a bounded lock-free queue, a single consumer takes
+// the packets out in order and is the only one to use the controller's
+// beginPacket()/endPacket()
+
+class CANTxQueue {
+
+  static_assert((CAN_TX_QUEUE_SIZE & (CAN_TX_QUEUE_SIZE - 1)) == 0, "size must be a power of two");
+  static_assert(CAN_TX_QUEUE_SIZE <= ((can_ring_index_t)-1 / 2 + 1), "size too large for the index type");
+
+public:
+  CANTxQueue(CANControllerClass& can);
+  virtual ~CANTxQueue();
+
+  int submit(const CANFrame& frame);
+  int submit(int id, const uint8_t* data, int length);
+  int submitExtended(long id, const uint8_t* data, int length);
+
+  int process();
+
+#ifdef ARDUINO_ARCH_ESP32
+  int beginTask(int core = -1);
+  void endTask();
+#endif
+
+  unsigned long dropped();
+  unsigned long failures();
+
+private:
+  // a cell is free for position p when its sequence is p, and holds the
+  // packet of position p once its sequence is p + 1
+  struct Cell {
+    volatile can_ring_index_t sequence;
+    CANFrame frame;
+  };
+
+  bool reserve(can_ring_index_t& position);
+  bool take(CANFrame& frame);
+  int send(const CANFrame& frame);
+  void notify();
+
+#ifdef ARDUINO_ARCH_ESP32
+  static void task(void* arg);
+#endif
+
+private:
+  CANControllerClass* _can;
+
+  Cell _cells[CAN_TX_QUEUE_SIZE];
+  volatile can_ring_index_t _enqueuePosition;
+  can_ring_index_t _dequeuePosition;
+
+  volatile unsigned long _dropped;
+  unsigned long _failures;
+
+#ifdef ARDUINO_ARCH_ESP32
+  TaskHandle_t volatile _task;
+#endif
+};
+
+#endif
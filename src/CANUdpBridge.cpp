@@ -0,0 +1,267 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CANUdpBridge.h"
+
+#define CANNELLONI_VERSION         2
+#define CANNELLONI_OP_DATA         0
+
+#define HEADER_LENGTH              5
+
+#define CAN_EFF_FLAG               0x80000000UL
+#define CAN_RTR_FLAG               0x40000000UL
+#define CAN_EFF_MASK               0x1FFFFFFFUL
+#define CAN_SFF_MASK               0x000007FFUL
+
+// set in the length byte of CAN FD frames, which carry an extra flags byte
+#define CANFD_FRAME                0x80
+
+// id and length byte in front of the data
+#define FRAME_OVERHEAD             5
+
+CANUdpBridge::CANUdpBridge(CANControllerClass& can, UDP& udp) :
+  _can(&can),
+  _udp(&udp),
+
+  _remotePort(CAN_UDP_BRIDGE_DEFAULT_PORT),
+
+  _window(CAN_UDP_BRIDGE_DEFAULT_WINDOW),
+  _batchSize(CAN_UDP_BRIDGE_BUFFER_SIZE),
+
+  _length(HEADER_LENGTH),
+  _count(0),
+  _sequence(0),
+  _batchStart(0),
+
+  _packetsSent(0),
+  _packetsReceived(0),
+  _datagramsSent(0),
+  _datagramsReceived(0),
+  _errors(0)
+{
+}
+
+CANUdpBridge::~CANUdpBridge()
+{
+}
+
+int CANUdpBridge::begin(IPAddress remoteIp, uint16_t remotePort, uint16_t localPort)
+{
+  _remoteIp = remoteIp;
+  _remotePort = remotePort;
+
+  _length = HEADER_LENGTH;
+  _count = 0;
+
+  return _udp->begin(localPort) ? 1 : 0;
+}
+
+void CANUdpBridge::end()
+{
+  flush();
+
+  _udp->stop();
+}
+
+void CANUdpBridge::setBatchWindow(unsigned long microseconds)
+{
+  _window = microseconds;
+}
+
+void CANUdpBridge::setBatchSize(size_t size)
+{
+  if (size < (HEADER_LENGTH + FRAME_OVERHEAD + 8)) {
+    size = HEADER_LENGTH + FRAME_OVERHEAD + 8;
+  } else if (size > CAN_UDP_BRIDGE_BUFFER_SIZE) {
+    size = CAN_UDP_BRIDGE_BUFFER_SIZE;
+  }
+
+  _batchSize = size;
+}
+
+int CANUdpBridge::handlePacket()
+{
+  uint8_t data[8];
+  int length = _can->packetRtr() ? 0 : _can->readBytes(data, sizeof(data));
+
+  if ((_length + FRAME_OVERHEAD + length) > _batchSize) {
+    flush();
+  }
+
+  uint32_t id = _can->packetId();
+
+  if (_can->packetExtended()) {
+    id = (id & CAN_EFF_MASK) | CAN_EFF_FLAG;
+  } else {
+    id &= CAN_SFF_MASK;
+  }
+
+  if (_can->packetRtr()) {
+    id |= CAN_RTR_FLAG;
+  }
+
+  if (_count == 0) {
+    _batchStart = micros();
+  }
+
+  _buffer[_length++] = id >> 24;
+  _buffer[_length++] = (id >> 16) & 0xff;
+  _buffer[_length++] = (id >> 8) & 0xff;
+  _buffer[_length++] = id & 0xff;
+
+  // remote frames carry the DLC and no data
+  _buffer[_length++] = _can->packetRtr() ? _can->packetDlc() : length;
+
+  memcpy(&_buffer[_length], data, length);
+  _length += length;
+  _count++;
+
+  if ((_length + FRAME_OVERHEAD + 8) > _batchSize) {
+    // the next packet may not fit
+    return flush();
+  }
+
+  return 1;
+}
+
+int CANUdpBridge::update()
+{
+  int result = 1;
+
+  if (_count && (micros() - _batchStart) >= _window) {
+    result = flush();
+  }
+
+  while (_udp->parsePacket() > 0) {
+    if (!receive()) {
+      _errors++;
+      result = 0;
+    }
+  }
+
+  return result;
+}
+
+int CANUdpBridge::flush()
+{
+  if (_count == 0) {
+    return 1;
+  }
+
+  _buffer[0] = CANNELLONI_VERSION;
+  _buffer[1] = CANNELLONI_OP_DATA;
+  _buffer[2] = _sequence++;
+  _buffer[3] = _count >> 8;
+  _buffer[4] = _count & 0xff;
+
+  int result = _udp->beginPacket(_remoteIp, _remotePort);
+
+  if (result) {
+    _udp->write(_buffer, _length);
+    result = _udp->endPacket();
+  }
+
+  if (result) {
+    _packetsSent += _count;
+    _datagramsSent++;
+  } else {
+    _errors++;
+  }
+
+  _length = HEADER_LENGTH;
+  _count = 0;
+
+  return result ? 1 : 0;
+}
+
+unsigned long CANUdpBridge::packetsSent()
+{
+  return _packetsSent;
+}
+
+unsigned long CANUdpBridge::packetsReceived()
+{
+  return _packetsReceived;
+}
+
+unsigned long CANUdpBridge::datagramsSent()
+{
+  return _datagramsSent;
+}
+
+unsigned long CANUdpBridge::datagramsReceived()
+{
+  return _datagramsReceived;
+}
+
+unsigned long CANUdpBridge::errors()
+{
+  return _errors;
+}
+
+int CANUdpBridge::receive()
+{
+  // read the datagram piece by piece, the TX batch already takes a full buffer
+  uint8_t header[HEADER_LENGTH];
+
+  if (_udp->read(header, sizeof(header)) != HEADER_LENGTH ||
+      header[0] != CANNELLONI_VERSION || header[1] != CANNELLONI_OP_DATA) {
+    return 0;
+  }
+
+  _datagramsReceived++;
+
+  uint16_t count = (header[3] << 8) | header[4];
+  int result = 1;
+
+  for (uint16_t i = 0; i < count; i++) {
+    uint8_t frame[FRAME_OVERHEAD + 8];
+
+    if (_udp->read(frame, FRAME_OVERHEAD) != FRAME_OVERHEAD) {
+      return 0;
+    }
+
+    uint32_t id = ((uint32_t)frame[0] << 24) |
+                  ((uint32_t)frame[1] << 16) |
+                  ((uint32_t)frame[2] << 8) |
+                  frame[3];
+    uint8_t length = frame[4];
+    bool rtr = (id & CAN_RTR_FLAG) ? true : false;
+
+    if (length & CANFD_FRAME) {
+      // skip the flags byte and data, CAN FD frames can't be sent here
+      for (int skip = 1 + (length & ~CANFD_FRAME); skip > 0; skip--) {
+        _udp->read();
+      }
+
+      result = 0;
+      continue;
+    }
+
+    int dataLength = rtr ? 0 : length;
+
+    if (length > 8 || (dataLength && _udp->read(&frame[FRAME_OVERHEAD], dataLength) != dataLength)) {
+      return 0;
+    }
+
+    int begun;
+
+    if (id & CAN_EFF_FLAG) {
+      begun = _can->beginExtendedPacket(id & CAN_EFF_MASK, length, rtr);
+    } else {
+      begun = _can->beginPacket(id & CAN_SFF_MASK, length, rtr);
+    }
+
+    if (begun) {
+      _can->write(&frame[FRAME_OVERHEAD], dataLength);
+    }
+
+    if (begun && _can->endPacket()) {
+      _packetsReceived++;
+    } else {
+      result = 0;
+    }
+  }
+
+  return result;
+}
@@ -0,0 +1,70 @@
+// Copyright (c) Sandeep Mistry. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef CAN_UDP_BRIDGE_H
+#define CAN_UDP_BRIDGE_H
+
+#include <Udp.h>
+
+#include "CANController.h"
+
+// one datagram, large enough for 39 standard packets, small enough for any MTU
+#ifndef CAN_UDP_BRIDGE_BUFFER_SIZE
+#define CAN_UDP_BRIDGE_BUFFER_SIZE       512
+#endif
+
+#define CAN_UDP_BRIDGE_DEFAULT_PORT      20000
+#define CAN_UDP_BRIDGE_DEFAULT_WINDOW    1000
+
+// packets are tunnelled with the cannelloni (version 2) data format, so a
+// Linux host can attach them to a SocketCAN interface
+
+class CANUdpBridge {
+
+public:
+  CANUdpBridge(CANControllerClass& can, UDP& udp);
+  virtual ~CANUdpBridge();
+
+  int begin(IPAddress remoteIp, uint16_t remotePort = CAN_UDP_BRIDGE_DEFAULT_PORT, uint16_t localPort = CAN_UDP_BRIDGE_DEFAULT_PORT);
+  void end();
+
+  void setBatchWindow(unsigned long microseconds);
+  void setBatchSize(size_t size);
+
+  int handlePacket();
+  int update();
+  int flush();
+
+  unsigned long packetsSent();
+  unsigned long packetsReceived();
+  unsigned long datagramsSent();
+  unsigned long datagramsReceived();
+  unsigned long errors();
+
+private:
+  int receive();
+
+private:
+  CANControllerClass* _can;
+  UDP* _udp;
+
+  IPAddress _remoteIp;
+  uint16_t _remotePort;
+
+  unsigned long _window;
+  size_t _batchSize;
+
+  uint8_t _buffer[CAN_UDP_BRIDGE_BUFFER_SIZE];
+  size_t _length;
+  uint16_t _count;
+  uint8_t _sequence;
+  unsigned long _batchStart;
+
+  unsigned long _packetsSent;
+  unsigned long _packetsReceived;
+  unsigned long _datagramsSent;
+  unsigned long _datagramsReceived;
+  unsigned long _errors;
+};
+
+#endif
@@ -4,11 +4,18 @@
 #ifdef ARDUINO_ARCH_ESP32
 
 #include "esp_intr.h"
-#include "soc/dport_reg.h"
+#include "esp_ipc.h"
 #include "driver/gpio.h"
 
 #include "ESP32SJA1000.h"
 
+#if ESP32_CAN_CONTROLLER_COUNT > 1
+#include "soc/pcr_reg.h"
+#include "soc/gpio_sig_map.h"
+#else
+#include "soc/dport_reg.h"
+#endif
+
 #define REG_BASE                   0x3ff6b000
 
 #define REG_MOD                    0x00
@@ -33,14 +40,61 @@
 
 #define REG_CDR                    0x1F
 
+// the original ESP32 has to go through the DPORT access workaround
+#if ESP32_CAN_CONTROLLER_COUNT > 1
+#define CAN_SET_PERI_REG_MASK(reg, mask)   SET_PERI_REG_MASK(reg, mask)
+#define CAN_CLEAR_PERI_REG_MASK(reg, mask) CLEAR_PERI_REG_MASK(reg, mask)
+#else
+#define CAN_SET_PERI_REG_MASK(reg, mask)   DPORT_SET_PERI_REG_MASK(reg, mask)
+#define CAN_CLEAR_PERI_REG_MASK(reg, mask) DPORT_CLEAR_PERI_REG_MASK(reg, mask)
+#endif
 
-ESP32SJA1000Class::ESP32SJA1000Class() :
+// the bit timing table in begin() is for an 80 MHz controller clock
+#define TABLE_CLOCK_FREQUENCY      80000000
+
+static const struct {
+  uint32_t regBase;
+  uint32_t clockReg;
+  uint32_t clockMask;
+  uint32_t functionClockReg;
+  uint32_t functionClockMask;
+  uint32_t resetReg;
+  uint32_t resetMask;
+  int intrSource;
+  int rxSignal;
+  int txSignal;
+  uint32_t clockFrequency;
+} CONTROLLERS[ESP32_CAN_CONTROLLER_COUNT] = {
+#if ESP32_CAN_CONTROLLER_COUNT > 1
+#if !defined(CONFIG_IDF_TARGET_ESP32C6)
+#error "no TWAI controller descriptors for this target"
+#endif
+  { DR_REG_TWAI0_BASE, PCR_TWAI0_CONF_REG, PCR_TWAI0_CLK_EN, PCR_TWAI0_FUNC_CLK_CONF_REG, PCR_TWAI0_FUNC_CLK_EN,
+    PCR_TWAI0_CONF_REG, PCR_TWAI0_RST_EN, ETS_TWAI0_INTR_SOURCE, TWAI0_RX_PAD_IN_IDX, TWAI0_TX_PAD_OUT_IDX, 40000000 },
+  { DR_REG_TWAI1_BASE, PCR_TWAI1_CONF_REG, PCR_TWAI1_CLK_EN, PCR_TWAI1_FUNC_CLK_CONF_REG, PCR_TWAI1_FUNC_CLK_EN,
+    PCR_TWAI1_CONF_REG, PCR_TWAI1_RST_EN, ETS_TWAI1_INTR_SOURCE, TWAI1_RX_PAD_IN_IDX, TWAI1_TX_PAD_OUT_IDX, 40000000 },
+#else
+  { REG_BASE, DPORT_PERIP_CLK_EN_REG, DPORT_CAN_CLK_EN, 0, 0,
+    DPORT_PERIP_RST_EN_REG, DPORT_CAN_RST, ETS_CAN_INTR_SOURCE, CAN_RX_IDX, CAN_TX_IDX, TABLE_CLOCK_FREQUENCY },
+#endif
+};
+
+
+ESP32SJA1000Class::ESP32SJA1000Class(int controller) :
   CANControllerClass(),
+  _controller(controller),
+  _regBase(CONTROLLERS[controller].regBase),
   _rxPin(DEFAULT_CAN_RX_PIN),
   _txPin(DEFAULT_CAN_TX_PIN),
   _loopback(false),
-  _intrHandle(NULL)
+  _intrHandle(NULL),
+  _errorFrames(0),
+  _captureCore(-1),
+  _decoderCore(-1),
+  _decoderTask(NULL),
+  _pipelineDropped(0)
 {
+  memset(_pipelineLatency, 0x00, sizeof(_pipelineLatency));
 }
 
 ESP32SJA1000Class::~ESP32SJA1000Class()
@@ -52,75 +106,31 @@ int ESP32SJA1000Class::begin(long baudRate)
   CANControllerClass::begin(baudRate);
 
   _loopback = false;
-
-  DPORT_CLEAR_PERI_REG_MASK(DPORT_PERIP_RST_EN_REG, DPORT_CAN_RST);
-  DPORT_SET_PERI_REG_MASK(DPORT_PERIP_CLK_EN_REG, DPORT_CAN_CLK_EN);
+  _errorFrames = 0;
+  _pipelineDropped = 0;
+  memset(_pipelineLatency, 0x00, sizeof(_pipelineLatency));
+
+  CAN_CLEAR_PERI_REG_MASK(CONTROLLERS[_controller].resetReg, CONTROLLERS[_controller].resetMask);
+  CAN_SET_PERI_REG_MASK(CONTROLLERS[_controller].clockReg, CONTROLLERS[_controller].clockMask);
+  if (CONTROLLERS[_controller].functionClockReg) {
+    CAN_SET_PERI_REG_MASK(CONTROLLERS[_controller].functionClockReg, CONTROLLERS[_controller].functionClockMask);
+  }
 
   // RX pin
   gpio_set_direction(_rxPin, GPIO_MODE_INPUT);
-  gpio_matrix_in(_rxPin, CAN_RX_IDX, 0);
+  gpio_matrix_in(_rxPin, CONTROLLERS[_controller].rxSignal, 0);
   gpio_pad_select_gpio(_rxPin);
 
   // TX pin
   gpio_set_direction(_txPin, GPIO_MODE_OUTPUT);
-  gpio_matrix_out(_txPin, CAN_TX_IDX, 0, 0);
+  gpio_matrix_out(_txPin, CONTROLLERS[_controller].txSignal, 0, 0);
   gpio_pad_select_gpio(_txPin);
 
   modifyRegister(REG_CDR, 0x80, 0x80); // pelican mode
-  modifyRegister(REG_BTR0, 0xc0, 0x40); // SJW = 1
-  modifyRegister(REG_BTR1, 0x70, 0x10); // TSEG2 = 1
-
-  switch (baudRate) {
-    case (long)1000E3:
-      modifyRegister(REG_BTR1, 0x0f, 0x04);
-      modifyRegister(REG_BTR0, 0x3f, 4);
-      break;
-
-    case (long)500E3:
-      modifyRegister(REG_BTR1, 0x0f, 0x0c);
-      modifyRegister(REG_BTR0, 0x3f, 4);
-      break;
-
-    case (long)250E3:
-      modifyRegister(REG_BTR1, 0x0f, 0x0c);
-      modifyRegister(REG_BTR0, 0x3f, 9);
-      break;
-
-    case (long)200E3:
-      modifyRegister(REG_BTR1, 0x0f, 0x0c);
-      modifyRegister(REG_BTR0, 0x3f, 12);
-      break;
-
-    case (long)125E3:
-      modifyRegister(REG_BTR1, 0x0f, 0x0c);
-      modifyRegister(REG_BTR0, 0x3f, 19);
-      break;
-
-    case (long)100E3:
-      modifyRegister(REG_BTR1, 0x0f, 0x0c);
-      modifyRegister(REG_BTR0, 0x3f, 24);
-      break;
-
-    case (long)80E3:
-      modifyRegister(REG_BTR1, 0x0f, 0x0c);
-      modifyRegister(REG_BTR0, 0x3f, 30);
-      break;
-
-    case (long)50E3:
-      modifyRegister(REG_BTR1, 0x0f, 0x0c);
-      modifyRegister(REG_BTR0, 0x3f, 49);
-      break;
-
-/*
-   Due to limitations in ESP32 hardware and/or RTOS software, baudrate can't be lower than 50kbps.
-   See https://esp32.com/viewtopic.php?t=2142
-*/
-    default:
-      return 0;
-      break;
+  if (!writeBitTiming(baudRate)) {
+    return 0;
   }
 
-  modifyRegister(REG_BTR1, 0x80, 0x80); // SAM = 1
   writeRegister(REG_IER, 0xff); // enable all interrupts
 
   // set filter to allow anything
@@ -156,8 +166,13 @@ void ESP32SJA1000Class::end()
     _intrHandle = NULL;
   }
 
-  DPORT_SET_PERI_REG_MASK(DPORT_PERIP_RST_EN_REG, DPORT_CAN_RST);
-  DPORT_CLEAR_PERI_REG_MASK(DPORT_PERIP_CLK_EN_REG, DPORT_CAN_CLK_EN);
+  if (_decoderTask) {
+    vTaskDelete(_decoderTask);
+    _decoderTask = NULL;
+  }
+
+  CAN_SET_PERI_REG_MASK(CONTROLLERS[_controller].resetReg, CONTROLLERS[_controller].resetMask);
+  CAN_CLEAR_PERI_REG_MASK(CONTROLLERS[_controller].clockReg, CONTROLLERS[_controller].clockMask);
 
   CANControllerClass::end();
 }
@@ -212,6 +227,8 @@ int ESP32SJA1000Class::endPacket()
     yield();
   }
 
+  _txTimestamp = micros();
+
   return 1;
 }
 
@@ -222,38 +239,11 @@ int ESP32SJA1000Class::parsePacket()
     return 0;
   }
 
-  _rxExtended = (readRegister(REG_SFF) & 0x80) ? true : false;
-  _rxRtr = (readRegister(REG_SFF) & 0x40) ? true : false;
-  _rxDlc = (readRegister(REG_SFF) & 0x0f);
-  _rxIndex = 0;
-
-  int dataReg;
-
-  if (_rxExtended) {
-    _rxId = (readRegister(REG_EFF + 1) << 21) |
-            (readRegister(REG_EFF + 2) << 13) |
-            (readRegister(REG_EFF + 3) << 5) |
-            (readRegister(REG_EFF + 4) >> 3);
-
-    dataReg = REG_EFF + 5;
-  } else {
-    _rxId = (readRegister(REG_SFF + 1) << 3) | ((readRegister(REG_SFF + 2) >> 5) & 0x07);
-
-    dataReg = REG_SFF + 3;
-  }
+  CANFrame frame;
+  unsigned long timestamp = micros();
 
-  if (_rxRtr) {
-    _rxLength = 0;
-  } else {
-    _rxLength = _rxDlc;
-
-    for (int i = 0; i < _rxLength; i++) {
-      _rxData[i] = readRegister(dataReg + i);
-    }
-  }
-
-  // release RX buffer
-  modifyRegister(REG_CMR, 0x04, 0x04);
+  readFrame(frame);
+  loadFrame(frame, timestamp);
 
   return _rxDlc;
 }
@@ -267,8 +257,23 @@ void ESP32SJA1000Class::onReceive(void(*callback)(int))
     _intrHandle = NULL;
   }
 
+  if (_decoderTask) {
+    vTaskDelete(_decoderTask);
+    _decoderTask = NULL;
+  }
+
   if (callback) {
-    esp_intr_alloc(ETS_CAN_INTR_SOURCE, 0, ESP32SJA1000Class::onInterrupt, this, &_intrHandle);
+    if (_captureCore >= 0) {
+      _pipeline.clear();
+
+      xTaskCreatePinnedToCore(ESP32SJA1000Class::decoderTask, "CAN decoder", ESP32_CAN_PIPELINE_STACK_SIZE,
+                              this, ESP32_CAN_PIPELINE_PRIORITY, &_decoderTask, _decoderCore);
+
+      // interrupts are serviced by the core that allocates them
+      esp_ipc_call_blocking(_captureCore, ESP32SJA1000Class::allocateInterrupt, this);
+    } else {
+      esp_intr_alloc(CONTROLLERS[_controller].intrSource, 0, ESP32SJA1000Class::onInterrupt, this, &_intrHandle);
+    }
   }
 }
 
@@ -348,12 +353,191 @@ int ESP32SJA1000Class::wakeup()
   return 1;
 }
 
+unsigned long ESP32SJA1000Class::errorFrameCount()
+{
+  if (!_intrHandle) {
+    // reading the interrupt register does not release received packets
+    handleErrors(readRegister(REG_IR));
+  }
+
+  return _errorFrames;
+}
+
+int ESP32SJA1000Class::errorState()
+{
+  if (readRegister(REG_SR) & 0x80) {
+    return CAN_BUS_OFF;
+  }
+
+  if (readRegister(REG_TXERR) >= 128 || readRegister(REG_RXERR) >= 128) {
+    return CAN_ERROR_PASSIVE;
+  }
+
+  return CAN_ERROR_ACTIVE;
+}
+
+int ESP32SJA1000Class::setBitRate(long baudRate)
+{
+  unsigned long start = micros();
+
+  // bus timing can only be written in reset mode, which keeps the
+  // acceptance filter and returns to the previous mode when it is left
+  uint8_t mode = readRegister(REG_MOD) & 0x1f;
+  modifyRegister(REG_MOD, 0x01, 0x01); // reset
+
+  uint8_t btr0 = readRegister(REG_BTR0);
+  uint8_t btr1 = readRegister(REG_BTR1);
+
+  int result = writeBitTiming(baudRate);
+  if (!result) {
+    writeRegister(REG_BTR0, btr0);
+    writeRegister(REG_BTR1, btr1);
+  }
+
+  modifyRegister(REG_MOD, 0x1f, mode);
+
+  _offlineTime = micros() - start;
+
+  return result;
+}
+
 void ESP32SJA1000Class::setPins(int rx, int tx)
 {
   _rxPin = (gpio_num_t)rx;
   _txPin = (gpio_num_t)tx;
 }
 
+int ESP32SJA1000Class::writeBitTiming(long baudRate)
+{
+  modifyRegister(REG_BTR0, 0xc0, 0x40); // SJW = 1
+  modifyRegister(REG_BTR1, 0x70, 0x10); // TSEG2 = 1
+
+  if (CONTROLLERS[_controller].clockFrequency != TABLE_CLOCK_FREQUENCY) {
+    if (!setBitTiming(CONTROLLERS[_controller].clockFrequency, baudRate)) {
+      return 0;
+    }
+  } else {
+    switch (baudRate) {
+      case (long)1000E3:
+        modifyRegister(REG_BTR1, 0x0f, 0x04);
+        modifyRegister(REG_BTR0, 0x3f, 4);
+        break;
+
+      case (long)500E3:
+        modifyRegister(REG_BTR1, 0x0f, 0x0c);
+        modifyRegister(REG_BTR0, 0x3f, 4);
+        break;
+
+      case (long)250E3:
+        modifyRegister(REG_BTR1, 0x0f, 0x0c);
+        modifyRegister(REG_BTR0, 0x3f, 9);
+        break;
+
+      case (long)200E3:
+        modifyRegister(REG_BTR1, 0x0f, 0x0c);
+        modifyRegister(REG_BTR0, 0x3f, 12);
+        break;
+
+      case (long)125E3:
+        modifyRegister(REG_BTR1, 0x0f, 0x0c);
+        modifyRegister(REG_BTR0, 0x3f, 19);
+        break;
+
+      case (long)100E3:
+        modifyRegister(REG_BTR1, 0x0f, 0x0c);
+        modifyRegister(REG_BTR0, 0x3f, 24);
+        break;
+
+      case (long)80E3:
+        modifyRegister(REG_BTR1, 0x0f, 0x0c);
+        modifyRegister(REG_BTR0, 0x3f, 30);
+        break;
+
+      case (long)50E3:
+        modifyRegister(REG_BTR1, 0x0f, 0x0c);
+        modifyRegister(REG_BTR0, 0x3f, 49);
+        break;
+
+/*
+   Due to limitations in ESP32 hardware and/or RTOS software, baudrate can't be lower than 50kbps.
+   See https://esp32.com/viewtopic.php?t=2142
+*/
+      default:
+        return 0;
+        break;
+    }
+  }
+
+  modifyRegister(REG_BTR1, 0x80, 0x80); // SAM = 1
+
+  return 1;
+}
+
+int ESP32SJA1000Class::setBitTiming(uint32_t clockFrequency, long baudRate)
+{
+  // same shape as the table: a time quantum of 2 * (BRP + 1) clocks, TSEG2 of 2
+  // and SJW of 1, with as many time quanta per bit as fit
+  if ((clockFrequency % baudRate) != 0) {
+    return 0;
+  }
+
+  long cycles = clockFrequency / baudRate;
+
+  for (int quanta = 19; quanta >= 8; quanta--) {
+    if ((cycles % (2 * quanta)) != 0) {
+      continue;
+    }
+
+    long brp = cycles / (2 * quanta) - 1;
+
+    if (brp > 63) {
+      break;
+    }
+
+    modifyRegister(REG_BTR1, 0x0f, quanta - 4);
+    modifyRegister(REG_BTR0, 0x3f, brp);
+
+    return 1;
+  }
+
+  return 0;
+}
+
+void ESP32SJA1000Class::setReceivePipeline(int captureCore, int decoderCore)
+{
+  // takes effect with the next onReceive(...), a negative core turns it off
+  if (captureCore < 0 || decoderCore < 0) {
+    _captureCore = -1;
+    _decoderCore = -1;
+  } else {
+    _captureCore = captureCore;
+    _decoderCore = decoderCore;
+  }
+}
+
+unsigned long ESP32SJA1000Class::pipelineDropped()
+{
+  return _pipelineDropped;
+}
+
+unsigned long ESP32SJA1000Class::pipelineLatencyMax(int stage)
+{
+  if (stage < CAN_PIPELINE_CAPTURE || stage > CAN_PIPELINE_DECODE) {
+    return 0;
+  }
+
+  return _pipelineLatency[stage].max;
+}
+
+unsigned long ESP32SJA1000Class::pipelineLatencyAverage(int stage)
+{
+  if (stage < CAN_PIPELINE_CAPTURE || stage > CAN_PIPELINE_DECODE || _pipelineLatency[stage].count == 0) {
+    return 0;
+  }
+
+  return _pipelineLatency[stage].total / _pipelineLatency[stage].count;
+}
+
 void ESP32SJA1000Class::dumpRegisters(Stream& out)
 {
   for (int i = 0; i < 32; i++) {
@@ -376,33 +560,133 @@ void ESP32SJA1000Class::handleInterrupt()
 {
   uint8_t ir = readRegister(REG_IR);
 
+  handleErrors(ir);
+
   if (ir & 0x01) {
-    // received packet, parse and call callback
-    parsePacket();
+    if (_decoderTask) {
+      // hand the packets over to the decoder task on the other core
+      captureFrames();
+    } else {
+      // received packet, parse and call callback
+      parsePacket();
+
+      _onReceive(available());
+    }
+  }
+}
+
+void ESP32SJA1000Class::handleErrors(uint8_t ir)
+{
+  if (ir & 0x80) {
+    // bus error, reading ECC lets the next one be captured
+    readRegister(REG_ECC);
+    _errorFrames++;
+  }
+}
+
+void ESP32SJA1000Class::captureFrames()
+{
+  BaseType_t woken = pdFALSE;
+
+  // drain the whole RX FIFO, the decoder only runs after the interrupt
+  while (readRegister(REG_SR) & 0x01) {
+    PipelineEntry entry;
 
+    entry.timestamp = micros();
+    readFrame(entry.frame);
+    entry.queued = micros();
+
+    recordLatency(CAN_PIPELINE_CAPTURE, entry.queued - entry.timestamp);
+
+    if (!_pipeline.push(entry)) {
+      _pipelineDropped++;
+    }
+  }
+
+  vTaskNotifyGiveFromISR(_decoderTask, &woken);
+
+  if (woken) {
+    portYIELD_FROM_ISR();
+  }
+}
+
+void ESP32SJA1000Class::decodeFrames()
+{
+  PipelineEntry entry;
+
+  while (_pipeline.pop(entry)) {
+    unsigned long start = micros();
+
+    recordLatency(CAN_PIPELINE_HANDOFF, start - entry.queued);
+
+    loadFrame(entry.frame, entry.timestamp);
     _onReceive(available());
+
+    recordLatency(CAN_PIPELINE_DECODE, micros() - start);
   }
 }
 
-uint8_t ESP32SJA1000Class::readRegister(uint8_t address)
+void ESP32SJA1000Class::readFrame(CANFrame& frame)
+{
+  bool extended = (readRegister(REG_SFF) & 0x80) ? true : false;
+  bool rtr = (readRegister(REG_SFF) & 0x40) ? true : false;
+  long id;
+  int dataReg;
+
+  if (extended) {
+    id = ((long)readRegister(REG_EFF + 1) << 21) |
+         ((long)readRegister(REG_EFF + 2) << 13) |
+         (readRegister(REG_EFF + 3) << 5) |
+         (readRegister(REG_EFF + 4) >> 3);
+
+    dataReg = REG_EFF + 5;
+  } else {
+    id = (readRegister(REG_SFF + 1) << 3) | ((readRegister(REG_SFF + 2) >> 5) & 0x07);
+
+    dataReg = REG_SFF + 3;
+  }
+
+  frame.setId(id, extended, rtr);
+  frame.dlc = (readRegister(REG_SFF) & 0x0f);
+  frame.bus = 0;
+  frame.filter = -1;
+  frame.reserved = 0;
+
+  int length = frame.packetLength();
+
+  for (int i = 0; i < length; i++) {
+    frame.data[i] = readRegister(dataReg + i);
+  }
+
+  // release RX buffer
+  modifyRegister(REG_CMR, 0x04, 0x04);
+}
+
+void ESP32SJA1000Class::recordLatency(int stage, unsigned long latency)
 {
-  volatile uint32_t* reg = (volatile uint32_t*)(REG_BASE + address * 4);
+  if (latency > _pipelineLatency[stage].max) {
+    _pipelineLatency[stage].max = latency;
+  }
+
+  _pipelineLatency[stage].total += latency;
+  _pipelineLatency[stage].count++;
+}
 
-  return *reg;
+uint8_t ESP32SJA1000Class::readRegister(uint8_t address)
+{
+  return REG_READ(_regBase + address * 4);
 }
 
 void ESP32SJA1000Class::modifyRegister(uint8_t address, uint8_t mask, uint8_t value)
 {
-  volatile uint32_t* reg = (volatile uint32_t*)(REG_BASE + address * 4);
+  uint32_t reg = _regBase + address * 4;
 
-  *reg = (*reg & ~mask) | value;
+  REG_WRITE(reg, (REG_READ(reg) & ~mask) | value);
 }
 
 void ESP32SJA1000Class::writeRegister(uint8_t address, uint8_t value)
 {
-  volatile uint32_t* reg = (volatile uint32_t*)(REG_BASE + address * 4);
-
-  *reg = value;
+  REG_WRITE(_regBase + address * 4, value);
 }
 
 void ESP32SJA1000Class::onInterrupt(void* arg)
@@ -410,6 +694,27 @@ void ESP32SJA1000Class::onInterrupt(void* arg)
   ((ESP32SJA1000Class*)arg)->handleInterrupt();
 }
 
+void ESP32SJA1000Class::allocateInterrupt(void* arg)
+{
+  ESP32SJA1000Class* self = (ESP32SJA1000Class*)arg;
+
+  esp_intr_alloc(CONTROLLERS[self->_controller].intrSource, 0, ESP32SJA1000Class::onInterrupt, self, &self->_intrHandle);
+}
+
+void ESP32SJA1000Class::decoderTask(void* arg)
+{
+  ESP32SJA1000Class* self = (ESP32SJA1000Class*)arg;
+
+  while (1) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    self->decodeFrames();
+  }
+}
+
 ESP32SJA1000Class CAN;
+#if ESP32_CAN_CONTROLLER_COUNT > 1
+ESP32SJA1000Class CAN1(1);
+#endif
 
 #endif
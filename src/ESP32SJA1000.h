@@ -6,15 +6,34 @@
 #ifndef ESP32_SJA1000_H
 #define ESP32_SJA1000_H
 
+#include "soc/soc.h"
+
 #include "CANController.h"
+#include "CANFrame.h"
+#include "CANRingBuffer.h"
 
 #define DEFAULT_CAN_RX_PIN GPIO_NUM_4
 #define DEFAULT_CAN_TX_PIN GPIO_NUM_5
 
+// parts with more than one TWAI controller name their register blocks TWAI0, TWAI1, ...
+#if defined(DR_REG_TWAI1_BASE)
+#define ESP32_CAN_CONTROLLER_COUNT       2
+#else
+#define ESP32_CAN_CONTROLLER_COUNT       1
+#endif
+
+#define ESP32_CAN_PIPELINE_SIZE          64
+#define ESP32_CAN_PIPELINE_STACK_SIZE    4096
+#define ESP32_CAN_PIPELINE_PRIORITY      5
+
+#define CAN_PIPELINE_CAPTURE             0
+#define CAN_PIPELINE_HANDOFF             1
+#define CAN_PIPELINE_DECODE              2
+
 class ESP32SJA1000Class : public CANControllerClass {
 
 public:
-  ESP32SJA1000Class();
+  ESP32SJA1000Class(int controller = 0);
   virtual ~ESP32SJA1000Class();
 
   virtual int begin(long baudRate);
@@ -36,29 +55,73 @@ public:
   virtual int sleep();
   virtual int wakeup();
 
+  virtual int setBitRate(long baudRate);
+
+  virtual unsigned long errorFrameCount();
+  virtual int errorState();
+
   void setPins(int rx, int tx);
 
+  void setReceivePipeline(int captureCore, int decoderCore);
+  unsigned long pipelineDropped();
+  unsigned long pipelineLatencyMax(int stage);
+  unsigned long pipelineLatencyAverage(int stage);
+
   void dumpRegisters(Stream& out);
 
 private:
   void reset();
 
   void handleInterrupt();
+  void handleErrors(uint8_t ir);
+  void captureFrames();
+  void decodeFrames();
+  void readFrame(CANFrame& frame);
+  void recordLatency(int stage, unsigned long latency);
+  int writeBitTiming(long baudRate);
+  int setBitTiming(uint32_t clockFrequency, long baudRate);
 
   uint8_t readRegister(uint8_t address);
   void modifyRegister(uint8_t address, uint8_t mask, uint8_t value);
   void writeRegister(uint8_t address, uint8_t value);
 
   static void onInterrupt(void* arg);
+  static void allocateInterrupt(void* arg);
+  static void decoderTask(void* arg);
 
 private:
+  int _controller;
+  uint32_t _regBase;
+
   gpio_num_t _rxPin;
   gpio_num_t _txPin;
   bool _loopback;
   intr_handle_t _intrHandle;
+  volatile unsigned long _errorFrames;
+
+  struct PipelineEntry {
+    CANFrame frame;
+    unsigned long timestamp;
+    unsigned long queued;
+  };
+
+  int _captureCore;
+  int _decoderCore;
+  TaskHandle_t _decoderTask;
+  CANRingBuffer<PipelineEntry, ESP32_CAN_PIPELINE_SIZE> _pipeline;
+  volatile unsigned long _pipelineDropped;
+
+  struct {
+    unsigned long max;
+    unsigned long total;
+    unsigned long count;
+  } _pipelineLatency[3];
 };
 
 extern ESP32SJA1000Class CAN;
+#if ESP32_CAN_CONTROLLER_COUNT > 1
+extern ESP32SJA1000Class CAN1;
+#endif
 
 #endif
 
@@ -8,23 +8,57 @@
 #define REG_BFPCTRL                0x0c
 #define REG_TXRTSCTRL              0x0d
 
+#define REG_CANSTAT                0x0e
 #define REG_CANCTRL                0x0f
 
+#define MASK_OPMOD                 0xe0
+#define MASK_REQOP                 0xe0
+
+#define MODE_NORMAL                0x00
+#define MODE_SLEEP                 0x20
+#define MODE_LOOPBACK              0x40
+#define MODE_LISTEN_ONLY           0x60
+#define MODE_CONFIG                0x80
+
+#define MODE_CHANGE_TIMEOUT        10
+
+// SPI clocks tried by setSPIFrequencyAuto(), fastest first
+static const uint32_t SPI_AUTO_FREQUENCIES[] = { 10000000, 8000000, 5000000, 4000000, 2000000, 1000000, 500000 };
+#define SPI_AUTO_FREQUENCY_COUNT   (int)(sizeof(SPI_AUTO_FREQUENCIES) / sizeof(SPI_AUTO_FREQUENCIES[0]))
+#define SPI_AUTO_REPEAT            4
+
+// data frame with no data bytes and no stuff bits, including intermission
+#define MIN_FRAME_BITS             47
+
 #define REG_CNF3                   0x28
 #define REG_CNF2                   0x29
 #define REG_CNF1                   0x2a
 
 #define REG_CANINTE                0x2b
 #define REG_CANINTF                0x2c
+#define REG_EFLG                   0x2d
+
+#define FLAG_MERRE                 0x80
+#define FLAG_MERRF                 0x80
+#define FLAG_ERRIE                 0x20
+#define FLAG_ERRIF                 0x20
+
+#define FLAG_RX1OVR                0x80
+#define FLAG_RX0OVR                0x40
+#define FLAG_TXBO                  0x20
+#define FLAG_TXEP                  0x10
+#define FLAG_RXEP                  0x08
 
 #define FLAG_RXnIE(n)              (0x01 << n)
 #define FLAG_RXnIF(n)              (0x01 << n)
+#define FLAG_TXnIE(n)              (0x04 << n)
 #define FLAG_TXnIF(n)              (0x04 << n)
 
-#define REG_RXFnSIDH(n)            (0x00 + (n * 4))
-#define REG_RXFnSIDL(n)            (0x01 + (n * 4))
-#define REG_RXFnEID8(n)            (0x02 + (n * 4))
-#define REG_RXFnEID0(n)            (0x03 + (n * 4))
+// RXF3 - RXF5 start at 0x10, after BFPCTRL, TXRTSCTRL, CANSTAT and CANCTRL
+#define REG_RXFnSIDH(n)            (0x00 + ((n + (n > 2)) * 4))
+#define REG_RXFnSIDL(n)            (0x01 + ((n + (n > 2)) * 4))
+#define REG_RXFnEID8(n)            (0x02 + ((n + (n > 2)) * 4))
+#define REG_RXFnEID0(n)            (0x03 + ((n + (n > 2)) * 4))
 
 #define REG_RXMnSIDH(n)            (0x20 + (n * 0x04))
 #define REG_RXMnSIDL(n)            (0x21 + (n * 0x04))
@@ -54,15 +88,35 @@
 
 #define FLAG_RXM0                  0x20
 #define FLAG_RXM1                  0x40
+#define FLAG_FILHIT0               0x01
+#define FLAG_FILHIT                0x07
+#define FLAG_BUKT                  0x04
 
 
 MCP2515Class::MCP2515Class() :
   CANControllerClass(),
   _spiSettings(10E6, MSBFIRST, SPI_MODE0),
+  _spiFrequency(10E6),
+  _spiFrequencyAutoMax(0),
   _csPin(MCP2515_DEFAULT_CS_PIN),
   _intPin(MCP2515_DEFAULT_INT_PIN),
-  _clockFrequency(MCP2515_DEFAULT_CLOCK_FREQUENCY)
+  _clockFrequency(MCP2515_DEFAULT_CLOCK_FREQUENCY),
+  _mode(MODE_NORMAL),
+  _errorFrames(0),
+  _overflows(0),
+  _interruptFalling(false),
+  _spuriousInterrupts(0),
+  _baudRate(0),
+  _spiShared(false),
+  _interruptDeferred(false),
+  _handlingInterrupt(false),
+  _deferredSince(0),
+  _spiWaitMax(0),
+  _spiWaitTotal(0),
+  _rtsMask(0)
 {
+  memset(_txStagedLength, 0x00, sizeof(_txStagedLength));
+  memset(_onFilter, 0x00, sizeof(_onFilter));
 }
 
 MCP2515Class::~MCP2515Class()
@@ -73,66 +127,44 @@ int MCP2515Class::begin(long baudRate)
 {
   CANControllerClass::begin(baudRate);
 
+  _rtsMask = 0;
+  memset(_txStagedLength, 0x00, sizeof(_txStagedLength));
+
+  _baudRate = baudRate;
+  _spiShared = false;
+  _interruptDeferred = false;
+  _spiWaitMax = 0;
+  _spiWaitTotal = 0;
+
   pinMode(_csPin, OUTPUT);
 
   // start SPI
   SPI.begin();
 
-  reset();
-
-  writeRegister(REG_CANCTRL, 0x80);
-  if (readRegister(REG_CANCTRL) != 0x80) {
-    return 0;
+  if (_spiFrequencyAutoMax) {
+    // reset at the slowest clock, the fastest one may not work at all
+    _spiSettings = SPISettings(SPI_AUTO_FREQUENCIES[SPI_AUTO_FREQUENCY_COUNT - 1], MSBFIRST, SPI_MODE0);
   }
 
-  const struct {
-    long clockFrequency;
-    long baudRate;
-    uint8_t cnf[3];
-  } CNF_MAPPER[] = {
-    {  (long)8E6, (long)1000E3, { 0x00, 0x80, 0x00 } },
-    {  (long)8E6,  (long)500E3, { 0x00, 0x90, 0x02 } },
-    {  (long)8E6,  (long)250E3, { 0x00, 0xb1, 0x05 } },
-    {  (long)8E6,  (long)200E3, { 0x00, 0xb4, 0x06 } },
-    {  (long)8E6,  (long)125E3, { 0x01, 0xb1, 0x05 } },
-    {  (long)8E6,  (long)100E3, { 0x01, 0xb4, 0x06 } },
-    {  (long)8E6,   (long)80E3, { 0x01, 0xbf, 0x07 } },
-    {  (long)8E6,   (long)50E3, { 0x03, 0xb4, 0x06 } },
-    {  (long)8E6,   (long)40E3, { 0x03, 0xbf, 0x07 } },
-    {  (long)8E6,   (long)20E3, { 0x07, 0xbf, 0x07 } },
-    {  (long)8E6,   (long)10E3, { 0x0f, 0xbf, 0x07 } },
-    {  (long)8E6,    (long)5E3, { 0x1f, 0xbf, 0x07 } },
-
-    { (long)16E6, (long)1000E3, { 0x00, 0xd0, 0x82 } },
-    { (long)16E6,  (long)500E3, { 0x00, 0xf0, 0x86 } },
-    { (long)16E6,  (long)250E3, { 0x41, 0xf1, 0x85 } },
-    { (long)16E6,  (long)200E3, { 0x01, 0xfa, 0x87 } },
-    { (long)16E6,  (long)125E3, { 0x03, 0xf0, 0x86 } },
-    { (long)16E6,  (long)100E3, { 0x03, 0xfa, 0x87 } },
-    { (long)16E6,   (long)80E3, { 0x03, 0xff, 0x87 } },
-    { (long)16E6,   (long)50E3, { 0x07, 0xfa, 0x87 } },
-    { (long)16E6,   (long)40E3, { 0x07, 0xff, 0x87 } },
-    { (long)16E6,   (long)20E3, { 0x0f, 0xff, 0x87 } },
-    { (long)16E6,   (long)10E3, { 0x1f, 0xff, 0x87 } },
-    { (long)16E6,    (long)5E3, { 0x3f, 0xff, 0x87 } },
-  };
+  reset();
 
-  const uint8_t* cnf = NULL;
+  _mode = MODE_NORMAL;
+  _offlineTime = 0;
+  _errorFrames = 0;
+  _overflows = 0;
+  _spuriousInterrupts = 0;
 
-  for (unsigned int i = 0; i < (sizeof(CNF_MAPPER) / sizeof(CNF_MAPPER[0])); i++) {
-    if (CNF_MAPPER[i].clockFrequency == _clockFrequency && CNF_MAPPER[i].baudRate == baudRate) {
-      cnf = CNF_MAPPER[i].cnf;
-      break;
-    }
+  if (!setMode(MODE_CONFIG)) {
+    return 0;
   }
 
-  if (cnf == NULL) {
+  if (_spiFrequencyAutoMax && !qualifySPIFrequency()) {
     return 0;
   }
 
-  writeRegister(REG_CNF1, cnf[0]);
-  writeRegister(REG_CNF2, cnf[1]);
-  writeRegister(REG_CNF3, cnf[2]);
+  if (!writeBitTiming(baudRate)) {
+    return 0;
+  }
 
   writeRegister(REG_CANINTE, FLAG_RXnIE(1) | FLAG_RXnIE(0));
   writeRegister(REG_BFPCTRL, 0x00);
@@ -140,8 +172,12 @@ int MCP2515Class::begin(long baudRate)
   writeRegister(REG_RXBnCTRL(0), FLAG_RXM1 | FLAG_RXM0);
   writeRegister(REG_RXBnCTRL(1), FLAG_RXM1 | FLAG_RXM0);
 
-  writeRegister(REG_CANCTRL, 0x00);
-  if (readRegister(REG_CANCTRL) != 0x00) {
+  // filters and masks are cleared by the reset
+  memset(&_filterRegs, 0x00, sizeof(_filterRegs));
+  _filterRegs.rxm[0] = FLAG_RXM1 | FLAG_RXM0;
+  _filterRegs.rxm[1] = FLAG_RXM1 | FLAG_RXM0;
+
+  if (!setMode(MODE_NORMAL)) {
     return 0;
   }
 
@@ -161,29 +197,18 @@ int MCP2515Class::endPacket()
     return 0;
   }
 
+  // buffers armed for the TXnRTS pins are left alone
   int n = 0;
 
-  if (_txExtended) {
-    writeRegister(REG_TXBnSIDH(n), _txId >> 21);
-    writeRegister(REG_TXBnSIDL(n), (((_txId >> 18) & 0x07) << 5) | FLAG_EXIDE | ((_txId >> 16) & 0x03));
-    writeRegister(REG_TXBnEID8(n), (_txId >> 8) & 0xff);
-    writeRegister(REG_TXBnEID0(n), _txId & 0xff);
-  } else {
-    writeRegister(REG_TXBnSIDH(n), _txId >> 3);
-    writeRegister(REG_TXBnSIDL(n), _txId << 5);
-    writeRegister(REG_TXBnEID8(n), 0x00);
-    writeRegister(REG_TXBnEID0(n), 0x00);
+  while (_rtsMask & (1 << n)) {
+    if (++n == 3) {
+      return 0;
+    }
   }
 
-  if (_txRtr) {
-    writeRegister(REG_TXBnDLC(n), 0x40 | _txLength);
-  } else {
-    writeRegister(REG_TXBnDLC(n), _txLength);
+  uint8_t regs[13];
 
-    for (int i = 0; i < _txLength; i++) {
-      writeRegister(REG_TXBnD0(n) + i, _txData[i]);
-    }
-  }
+  loadTxBuffer(n, regs, packTxBuffer(regs));
 
   writeRegister(REG_TXBnCTRL(n), 0x08);
 
@@ -200,6 +225,8 @@ int MCP2515Class::endPacket()
     yield();
   }
 
+  _txTimestamp = micros();
+
   if (aborted) {
     // clear abort command
     modifyRegister(REG_CANCTRL, 0x10, 0x00);
@@ -210,12 +237,76 @@ int MCP2515Class::endPacket()
   return (readRegister(REG_TXBnCTRL(n)) & 0x70) ? 0 : 1;
 }
 
+int MCP2515Class::armPacket(int n)
+{
+  if (n < 0 || n > 2 || !CANControllerClass::endPacket()) {
+    return 0;
+  }
+
+  if (!(_rtsMask & (1 << n)) && !setRTSMask(_rtsMask | (1 << n))) {
+    return 0;
+  }
+
+  // the TX complete interrupt reloads from the staged frame, keep it out
+  // until the frame is complete and loaded or left for it, unless this is
+  // called from the callback in it
+  bool masked = _onReceive && !_handlingInterrupt;
+
+  if (masked) {
+    detachInterrupt(digitalPinToInterrupt(_intPin));
+  }
+
+  _txStagedLength[n] = packTxBuffer(_txStaged[n]);
+
+  if (!(readRegister(REG_TXBnCTRL(n)) & 0x08)) {
+    loadStagedTxBuffer(n);
+  }
+
+  if (masked) {
+    reattachIntPin();
+  }
+
+  return 1;
+}
+
+int MCP2515Class::disarmPacket(int n)
+{
+  if (n < 0 || n > 2) {
+    return 0;
+  }
+
+  bool masked = _onReceive && !_handlingInterrupt;
+
+  if (masked) {
+    detachInterrupt(digitalPinToInterrupt(_intPin));
+  }
+
+  _txStagedLength[n] = 0;
+
+  modifyRegister(REG_TXBnCTRL(n), 0x08, 0x00);
+
+  if (masked) {
+    reattachIntPin();
+  }
+
+  return setRTSMask(_rtsMask & ~(1 << n));
+}
+
 int MCP2515Class::parsePacket()
 {
   int n;
 
   uint8_t intf = readRegister(REG_CANINTF);
 
+  if (intf & (FLAG_MERRF | FLAG_ERRIF)) {
+    handleErrors(intf);
+  }
+
+  // without a callback there is no interrupt to reload armed buffers
+  if (!_onReceive) {
+    handleTxComplete(intf);
+  }
+
   if (intf & FLAG_RXnIF(0)) {
     n = 0;
   } else if (intf & FLAG_RXnIF(1)) {
@@ -225,37 +316,11 @@ int MCP2515Class::parsePacket()
     _rxExtended = false;
     _rxRtr = false;
     _rxLength = 0;
+    _rxFilter = -1;
     return 0;
   }
 
-  _rxExtended = (readRegister(REG_RXBnSIDL(n)) & FLAG_IDE) ? true : false;
-
-  uint32_t idA = ((readRegister(REG_RXBnSIDH(n)) << 3) & 0x07f8) | ((readRegister(REG_RXBnSIDL(n)) >> 5) & 0x07);
-  if (_rxExtended) {
-    uint32_t idB = (((uint32_t)(readRegister(REG_RXBnSIDL(n)) & 0x03) << 16) & 0x30000) | ((readRegister(REG_RXBnEID8(n)) << 8) & 0xff00) | readRegister(REG_RXBnEID0(n));
-
-    _rxId = (idA << 18) | idB;
-    _rxRtr = (readRegister(REG_RXBnDLC(n)) & FLAG_RTR) ? true : false;
-  } else {
-    _rxId = idA;
-    _rxRtr = (readRegister(REG_RXBnSIDL(n)) & FLAG_SRR) ? true : false;
-  }
-  _rxDlc = readRegister(REG_RXBnDLC(n)) & 0x0f;
-  _rxIndex = 0;
-
-  if (_rxRtr) {
-    _rxLength = 0;
-  } else {
-    _rxLength = _rxDlc;
-
-    for (int i = 0; i < _rxLength; i++) {
-      _rxData[i] = readRegister(REG_RXBnD0(n) + i);
-    }
-  }
-
-  modifyRegister(REG_CANINTF, FLAG_RXnIF(n), 0x00);
-
-  return _rxDlc;
+  return readRxBuffer(n);
 }
 
 void MCP2515Class::onReceive(void(*callback)(int))
@@ -268,7 +333,7 @@ void MCP2515Class::onReceive(void(*callback)(int))
 #ifndef ESP8266
     SPI.usingInterrupt(digitalPinToInterrupt(_intPin));
 #endif
-    attachInterrupt(digitalPinToInterrupt(_intPin), MCP2515Class::onInterrupt, LOW);
+    attachIntPin();
   } else {
     detachInterrupt(digitalPinToInterrupt(_intPin));
 #ifdef SPI_HAS_NOTUSINGINTERRUPT
@@ -277,201 +342,907 @@ void MCP2515Class::onReceive(void(*callback)(int))
   }
 }
 
-int MCP2515Class::filter(int id, int mask)
+int MCP2515Class::setInterruptMode(int mode)
 {
-  id &= 0x7ff;
-  mask &= 0x7ff;
-
-  // config mode
-  writeRegister(REG_CANCTRL, 0x80);
-  if (readRegister(REG_CANCTRL) != 0x80) {
+  if (mode != LOW && mode != FALLING) {
     return 0;
   }
 
-  for (int n = 0; n < 2; n++) {
-    // standard only
-    writeRegister(REG_RXBnCTRL(n), FLAG_RXM0);
-    writeRegister(REG_RXBnCTRL(n), FLAG_RXM0);
+  _interruptFalling = (mode == FALLING);
 
-    writeRegister(REG_RXMnSIDH(n), mask >> 3);
-    writeRegister(REG_RXMnSIDL(n), mask << 5);
-    writeRegister(REG_RXMnEID8(n), 0);
-    writeRegister(REG_RXMnEID0(n), 0);
+  if (_onReceive) {
+    attachIntPin();
   }
 
-  for (int n = 0; n < 6; n++) {
-    writeRegister(REG_RXFnSIDH(n), id >> 3);
-    writeRegister(REG_RXFnSIDL(n), id << 5);
-    writeRegister(REG_RXFnEID8(n), 0);
-    writeRegister(REG_RXFnEID0(n), 0);
-  }
+  return 1;
+}
 
-  // normal mode
-  writeRegister(REG_CANCTRL, 0x00);
-  if (readRegister(REG_CANCTRL) != 0x00) {
-    return 0;
+void MCP2515Class::attachIntPin()
+{
+  // some cores take a PinStatus rather than an int for the mode
+  if (_interruptFalling) {
+    attachInterrupt(digitalPinToInterrupt(_intPin), MCP2515Class::onInterrupt, FALLING);
+  } else {
+    attachInterrupt(digitalPinToInterrupt(_intPin), MCP2515Class::onInterrupt, LOW);
   }
-
-  return 1;
 }
 
-int MCP2515Class::filterExtended(long id, long mask)
+void MCP2515Class::reattachIntPin()
 {
-  id &= 0x1FFFFFFF;
-  mask &= 0x1FFFFFFF;
+  attachIntPin();
 
-  // config mode
-  writeRegister(REG_CANCTRL, 0x80);
-  if (readRegister(REG_CANCTRL) != 0x80) {
-    return 0;
-  }
+  // an edge while the pin was detached is lost in FALLING mode, while INT is
+  // asserted run the handler with the pin detached and interrupts enabled,
+  // as serviceDeferred() does, and check again once attached
+  while (_interruptFalling && digitalRead(_intPin) == LOW) {
+    unsigned long spurious = _spuriousInterrupts;
 
-  for (int n = 0; n < 2; n++) {
-    // extended only
-    writeRegister(REG_RXBnCTRL(n), FLAG_RXM1);
-    writeRegister(REG_RXBnCTRL(n), FLAG_RXM1);
+    detachInterrupt(digitalPinToInterrupt(_intPin));
+    handleInterrupt();
 
-    writeRegister(REG_RXMnSIDH(n), mask >> 21);
-    writeRegister(REG_RXMnSIDL(n), (((mask >> 18) & 0x03) << 5) | FLAG_EXIDE | ((mask >> 16) & 0x03));
-    writeRegister(REG_RXMnEID8(n), (mask >> 8) & 0xff);
-    writeRegister(REG_RXMnEID0(n), mask & 0xff);
-  }
+    if (_interruptDeferred) {
+      // another device owns the bus, yieldSPI() reattaches
+      return;
+    }
 
-  for (int n = 0; n < 6; n++) {
-    writeRegister(REG_RXFnSIDH(n), id >> 21);
-    writeRegister(REG_RXFnSIDL(n), (((id >> 18) & 0x03) << 5) | FLAG_EXIDE | ((id >> 16) & 0x03));
-    writeRegister(REG_RXFnEID8(n), (id >> 8) & 0xff);
-    writeRegister(REG_RXFnEID0(n), id & 0xff);
-  }
+    attachIntPin();
 
-  // normal mode
-  writeRegister(REG_CANCTRL, 0x00);
-  if (readRegister(REG_CANCTRL) != 0x00) {
-    return 0;
+    if (_spuriousInterrupts != spurious) {
+      // INT is held by a flag the handler doesn't service
+      break;
+    }
   }
+}
 
-  return 1;
+void MCP2515Class::beginSPIShare()
+{
+  _spiShared = true;
 }
 
-int MCP2515Class::observe()
+void MCP2515Class::endSPIShare()
 {
-  writeRegister(REG_CANCTRL, 0x80);
-  if (readRegister(REG_CANCTRL) != 0x80) {
-    return 0;
-  }
+  // from here on the handler may use the bus, so no interrupt can be
+  // deferred after the check below
+  noInterrupts();
+  _spiShared = false;
+  interrupts();
 
-  return 1;
+  serviceDeferred();
 }
 
-int MCP2515Class::loopback()
+int MCP2515Class::yieldSPI()
 {
-  writeRegister(REG_CANCTRL, 0x40);
-  if (readRegister(REG_CANCTRL) != 0x40) {
+  if (!_interruptDeferred) {
     return 0;
   }
 
+  // the caller has released the bus, so the handler may use it
+  _spiShared = false;
+
+  serviceDeferred();
+
+  noInterrupts();
+  _spiShared = true;
+  interrupts();
+
   return 1;
 }
 
-int MCP2515Class::sleep()
+void MCP2515Class::serviceDeferred()
 {
-  writeRegister(REG_CANCTRL, 0x01);
-  if (readRegister(REG_CANCTRL) != 0x01) {
-    return 0;
+  noInterrupts();
+  bool deferred = _interruptDeferred;
+  _interruptDeferred = false;
+  interrupts();
+
+  if (!deferred) {
+    return;
   }
 
-  return 1;
+  unsigned long wait = micros() - _deferredSince;
+
+  if (wait > _spiWaitMax) {
+    _spiWaitMax = wait;
+  }
+  _spiWaitTotal += wait;
+
+  handleInterrupt();
+
+  if (_onReceive) {
+    reattachIntPin();
+  }
 }
 
-int MCP2515Class::wakeup()
+long MCP2515Class::spiHoldBudget()
 {
-  writeRegister(REG_CANCTRL, 0x00);
-  if (readRegister(REG_CANCTRL) != 0x00) {
+  if (_baudRate <= 0) {
     return 0;
   }
 
-  return 1;
+  // two RX buffers, each holds at least one frame time of the shortest frame
+  long frameTime = (MIN_FRAME_BITS * 1000000L) / _baudRate;
+
+  if (!_interruptDeferred) {
+    return 2 * frameTime;
+  }
+
+  long budget = frameTime - (long)(micros() - _deferredSince);
+
+  return (budget < 0) ? 0 : budget;
 }
 
-void MCP2515Class::setPins(int cs, int irq)
+unsigned long MCP2515Class::spiWaitMax()
 {
-  _csPin = cs;
-  _intPin = irq;
+  return _spiWaitMax;
 }
 
-void MCP2515Class::setSPIFrequency(uint32_t frequency)
+unsigned long MCP2515Class::spiWaitTotal()
 {
-  _spiSettings = SPISettings(frequency, MSBFIRST, SPI_MODE0);
+  return _spiWaitTotal;
 }
 
-void MCP2515Class::setClockFrequency(long clockFrequency)
+unsigned long MCP2515Class::spuriousInterrupts()
 {
-  _clockFrequency = clockFrequency;
+  return _spuriousInterrupts;
 }
 
-void MCP2515Class::dumpRegisters(Stream& out)
+int MCP2515Class::readRxBuffer(int n)
 {
-  for (int i = 0; i < 128; i++) {
-    byte b = readRegister(i);
+  _rxTimestamp = micros();
 
-    out.print("0x");
-    if (i < 16) {
-      out.print('0');
-    }
-    out.print(i, HEX);
-    out.print(": 0x");
-    if (b < 16) {
-      out.print('0');
-    }
-    out.println(b, HEX);
+  uint8_t ctrl = readRegister(REG_RXBnCTRL(n));
+
+  // FILHIT, a frame rolled over from RXB0 reports filter 0 or 1, a buffer
+  // receiving any packet doesn't use the filters
+  if ((ctrl & (FLAG_RXM1 | FLAG_RXM0)) == (FLAG_RXM1 | FLAG_RXM0)) {
+    _rxFilter = -1;
+  } else {
+    _rxFilter = ctrl & ((n == 0) ? FLAG_FILHIT0 : FLAG_FILHIT);
   }
-}
 
-void MCP2515Class::reset()
-{
+  // RXBnSIDH, RXBnSIDL, RXBnEID8, RXBnEID0 and RXBnDLC
+  uint8_t regs[5];
+
   SPI.beginTransaction(_spiSettings);
   digitalWrite(_csPin, LOW);
-  SPI.transfer(0xc0);
+  SPI.transfer(0x90 | (n << 2)); // READ RX BUFFER, starting at RXBnSIDH
+  for (int i = 0; i < 5; i++) {
+    regs[i] = SPI.transfer(0x00);
+  }
+
+  _rxExtended = (regs[1] & FLAG_IDE) ? true : false;
+
+  uint32_t idA = ((regs[0] << 3) & 0x07f8) | ((regs[1] >> 5) & 0x07);
+  if (_rxExtended) {
+    uint32_t idB = (((uint32_t)(regs[1] & 0x03) << 16) & 0x30000) | ((regs[2] << 8) & 0xff00) | regs[3];
+
+    _rxId = (idA << 18) | idB;
+    _rxRtr = (regs[4] & FLAG_RTR) ? true : false;
+  } else {
+    _rxId = idA;
+    _rxRtr = (regs[1] & FLAG_SRR) ? true : false;
+  }
+  _rxDlc = regs[4] & 0x0f;
+  _rxIndex = 0;
+
+  if (_rxRtr) {
+    _rxLength = 0;
+  } else {
+    _rxLength = (_rxDlc > 8) ? 8 : _rxDlc;
+
+    for (int i = 0; i < _rxLength; i++) {
+      _rxData[i] = SPI.transfer(0x00);
+    }
+  }
+
+  // raising CS after READ RX BUFFER clears RXnIF
   digitalWrite(_csPin, HIGH);
   SPI.endTransaction();
 
-  delayMicroseconds(10);
+  return _rxDlc;
 }
 
-void MCP2515Class::handleInterrupt()
+void MCP2515Class::onFilter(int n, void(*callback)(int))
 {
-  if (readRegister(REG_CANINTF) == 0) {
-    return;
+  if (n >= 0 && n < 6) {
+    _onFilter[n] = callback;
+  }
+}
+
+int MCP2515Class::setFilter(int n, long id, bool extended)
+{
+  if (n < 0 || n > 5) {
+    return 0;
   }
 
-  while (parsePacket()) {
-    _onReceive(available());
+  FilterRegisters regs = _filterRegs;
+  int m = n < 2 ? 0 : 1;
+  static const uint8_t unset[4] = { 0x00, 0x00, 0x00, 0x00 };
+
+  // RXF0 and RXF1 belong to RXB0, RXF2 - RXF5 to RXB1, both take standard and extended frames
+  regs.rxm[m] = 0x00;
+  packFilterId(regs.filter[n], id, extended);
+
+  if (memcmp(regs.mask[m], unset, 4) == 0) {
+    // a mask of 0 lets every packet through, compare the whole id until setMask()
+    packFilterId(regs.mask[m], extended ? 0x1fffffff : 0x7ff, extended);
   }
+
+  return writeFilters(regs);
 }
 
-uint8_t MCP2515Class::readRegister(uint8_t address)
+int MCP2515Class::setMask(int n, long mask, bool extended)
 {
-  uint8_t value;
+  if (n < 0 || n > 1) {
+    return 0;
+  }
 
-  SPI.beginTransaction(_spiSettings);
-  digitalWrite(_csPin, LOW);
-  SPI.transfer(0x03);
-  SPI.transfer(address);
-  value = SPI.transfer(0x00);
-  digitalWrite(_csPin, HIGH);
-  SPI.endTransaction();
+  FilterRegisters regs = _filterRegs;
 
-  return value;
+  packFilterId(regs.mask[n], mask, extended);
+
+  return writeFilters(regs);
 }
 
-void MCP2515Class::modifyRegister(uint8_t address, uint8_t mask, uint8_t value)
+int MCP2515Class::filter(int id, int mask)
 {
-  SPI.beginTransaction(_spiSettings);
-  digitalWrite(_csPin, LOW);
-  SPI.transfer(0x05);
-  SPI.transfer(address);
-  SPI.transfer(mask);
-  SPI.transfer(value);
+  FilterRegisters regs;
+
+  for (int n = 0; n < 2; n++) {
+    // standard only
+    regs.rxm[n] = FLAG_RXM0;
+
+    packFilterId(regs.mask[n], mask, false);
+  }
+
+  for (int n = 0; n < 6; n++) {
+    packFilterId(regs.filter[n], id, false);
+  }
+
+  return writeFilters(regs);
+}
+
+int MCP2515Class::filterExtended(long id, long mask)
+{
+  FilterRegisters regs;
+
+  for (int n = 0; n < 2; n++) {
+    // extended only
+    regs.rxm[n] = FLAG_RXM1;
+
+    packFilterId(regs.mask[n], mask, true);
+  }
+
+  for (int n = 0; n < 6; n++) {
+    packFilterId(regs.filter[n], id, true);
+  }
+
+  return writeFilters(regs);
+}
+
+int MCP2515Class::observe()
+{
+  if (_mode != MODE_LISTEN_ONLY) {
+    // what is changed below, put back when leaving listen only mode
+    _listenRestore.rxm[0] = _filterRegs.rxm[0];
+    _listenRestore.rxm[1] = _filterRegs.rxm[1];
+    _listenRestore.bukt = readRegister(REG_RXBnCTRL(0)) & FLAG_BUKT;
+    _listenRestore.inte = readRegister(REG_CANINTE) & (FLAG_MERRE | FLAG_ERRIE);
+  }
+
+  if (!setMode(MODE_LISTEN_ONLY)) {
+    return 0;
+  }
+
+  _mode = MODE_LISTEN_ONLY;
+
+  // receive any frame, with RXB0 rolling over into RXB1 so back to back frames fit
+  for (int n = 0; n < 2; n++) {
+    modifyRegister(REG_RXBnCTRL(n), FLAG_RXM1 | FLAG_RXM0, FLAG_RXM1 | FLAG_RXM0);
+    _filterRegs.rxm[n] = FLAG_RXM1 | FLAG_RXM0;
+  }
+  modifyRegister(REG_RXBnCTRL(0), FLAG_BUKT, FLAG_BUKT);
+
+  modifyRegister(REG_CANINTE, FLAG_MERRE | FLAG_ERRIE, FLAG_MERRE | FLAG_ERRIE);
+
+  return 1;
+}
+
+int MCP2515Class::loopback()
+{
+  if (!setMode(MODE_LOOPBACK)) {
+    return 0;
+  }
+
+  leaveListenOnly();
+  _mode = MODE_LOOPBACK;
+
+  return 1;
+}
+
+int MCP2515Class::sleep()
+{
+  if (!setMode(MODE_SLEEP)) {
+    return 0;
+  }
+
+  leaveListenOnly();
+  _mode = MODE_SLEEP;
+
+  return 1;
+}
+
+int MCP2515Class::wakeup()
+{
+  if (!setMode(MODE_NORMAL)) {
+    return 0;
+  }
+
+  leaveListenOnly();
+  _mode = MODE_NORMAL;
+
+  return 1;
+}
+
+void MCP2515Class::leaveListenOnly()
+{
+  if (_mode != MODE_LISTEN_ONLY) {
+    return;
+  }
+
+  for (int n = 0; n < 2; n++) {
+    if (_filterRegs.rxm[n] != _listenRestore.rxm[n]) {
+      modifyRegister(REG_RXBnCTRL(n), FLAG_RXM1 | FLAG_RXM0, _listenRestore.rxm[n]);
+      _filterRegs.rxm[n] = _listenRestore.rxm[n];
+    }
+  }
+
+  modifyRegister(REG_RXBnCTRL(0), FLAG_BUKT, _listenRestore.bukt);
+  modifyRegister(REG_CANINTE, FLAG_MERRE | FLAG_ERRIE, _listenRestore.inte);
+}
+
+unsigned long MCP2515Class::errorFrameCount()
+{
+  return _errorFrames;
+}
+
+int MCP2515Class::errorState()
+{
+  uint8_t eflg = readRegister(REG_EFLG);
+
+  if (eflg & FLAG_TXBO) {
+    return CAN_BUS_OFF;
+  }
+
+  if (eflg & (FLAG_TXEP | FLAG_RXEP)) {
+    return CAN_ERROR_PASSIVE;
+  }
+
+  return CAN_ERROR_ACTIVE;
+}
+
+unsigned long MCP2515Class::overflowCount()
+{
+  return _overflows;
+}
+
+void MCP2515Class::setPins(int cs, int irq)
+{
+  _csPin = cs;
+  _intPin = irq;
+}
+
+void MCP2515Class::setSPIFrequency(uint32_t frequency)
+{
+  _spiSettings = SPISettings(frequency, MSBFIRST, SPI_MODE0);
+  _spiFrequency = frequency;
+  _spiFrequencyAutoMax = 0;
+}
+
+void MCP2515Class::setSPIFrequencyAuto(uint32_t maxFrequency)
+{
+  _spiFrequencyAutoMax = maxFrequency;
+}
+
+uint32_t MCP2515Class::spiFrequency()
+{
+  return _spiFrequency;
+}
+
+void MCP2515Class::setClockFrequency(long clockFrequency)
+{
+  _clockFrequency = clockFrequency;
+}
+
+int MCP2515Class::setBitRate(long baudRate)
+{
+  if (!waitForTransmit()) {
+    return 0;
+  }
+
+  unsigned long start = micros();
+
+  if (!setMode(MODE_CONFIG)) {
+    return 0;
+  }
+
+  // filters, masks and interrupt enables are kept in config mode, only the
+  // bit timing changes
+  int result = writeBitTiming(baudRate);
+  if (result) {
+    _baudRate = baudRate;
+  }
+
+  if (!setMode(_mode)) {
+    result = 0;
+  }
+
+  _offlineTime = micros() - start;
+
+  return result;
+}
+
+void MCP2515Class::dumpRegisters(Stream& out)
+{
+  for (int i = 0; i < 128; i++) {
+    byte b = readRegister(i);
+
+    out.print("0x");
+    if (i < 16) {
+      out.print('0');
+    }
+    out.print(i, HEX);
+    out.print(": 0x");
+    if (b < 16) {
+      out.print('0');
+    }
+    out.println(b, HEX);
+  }
+}
+
+void MCP2515Class::reset()
+{
+  SPI.beginTransaction(_spiSettings);
+  digitalWrite(_csPin, LOW);
+  SPI.transfer(0xc0);
+  digitalWrite(_csPin, HIGH);
+  SPI.endTransaction();
+
+  delayMicroseconds(10);
+}
+
+void MCP2515Class::handleInterrupt()
+{
+  if (_spiShared) {
+    // another device owns the bus, service the controller at the next yieldSPI()
+    if (!_interruptDeferred) {
+      _interruptDeferred = true;
+      _deferredSince = micros();
+    }
+
+    detachInterrupt(digitalPinToInterrupt(_intPin));
+    return;
+  }
+
+  _handlingInterrupt = true;
+
+  uint8_t enabled = FLAG_RXnIF(0) | FLAG_RXnIF(1) | FLAG_MERRF | FLAG_ERRIF;
+
+  for (int n = 0; n < 3; n++) {
+    if (_rtsMask & (1 << n)) {
+      enabled |= FLAG_TXnIF(n);
+    }
+  }
+
+  bool handled = false;
+
+  // one CANINTF read per pass covers RX, TX and errors, keep going until INT
+  // is released, or an edge would be lost in FALLING mode
+  do {
+    uint8_t intf = readRegister(REG_CANINTF) & enabled;
+
+    if (intf == 0) {
+      break;
+    }
+
+    handled = true;
+
+    if (intf & (FLAG_MERRF | FLAG_ERRIF)) {
+      handleErrors(intf);
+    }
+
+    handleTxComplete(intf);
+
+    for (int n = 0; n < 2; n++) {
+      if (intf & FLAG_RXnIF(n)) {
+        readRxBuffer(n);
+
+        // a filter with its own callback needs no id compare
+        if (_rxFilter >= 0 && _onFilter[_rxFilter]) {
+          _onFilter[_rxFilter](available());
+        } else {
+          _onReceive(available());
+        }
+      }
+    }
+  } while (digitalRead(_intPin) == LOW);
+
+  _handlingInterrupt = false;
+
+  if (!handled) {
+    _spuriousInterrupts++;
+  }
+}
+
+uint8_t MCP2515Class::readRegister(uint8_t address)
+{
+  uint8_t value;
+
+  SPI.beginTransaction(_spiSettings);
+  digitalWrite(_csPin, LOW);
+  SPI.transfer(0x03);
+  SPI.transfer(address);
+  value = SPI.transfer(0x00);
+  digitalWrite(_csPin, HIGH);
+  SPI.endTransaction();
+
+  return value;
+}
+
+void MCP2515Class::modifyRegister(uint8_t address, uint8_t mask, uint8_t value)
+{
+  SPI.beginTransaction(_spiSettings);
+  digitalWrite(_csPin, LOW);
+  SPI.transfer(0x05);
+  SPI.transfer(address);
+  SPI.transfer(mask);
+  SPI.transfer(value);
+  digitalWrite(_csPin, HIGH);
+  SPI.endTransaction();
+}
+
+int MCP2515Class::packTxBuffer(uint8_t* regs)
+{
+  // TXBnSIDH, TXBnSIDL, TXBnEID8, TXBnEID0, TXBnDLC and TXBnD0 - TXBnD7
+  if (_txExtended) {
+    regs[0] = _txId >> 21;
+    regs[1] = (((_txId >> 18) & 0x07) << 5) | FLAG_EXIDE | ((_txId >> 16) & 0x03);
+    regs[2] = (_txId >> 8) & 0xff;
+    regs[3] = _txId & 0xff;
+  } else {
+    regs[0] = _txId >> 3;
+    regs[1] = _txId << 5;
+    regs[2] = 0x00;
+    regs[3] = 0x00;
+  }
+
+  if (_txRtr) {
+    regs[4] = 0x40 | _txLength;
+
+    return 5;
+  }
+
+  regs[4] = _txLength;
+  memcpy(&regs[5], _txData, _txLength);
+
+  return 5 + _txLength;
+}
+
+void MCP2515Class::loadTxBuffer(int n, const uint8_t* regs, int length)
+{
+  SPI.beginTransaction(_spiSettings);
+  digitalWrite(_csPin, LOW);
+  SPI.transfer(0x40 | (n << 1)); // LOAD TX BUFFER, starting at TXBnSIDH
+  for (int i = 0; i < length; i++) {
+    SPI.transfer(regs[i]);
+  }
+  digitalWrite(_csPin, HIGH);
+  SPI.endTransaction();
+}
+
+void MCP2515Class::loadStagedTxBuffer(int n)
+{
+  int length = _txStagedLength[n];
+
+  if (length) {
+    _txStagedLength[n] = 0;
+
+    loadTxBuffer(n, _txStaged[n], length);
+  }
+}
+
+void MCP2515Class::handleTxComplete(uint8_t intf)
+{
+  for (int n = 0; n < 3; n++) {
+    if ((_rtsMask & (1 << n)) && (intf & FLAG_TXnIF(n))) {
+      // a pin triggered frame went out, reload the buffer if a new one is staged
+      _txTimestamp = micros();
+
+      modifyRegister(REG_CANINTF, FLAG_TXnIF(n), 0x00);
+      loadStagedTxBuffer(n);
+    }
+  }
+}
+
+void MCP2515Class::handleErrors(uint8_t intf)
+{
+  if (intf & FLAG_MERRF) {
+    // an error frame on the bus
+    _errorFrames++;
+  }
+
+  if (intf & FLAG_ERRIF) {
+    uint8_t eflg = readRegister(REG_EFLG);
+
+    if (eflg & FLAG_RX0OVR) {
+      _overflows++;
+    }
+
+    if (eflg & FLAG_RX1OVR) {
+      _overflows++;
+    }
+
+    modifyRegister(REG_EFLG, FLAG_RX1OVR | FLAG_RX0OVR, 0x00);
+  }
+
+  modifyRegister(REG_CANINTF, intf & (FLAG_MERRF | FLAG_ERRIF), 0x00);
+}
+
+int MCP2515Class::setRTSMask(uint8_t mask)
+{
+  // TXnRTS pin modes and the TX interrupts can only be changed in config mode
+  if (!setMode(MODE_CONFIG)) {
+    return 0;
+  }
+
+  writeRegister(REG_TXRTSCTRL, mask);
+  modifyRegister(REG_CANINTE, FLAG_TXnIE(0) | FLAG_TXnIE(1) | FLAG_TXnIE(2),
+                 ((mask & 0x01) ? FLAG_TXnIE(0) : 0) | ((mask & 0x02) ? FLAG_TXnIE(1) : 0) | ((mask & 0x04) ? FLAG_TXnIE(2) : 0));
+  _rtsMask = mask;
+
+  return setMode(_mode);
+}
+
+int MCP2515Class::writeBitTiming(long baudRate)
+{
+  const struct {
+    long clockFrequency;
+    long baudRate;
+    uint8_t cnf[3];
+  } CNF_MAPPER[] = {
+    {  (long)8E6, (long)1000E3, { 0x00, 0x80, 0x00 } },
+    {  (long)8E6,  (long)500E3, { 0x00, 0x90, 0x02 } },
+    {  (long)8E6,  (long)250E3, { 0x00, 0xb1, 0x05 } },
+    {  (long)8E6,  (long)200E3, { 0x00, 0xb4, 0x06 } },
+    {  (long)8E6,  (long)125E3, { 0x01, 0xb1, 0x05 } },
+    {  (long)8E6,  (long)100E3, { 0x01, 0xb4, 0x06 } },
+    {  (long)8E6,   (long)80E3, { 0x01, 0xbf, 0x07 } },
+    {  (long)8E6,   (long)50E3, { 0x03, 0xb4, 0x06 } },
+    {  (long)8E6,   (long)40E3, { 0x03, 0xbf, 0x07 } },
+    {  (long)8E6,   (long)20E3, { 0x07, 0xbf, 0x07 } },
+    {  (long)8E6,   (long)10E3, { 0x0f, 0xbf, 0x07 } },
+    {  (long)8E6,    (long)5E3, { 0x1f, 0xbf, 0x07 } },
+
+    { (long)16E6, (long)1000E3, { 0x00, 0xd0, 0x82 } },
+    { (long)16E6,  (long)500E3, { 0x00, 0xf0, 0x86 } },
+    { (long)16E6,  (long)250E3, { 0x41, 0xf1, 0x85 } },
+    { (long)16E6,  (long)200E3, { 0x01, 0xfa, 0x87 } },
+    { (long)16E6,  (long)125E3, { 0x03, 0xf0, 0x86 } },
+    { (long)16E6,  (long)100E3, { 0x03, 0xfa, 0x87 } },
+    { (long)16E6,   (long)80E3, { 0x03, 0xff, 0x87 } },
+    { (long)16E6,   (long)50E3, { 0x07, 0xfa, 0x87 } },
+    { (long)16E6,   (long)40E3, { 0x07, 0xff, 0x87 } },
+    { (long)16E6,   (long)20E3, { 0x0f, 0xff, 0x87 } },
+    { (long)16E6,   (long)10E3, { 0x1f, 0xff, 0x87 } },
+    { (long)16E6,    (long)5E3, { 0x3f, 0xff, 0x87 } },
+  };
+
+  for (unsigned int i = 0; i < (sizeof(CNF_MAPPER) / sizeof(CNF_MAPPER[0])); i++) {
+    if (CNF_MAPPER[i].clockFrequency == _clockFrequency && CNF_MAPPER[i].baudRate == baudRate) {
+      writeRegister(REG_CNF1, CNF_MAPPER[i].cnf[0]);
+      writeRegister(REG_CNF2, CNF_MAPPER[i].cnf[1]);
+      writeRegister(REG_CNF3, CNF_MAPPER[i].cnf[2]);
+
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+int MCP2515Class::waitForTransmit()
+{
+  // let queued frames go out first, config mode would abort them
+  unsigned long start = millis();
+
+  for (int n = 0; n < 3; n++) {
+    while (!(_rtsMask & (1 << n)) && (readRegister(REG_TXBnCTRL(n)) & 0x08)) {
+      if ((millis() - start) > MODE_CHANGE_TIMEOUT) {
+        return 0;
+      }
+
+      yield();
+    }
+  }
+
+  return 1;
+}
+
+int MCP2515Class::setMode(uint8_t mode)
+{
+  modifyRegister(REG_CANCTRL, MASK_REQOP, mode);
+
+  // the controller finishes the frame on the bus before it changes mode
+  unsigned long start = millis();
+
+  while ((readRegister(REG_CANSTAT) & MASK_OPMOD) != mode) {
+    if ((millis() - start) > MODE_CHANGE_TIMEOUT) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+void MCP2515Class::packFilterId(uint8_t* regs, long id, bool extended)
+{
+  // RXFnSIDH, RXFnSIDL, RXFnEID8 and RXFnEID0, masks use the same layout
+  if (extended) {
+    id &= 0x1FFFFFFF;
+
+    regs[0] = id >> 21;
+    regs[1] = (((id >> 18) & 0x07) << 5) | FLAG_EXIDE | ((id >> 16) & 0x03);
+    regs[2] = (id >> 8) & 0xff;
+    regs[3] = id & 0xff;
+  } else {
+    id &= 0x7ff;
+
+    regs[0] = id >> 3;
+    regs[1] = id << 5;
+    regs[2] = 0x00;
+    regs[3] = 0x00;
+  }
+}
+
+int MCP2515Class::writeFilters(const FilterRegisters& regs)
+{
+  bool changed = false;
+
+  for (int n = 0; n < 6; n++) {
+    changed |= (memcmp(regs.filter[n], _filterRegs.filter[n], 4) != 0);
+  }
+
+  for (int n = 0; n < 2; n++) {
+    changed |= (memcmp(regs.mask[n], _filterRegs.mask[n], 4) != 0);
+  }
+
+  for (int n = 0; n < 2; n++) {
+    // RXBnCTRL can be written in any mode
+    if (regs.rxm[n] != _filterRegs.rxm[n]) {
+      modifyRegister(REG_RXBnCTRL(n), FLAG_RXM1 | FLAG_RXM0, regs.rxm[n]);
+      _filterRegs.rxm[n] = regs.rxm[n];
+
+      // a filter set while observing is kept after listen only mode
+      _listenRestore.rxm[n] = regs.rxm[n];
+    }
+  }
+
+  if (!changed) {
+    _offlineTime = 0;
+
+    return 1;
+  }
+
+  if (!waitForTransmit()) {
+    return 0;
+  }
+
+  unsigned long start = micros();
+
+  if (!setMode(MODE_CONFIG)) {
+    return 0;
+  }
+
+  // only the filters and masks that differ from the shadow copy are written
+  for (int n = 0; n < 6; n++) {
+    if (memcmp(regs.filter[n], _filterRegs.filter[n], 4) != 0) {
+      writeRegisters(REG_RXFnSIDH(n), regs.filter[n], 4);
+      memcpy(_filterRegs.filter[n], regs.filter[n], 4);
+    }
+  }
+
+  for (int n = 0; n < 2; n++) {
+    if (memcmp(regs.mask[n], _filterRegs.mask[n], 4) != 0) {
+      writeRegisters(REG_RXMnSIDH(n), regs.mask[n], 4);
+      memcpy(_filterRegs.mask[n], regs.mask[n], 4);
+    }
+  }
+
+  int result = setMode(_mode);
+
+  _offlineTime = micros() - start;
+
+  return result;
+}
+
+int MCP2515Class::qualifySPIFrequency()
+{
+  // RXF0SIDL bits 4 and 2 are not implemented and read as 0
+  const uint8_t mask[4] = { 0xff, 0xeb, 0xff, 0xff };
+  const uint8_t patterns[][4] = {
+    { 0x55, 0xaa, 0x55, 0xaa },
+    { 0xaa, 0x55, 0xaa, 0x55 },
+    { 0xff, 0x00, 0xff, 0x00 },
+    { 0x00, 0xff, 0x00, 0xff },
+    { 0x01, 0x02, 0x04, 0x08 },
+    { 0x10, 0x20, 0x40, 0x80 },
+    { 0xfe, 0xfd, 0xfb, 0xf7 },
+    { 0xef, 0xdf, 0xbf, 0x7f },
+  };
+
+  for (int f = 0; f < SPI_AUTO_FREQUENCY_COUNT; f++) {
+    uint32_t frequency = SPI_AUTO_FREQUENCIES[f];
+
+    if (frequency > _spiFrequencyAutoMax) {
+      continue;
+    }
+
+    _spiSettings = SPISettings(frequency, MSBFIRST, SPI_MODE0);
+
+    bool ok = true;
+
+    // write and read back RXF0 as a burst, repeated to catch marginal timing
+    for (int repeat = 0; ok && repeat < SPI_AUTO_REPEAT; repeat++) {
+      for (unsigned int p = 0; ok && p < (sizeof(patterns) / sizeof(patterns[0])); p++) {
+        uint8_t values[4];
+
+        writeRegisters(REG_RXFnSIDH(0), patterns[p], 4);
+        readRegisters(REG_RXFnSIDH(0), values, 4);
+
+        for (int i = 0; i < 4; i++) {
+          if (values[i] != (patterns[p][i] & mask[i])) {
+            ok = false;
+          }
+        }
+      }
+    }
+
+    if (ok) {
+      // back to the reset value, which the filter shadow copy expects
+      const uint8_t zero[4] = { 0x00, 0x00, 0x00, 0x00 };
+
+      writeRegisters(REG_RXFnSIDH(0), zero, 4);
+      _spiFrequency = frequency;
+
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+void MCP2515Class::readRegisters(uint8_t address, uint8_t* values, int length)
+{
+  SPI.beginTransaction(_spiSettings);
+  digitalWrite(_csPin, LOW);
+  SPI.transfer(0x03);
+  SPI.transfer(address);
+  for (int i = 0; i < length; i++) {
+    values[i] = SPI.transfer(0x00);
+  }
+  digitalWrite(_csPin, HIGH);
+  SPI.endTransaction();
+}
+
+void MCP2515Class::writeRegisters(uint8_t address, const uint8_t* values, int length)
+{
+  SPI.beginTransaction(_spiSettings);
+  digitalWrite(_csPin, LOW);
+  SPI.transfer(0x02);
+  SPI.transfer(address);
+  for (int i = 0; i < length; i++) {
+    SPI.transfer(values[i]);
+  }
   digitalWrite(_csPin, HIGH);
   SPI.endTransaction();
 }
@@ -32,15 +32,31 @@ public:
 
   virtual int endPacket();
 
+  int armPacket(int n);
+  int disarmPacket(int n);
+
   virtual int parsePacket();
 
   virtual void onReceive(void(*callback)(int));
+  int setInterruptMode(int mode);
+  unsigned long spuriousInterrupts();
+
+  void beginSPIShare();
+  void endSPIShare();
+  int yieldSPI();
+  long spiHoldBudget();
+  unsigned long spiWaitMax();
+  unsigned long spiWaitTotal();
 
   using CANControllerClass::filter;
   virtual int filter(int id, int mask);
   using CANControllerClass::filterExtended;
   virtual int filterExtended(long id, long mask);
 
+  int setFilter(int n, long id, bool extended = false);
+  int setMask(int n, long mask, bool extended = false);
+  void onFilter(int n, void(*callback)(int));
+
   virtual int observe();
   virtual int loopback();
   virtual int sleep();
@@ -48,26 +64,91 @@ public:
 
   void setPins(int cs = MCP2515_DEFAULT_CS_PIN, int irq = MCP2515_DEFAULT_INT_PIN);
   void setSPIFrequency(uint32_t frequency);
+  void setSPIFrequencyAuto(uint32_t maxFrequency = 10E6);
+  uint32_t spiFrequency();
   void setClockFrequency(long clockFrequency);
 
+  virtual int setBitRate(long baudRate);
+
+  virtual unsigned long errorFrameCount();
+  virtual int errorState();
+  unsigned long overflowCount();
+
   void dumpRegisters(Stream& out);
 
 private:
+  struct FilterRegisters {
+    uint8_t filter[6][4];
+    uint8_t mask[2][4];
+    uint8_t rxm[2];
+  };
+
+  struct ListenRestore {
+    uint8_t rxm[2];
+    uint8_t bukt;
+    uint8_t inte;
+  };
+
   void reset();
 
   void handleInterrupt();
+  void handleTxComplete(uint8_t intf);
+  void handleErrors(uint8_t intf);
+  int readRxBuffer(int n);
+  void attachIntPin();
+  void reattachIntPin();
+  void serviceDeferred();
+
+  int packTxBuffer(uint8_t* regs);
+  void loadTxBuffer(int n, const uint8_t* regs, int length);
+  void loadStagedTxBuffer(int n);
+  int setRTSMask(uint8_t mask);
+
+  int setMode(uint8_t mode);
+  int waitForTransmit();
+  int writeBitTiming(long baudRate);
+  void packFilterId(uint8_t* regs, long id, bool extended);
+  int writeFilters(const FilterRegisters& regs);
+  void leaveListenOnly();
+  int qualifySPIFrequency();
 
   uint8_t readRegister(uint8_t address);
   void modifyRegister(uint8_t address, uint8_t mask, uint8_t value);
   void writeRegister(uint8_t address, uint8_t value);
+  void readRegisters(uint8_t address, uint8_t* values, int length);
+  void writeRegisters(uint8_t address, const uint8_t* values, int length);
 
   static void onInterrupt();
 
 private:
   SPISettings _spiSettings;
+  uint32_t _spiFrequency;
+  uint32_t _spiFrequencyAutoMax;
   int _csPin;
   int _intPin;
   long _clockFrequency;
+
+  uint8_t _mode;
+  unsigned long _errorFrames;
+  unsigned long _overflows;
+  bool _interruptFalling;
+  unsigned long _spuriousInterrupts;
+
+  long _baudRate;
+  volatile bool _spiShared;
+  volatile bool _interruptDeferred;
+  volatile bool _handlingInterrupt;
+  volatile unsigned long _deferredSince;
+  unsigned long _spiWaitMax;
+  unsigned long _spiWaitTotal;
+  FilterRegisters _filterRegs;
+  ListenRestore _listenRestore;
+
+  uint8_t _rtsMask;
+  uint8_t _txStaged[3][13];
+  uint8_t _txStagedLength[3];
+
+  void (*_onFilter[6])(int);
 };
 
 extern MCP2515Class CAN;